@@ -1,7 +1,13 @@
 #include <include/drivers/kbd.h>
 #include <include/drivers/vga.h>
 #include <include/x86/idt.h>
+#include <include/x86/irq.h>
 #include <include/x86/io_port.h>
+#include <include/kernel/softirq.h>
+#include <include/kernel/profile.h>
+#include <include/kernel/trace.h>
+#include <include/kernel/logger.h>
+#include <include/kernel/spinlock.h>
 #include <include/helpers.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -441,17 +447,19 @@ static const char *escaped_to_string(uint8_t code) {
 	return str;
 }
 
+// Scan codes read by the interrupt handler, waiting to be decoded by the tasklet.
+static uint8_t scancodes[KBD_BUFFER_SIZE];
+static uint32_t scancodes_head;
+static uint32_t scancodes_tail;
+static spinlock_t scancodes_lock = SPINLOCK_INITIALIZER;
+
 // Keyboard state, which drives the statement machine in handler
 static uint8_t state = 0;
 
-// A simple (and temporary) handler that reads input from the hardware (keyboard)
-// and converts it into it's respective character codes.
+// Converts the scan code into it's respective character code.
 // Temporary: It currently prints out the key being pressed but that is because
 // I hav enot implemented a more adequate way of doing this.
-static void keyboard_irq_handler(struct registers *UNUSED(regs)) {
-	// Get what key has been pressed
-	uint8_t scancode = inb(KBD_PORT);
-
+static void keyboard_handle_scancode(uint8_t scancode) {
 	// Multibyte Sequence, change state
 	if (scancode == 0xE0) {
 		state = 1;
@@ -466,7 +474,31 @@ static void keyboard_irq_handler(struct registers *UNUSED(regs)) {
 	switch (state) {
 		// Waiting for first byte
 		case 0: {
+			// F12 shows what the interrupts have been up to, such as to catch a storm in the act.
+			if (KBD_SCAN_TABLE[scancode] == KBD_KEY_F12 && !released) {
+				irq_stats_dump();
+			}
+
+			// F9 starts tracing, and stops it again, sending off the trace over the serial port.
+			if (KBD_SCAN_TABLE[scancode] == KBD_KEY_F9 && !released) {
+				trace_toggle();
+			}
+
+			// F10 turns up how much is logged, down to TRACE, and then back to the default again.
+			if (KBD_SCAN_TABLE[scancode] == KBD_KEY_F10 && !released) {
+				static uint32_t level = LOG_LEVEL_DEFAULT;
+				level = level == LEVEL_TRACE ? LOG_LEVEL_DEFAULT : level - 1;
+				log_set_level_all(level);
+				KINFO("Log level: %d", level);
+			}
+
+			// F11 starts the profiler, and stops it again, sending off what it found over the serial port.
+			if (KBD_SCAN_TABLE[scancode] == KBD_KEY_F11 && !released) {
+				profile_toggle();
+			}
+
 			char *str = to_string(KBD_SCAN_TABLE[scancode]);
+			uint32_t flags = vga_lock();
 			uint32_t x = vga_get_x();
 			uint32_t y = vga_get_y();
 			vga_set_x(65);
@@ -477,19 +509,27 @@ static void keyboard_irq_handler(struct registers *UNUSED(regs)) {
 			printf("%s", str);
 			vga_set_x(x);
 			vga_set_y(y);
+			vga_unlock(flags);
 			return;
 		}
 		// Waiting for second byte of multibyte sequence
 		case 1:
 			switch (KBD_ESCAPED_SCAN_TABLE[scancode]) {
-				case KBD_KEY_DOWN:
+				case KBD_KEY_DOWN: {
+					uint32_t flags = vga_lock();
 					vga_scroll_down();
+					vga_unlock(flags);
 					break;
-				case KBD_KEY_UP:
+				}
+				case KBD_KEY_UP: {
+					uint32_t flags = vga_lock();
 					vga_scroll_up();
+					vga_unlock(flags);
 					break;
+				}
 				default: {
 					char *str = escaped_to_string(KBD_ESCAPED_SCAN_TABLE[scancode]);
+					uint32_t flags = vga_lock();
 					uint32_t x = vga_get_x();
 					uint32_t y = vga_get_y();
 					vga_set_x(65);
@@ -500,6 +540,7 @@ static void keyboard_irq_handler(struct registers *UNUSED(regs)) {
 					printf("%s", str);
 					vga_set_x(x);
 					vga_set_y(y);
+					vga_unlock(flags);
 				}
 			}
 			state = 0;
@@ -508,7 +549,41 @@ static void keyboard_irq_handler(struct registers *UNUSED(regs)) {
 
 }
 
+// Decodes and displays the keys pressed, which is far too slow to do with interrupts disabled.
+static void keyboard_tasklet(void *UNUSED(data)) {
+	while (true) {
+		uint32_t flags = spin_lock_irqsave(&scancodes_lock);
+		if (scancodes_head == scancodes_tail) {
+			spin_unlock_irqrestore(&scancodes_lock, flags);
+			return;
+		}
+
+		uint8_t scancode = scancodes[scancodes_head++ % KBD_BUFFER_SIZE];
+		spin_unlock_irqrestore(&scancodes_lock, flags);
+
+		keyboard_handle_scancode(scancode);
+	}
+}
+
+static tasklet_t kbd_tasklet = TASKLET_INITIALIZER(keyboard_tasklet, NULL);
+
+// Only reads the scan code, leaving the rest to the tasklet.
+static int keyboard_irq_handler(struct registers *UNUSED(regs), void *UNUSED(data)) {
+	// Get what key has been pressed
+	uint8_t scancode = inb(KBD_PORT);
+
+	// If the tasklet falls that far behind, the newest keys are dropped.
+	spin_lock(&scancodes_lock);
+	if (scancodes_tail - scancodes_head < KBD_BUFFER_SIZE) {
+		scancodes[scancodes_tail++ % KBD_BUFFER_SIZE] = scancode;
+	}
+	spin_unlock(&scancodes_lock);
+
+	tasklet_schedule(&kbd_tasklet);
+	return IRQ_HANDLED;
+}
+
 // Simple initializer that registers IRQ handler
 void keyboard_init() {
-	register_interrupt_handler(IRQ1, keyboard_irq_handler);
+	request_irq(IRQ1, keyboard_irq_handler, 0, "keyboard", NULL);
 }
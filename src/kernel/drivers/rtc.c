@@ -1,5 +1,9 @@
 #include <include/drivers/rtc.h>
 #include <include/x86/io_port.h>
+#include <include/x86/idt.h>
+#include <include/x86/irq.h>
+#include <include/kernel/workqueue.h>
+#include <include/helpers.h>
 #include <stdio.h>
 #include <stdbool.h>
 
@@ -8,12 +12,45 @@
 // Input port for Real-Time Clock
 #define RTC_IN 0x71
 
+// Status registers B and C, with the high bit set to keep NMIs disabled while we access them.
+#define RTC_STATUS_B 0x8B
+#define RTC_STATUS_C 0x8C
+// Bit in status register B that enables the interrupt raised after each (once a second) update.
+#define RTC_UPDATE_INTERRUPT 0x10
+
+// Queued after each update, if set (see rtc_set_update_work)
+static work_t *update_work;
+
 static uint8_t as_binary(uint8_t bcd) {
 	return ((bcd >> 4) * 10) + (bcd & 0x0F);
 }
 
+static int rtc_irq_handler(struct registers *UNUSED(regs), void *UNUSED(data)) {
+	// Status register C must be read, otherwise the RTC will not raise any further interrupts
+	outb(RTC_OUT, RTC_STATUS_C);
+	if ((inb(RTC_IN) & RTC_UPDATE_INTERRUPT) && update_work) {
+		schedule_work(update_work);
+	}
+
+	return IRQ_HANDLED;
+}
+
 void rtc_init() {
-	// TODO: Register IRQ handler (IRQ8)
+	request_irq(IRQ8, rtc_irq_handler, 0, "rtc", NULL);
+
+	// Enable the update-ended interrupt, preserving the rest of status register B
+	outb(RTC_OUT, RTC_STATUS_B);
+	uint8_t status = inb(RTC_IN);
+	outb(RTC_OUT, RTC_STATUS_B);
+	outb(RTC_IN, status | RTC_UPDATE_INTERRUPT);
+
+	// Discard any interrupt that was already pending
+	outb(RTC_OUT, RTC_STATUS_C);
+	inb(RTC_IN);
+}
+
+void rtc_set_update_work(work_t *work) {
+	update_work = work;
 }
 
 uint8_t rtc_get_second() {
@@ -0,0 +1,305 @@
+#include <include/drivers/serial.h>
+#include <include/x86/io_port.h>
+#include <include/x86/irq.h>
+#include <include/x86/irqflags.h>
+#include <include/kernel/spinlock.h>
+#include <include/kernel/logger.h>
+#include <include/sched/preempt.h>
+#include <include/sched/wait.h>
+#include <include/helpers.h>
+#include <string.h>
+
+#define COM1 0x3F8
+#define COM1_IRQ IRQ4
+
+// Registers, as offsets from the base port. The first two are the divisor instead while DLAB is set.
+#define SERIAL_DATA 0
+#define SERIAL_IER 1
+#define SERIAL_IIR 2
+#define SERIAL_FCR 2
+#define SERIAL_LCR 3
+#define SERIAL_MCR 4
+#define SERIAL_LSR 5
+#define SERIAL_MSR 6
+#define SERIAL_SCRATCH 7
+
+// The divisor is taken of this rate
+#define SERIAL_CLOCK 115200
+
+#define IER_RX 1 << 0
+#define IER_TX 1 << 1
+#define IER_LINE 1 << 2
+
+// Interrupt identification: Bit 0 is clear while one is pending, and bits 1-3 say which.
+#define IIR_NONE 0x01
+#define IIR_ID_MASK 0x0E
+#define IIR_MODEM 0x00
+#define IIR_TX 0x02
+#define IIR_RX 0x04
+#define IIR_LINE 0x06
+#define IIR_RX_TIMEOUT 0x0C
+// Both bits are set once the FIFOs are enabled on a 16550A; the original 16550 had a broken FIFO.
+#define IIR_FIFO_MASK 0xC0
+
+// Enable and clear both FIFOs, raising the receive interrupt once 14 bytes are waiting.
+#define FCR_ENABLE 0xC7
+
+#define LCR_8N1 0x03
+#define LCR_DLAB 0x80
+
+// OUT2 gates the interrupt line of the UART on PCs.
+#define MCR_DTR_RTS_OUT2 0x0B
+
+#define LSR_DATA_READY 0x01
+#define LSR_THR_EMPTY 0x20
+
+// Bytes the transmitter takes at once while it is empty
+#define FIFO_SIZE 16
+
+static bool present;
+
+// Size of the transmit FIFO, or 1 without a working one.
+static uint32_t fifo_size;
+
+// Set once we are panicking, after which nothing but polling is used (see serial_panic).
+static volatile bool panicking;
+
+// Protects both rings and the interrupt enable register.
+static spinlock_t serial_lock = SPINLOCK_INITIALIZER;
+
+static char tx_ring[SERIAL_TX_SIZE];
+static volatile uint32_t tx_head;
+static volatile uint32_t tx_tail;
+static wait_queue_t tx_waiters = WAIT_QUEUE_INITIALIZER(tx_waiters);
+
+static char rx_ring[SERIAL_RX_SIZE];
+static volatile uint32_t rx_head;
+static volatile uint32_t rx_tail;
+static wait_queue_t rx_waiters = WAIT_QUEUE_INITIALIZER(rx_waiters);
+
+// Bytes received while the ring was full
+static uint32_t rx_dropped;
+
+static uint8_t ier;
+
+static uint32_t tx_space() {
+	return SERIAL_TX_SIZE - (tx_tail - tx_head);
+}
+
+static void wait_thr_empty() {
+	while (!(inb(COM1 + SERIAL_LSR) & LSR_THR_EMPTY)) {
+		cpu_relax();
+	}
+}
+
+// Hands the UART as much of the ring as its FIFO takes, if it is done with what it had. With serial_lock held.
+static void tx_fill() {
+	if (!(inb(COM1 + SERIAL_LSR) & LSR_THR_EMPTY)) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < fifo_size && tx_head != tx_tail; i++) {
+		outb(COM1 + SERIAL_DATA, (uint8_t) tx_ring[tx_head++ % SERIAL_TX_SIZE]);
+	}
+}
+
+static void set_ier(uint8_t value) {
+	if (ier != value) {
+		ier = value;
+		outb(COM1 + SERIAL_IER, ier);
+	}
+}
+
+// Keeps the transmitter going, interrupting us whenever it needs more, for as long as there is any.
+static void tx_start() {
+	tx_fill();
+	set_ier(tx_head != tx_tail ? (uint8_t) (ier | (IER_TX)) : (uint8_t) (ier & ~(IER_TX)));
+}
+
+static void rx_drain() {
+	while (inb(COM1 + SERIAL_LSR) & LSR_DATA_READY) {
+		char c = (char) inb(COM1 + SERIAL_DATA);
+		if (rx_tail - rx_head < SERIAL_RX_SIZE) {
+			rx_ring[rx_tail++ % SERIAL_RX_SIZE] = c;
+		} else {
+			rx_dropped++;
+		}
+	}
+}
+
+static int serial_irq_handler(struct registers *UNUSED(regs), void *UNUSED(data)) {
+	bool handled = false;
+	bool received = false;
+	bool sent = false;
+
+	spin_lock(&serial_lock);
+
+	uint8_t iir;
+	while (!((iir = inb(COM1 + SERIAL_IIR)) & IIR_NONE)) {
+		handled = true;
+
+		switch (iir & IIR_ID_MASK) {
+			case IIR_TX:
+				tx_start();
+				sent = true;
+				break;
+			case IIR_RX:
+			case IIR_RX_TIMEOUT:
+				rx_drain();
+				received = true;
+				break;
+			case IIR_LINE:
+				inb(COM1 + SERIAL_LSR);
+				break;
+			case IIR_MODEM:
+				inb(COM1 + SERIAL_MSR);
+				break;
+		}
+	}
+
+	spin_unlock(&serial_lock);
+
+	if (sent) {
+		wake_up_all(&tx_waiters);
+	}
+	if (received) {
+		wake_up_all(&rx_waiters);
+	}
+
+	return handled ? IRQ_HANDLED : IRQ_NONE;
+}
+
+bool serial_init() {
+	// There is no telling whether the port exists, other than that its scratch register holds a value.
+	outb(COM1 + SERIAL_SCRATCH, 0x5A);
+	if (inb(COM1 + SERIAL_SCRATCH) != 0x5A) {
+		KWARNING("No serial port found");
+		return false;
+	}
+
+	uint16_t divisor = SERIAL_CLOCK / SERIAL_BAUD;
+	outb(COM1 + SERIAL_IER, 0);
+	outb(COM1 + SERIAL_LCR, LCR_DLAB);
+	outb(COM1 + SERIAL_DATA, (uint8_t) (divisor & 0xFF));
+	outb(COM1 + SERIAL_IER, (uint8_t) (divisor >> 8));
+	outb(COM1 + SERIAL_LCR, LCR_8N1);
+
+	outb(COM1 + SERIAL_FCR, FCR_ENABLE);
+	fifo_size = (inb(COM1 + SERIAL_IIR) & IIR_FIFO_MASK) == IIR_FIFO_MASK ? FIFO_SIZE : 1;
+	if (fifo_size == 1) {
+		outb(COM1 + SERIAL_FCR, 0);
+	}
+
+	// Anything left over from before we took over
+	while (inb(COM1 + SERIAL_LSR) & LSR_DATA_READY) {
+		inb(COM1 + SERIAL_DATA);
+	}
+
+	// COM3 may be on the same line.
+	request_irq(COM1_IRQ, serial_irq_handler, IRQF_SHARED, "serial", NULL);
+	outb(COM1 + SERIAL_MCR, MCR_DTR_RTS_OUT2);
+
+	uint32_t flags = spin_lock_irqsave(&serial_lock);
+	set_ier(IER_RX | IER_LINE);
+	present = true;
+	spin_unlock_irqrestore(&serial_lock, flags);
+
+	KDEBUG("Serial port at %x, %d baud, %d byte FIFO", COM1, SERIAL_BAUD, fifo_size);
+	return true;
+}
+
+static void poll_putc(char c) {
+	wait_thr_empty();
+	outb(COM1 + SERIAL_DATA, (uint8_t) c);
+}
+
+void serial_panic() {
+	if (!present || panicking) {
+		return;
+	}
+
+	// Whoever holds the lock may never let go of it, so the ring is taken as it is.
+	panicking = true;
+	outb(COM1 + SERIAL_IER, 0);
+	while (tx_head != tx_tail) {
+		poll_putc(tx_ring[tx_head++ % SERIAL_TX_SIZE]);
+	}
+}
+
+// Adds as much of 'buf' to the ring as fits, returning how much that was. With serial_lock held.
+static uint32_t tx_queue(const char *buf, uint32_t len) {
+	uint32_t i;
+	for (i = 0; i < len; i++) {
+		// Terminals expect both, and without the carriage return, lines would march off to the right.
+		uint32_t needed = buf[i] == '\n' ? 2 : 1;
+		if (tx_space() < needed) {
+			break;
+		}
+
+		if (buf[i] == '\n') {
+			tx_ring[tx_tail++ % SERIAL_TX_SIZE] = '\r';
+		}
+		tx_ring[tx_tail++ % SERIAL_TX_SIZE] = buf[i];
+	}
+
+	return i;
+}
+
+void serial_write(const char *buf, uint32_t len) {
+	if (!present) {
+		return;
+	}
+
+	if (panicking) {
+		for (uint32_t i = 0; i < len; i++) {
+			if (buf[i] == '\n') {
+				poll_putc('\r');
+			}
+			poll_putc(buf[i]);
+		}
+		return;
+	}
+
+	// Only tasks may wait for the interrupt handler to make room, and only once the scheduler is up.
+	bool can_sleep = preemptible() && task_current();
+
+	while (len) {
+		uint32_t flags = spin_lock_irqsave(&serial_lock);
+		uint32_t queued = tx_queue(buf, len);
+		buf += queued;
+		len -= queued;
+
+		// Out of room: Make some by waiting for the transmitter ourselves, if we can not sleep.
+		if (len && !can_sleep) {
+			wait_thr_empty();
+		}
+
+		tx_start();
+		spin_unlock_irqrestore(&serial_lock, flags);
+
+		if (len && can_sleep) {
+			wait_event(tx_waiters, tx_space() >= 2);
+		}
+	}
+}
+
+void serial_putc(char c) {
+	serial_write(&c, 1);
+}
+
+void serial_print(const char *str) {
+	serial_write(str, strlen(str));
+}
+
+uint32_t serial_read(char *buf, uint32_t len) {
+	wait_event(rx_waiters, rx_head != rx_tail);
+
+	uint32_t flags = spin_lock_irqsave(&serial_lock);
+	uint32_t count = 0;
+	while (count < len && rx_head != rx_tail) {
+		buf[count++] = rx_ring[rx_head++ % SERIAL_RX_SIZE];
+	}
+	spin_unlock_irqrestore(&serial_lock, flags);
+
+	return count;
+}
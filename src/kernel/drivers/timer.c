@@ -1,34 +1,58 @@
 #include <include/drivers/timer.h>
+#include <include/kernel/tick.h>
 #include <include/x86/io_port.h>
+#include <include/x86/irq.h>
 #include <include/helpers.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <limits.h>
 
-static const uint32_t oscillator_frequency = 1193180;
+// Number of PIT cycles in one jiffy
+static const uint32_t counts_per_tick = PIT_FREQUENCY / TIMER_HZ;
 
-static void timer_default_irq(struct registers *UNUSED(regs)) {
-	// NOP
-}
+static void pit_set_count(uint8_t mode, uint16_t count) {
+	outb(PIT_COMMAND, mode);
 
-void timer_init() {
-	register_interrupt_handler(IRQ0, timer_default_irq);
+	// Split the 16-bit count into two 8-bit numbers
+	outb(PIT_CHANNEL0, (uint8_t) (count & 0xFF));
+	outb(PIT_CHANNEL0, (uint8_t) ((count >> 8) & 0xFF));
 }
 
-void timer_set_handler(uint32_t frequency, void (*cb)(struct registers *registers)) {
+static void pit_set_periodic() {
 	// Note: Frequency MUST be large enough so that rate fits within a 2-byte range
-	uint16_t rate = (uint16_t) (oscillator_frequency / frequency);
+	pit_set_count(PIT_REPEAT, (uint16_t) counts_per_tick);
+}
 
-	// Whenever we receive an interrupt from the system timer...
-	register_interrupt_handler(IRQ0, cb);
+static void pit_set_oneshot(uint32_t ticks) {
+	pit_set_count(PIT_ONESHOT, (uint16_t) (ticks * counts_per_tick));
+}
+
+static void pit_shutdown() {
+	// In one-shot mode, the counter does not start until it is given a count, which we never do.
+	outb(PIT_COMMAND, PIT_ONESHOT);
+}
+
+static struct clock_event_device pit = {
+	.name = "PIT",
+	.set_periodic = pit_set_periodic,
+	.set_oneshot = pit_set_oneshot,
+	.shutdown = pit_shutdown,
+};
+
+static int timer_irq(struct registers *regs, void *UNUSED(data)) {
+	// No longer driving the tick, but an interrupt may have been on its way while it was replaced.
+	if (pit.event_handler) {
+		pit.event_handler(regs);
+	}
 
-	// Set PIT mode to repeatedly interrupt at the requested frequency (below)
-	outb(PIT_COMMAND, PIT_REPEAT);
+	return IRQ_HANDLED;
+}
 
-	// Split the 16-bit rate into two 8-bit numbers
-	uint8_t low = (uint8_t)(rate & 0xFF);
-	uint8_t high = (uint8_t)((rate >> 8) & 0xFF);
+void timer_init() {
+	// Whenever we receive an interrupt from the system timer...
+	request_irq(IRQ0, timer_irq, 0, "PIT", NULL);
 
-	// Send new frequency on channel 0
-	outb(PIT_CHANNEL0, low);
-	outb(PIT_CHANNEL0, high);
+	// ... the tick handles it. It starts out in periodic mode.
+	pit.max_delta_ticks = 0xFFFF / counts_per_tick;
+	tick_register_device(&pit);
 }
\ No newline at end of file
@@ -7,6 +7,8 @@
 #include <include/x86/io_port.h>
 #include <include/helpers.h>
 #include <include/kernel/mem.h>
+#include <include/kernel/spinlock.h>
+#include <include/x86/cpu.h>
 
 /* X and Y coordinates for current position in VGA buffer */
 static size_t x, y;
@@ -25,6 +27,12 @@ const size_t vga_width = 80;
 static array_t *lines;
 static size_t line_number = 0;
 
+// See vga_lock. The owner is the CPU holding the lock, and depth how many times it has taken it.
+#define NO_OWNER 0xFFFFFFFF
+static spinlock_t lock = SPINLOCK_INITIALIZER;
+static volatile uint32_t owner = NO_OWNER;
+static uint32_t depth;
+
 static inline uint8_t make_color(enum vga_color foreground, enum vga_color background);
 
 static inline uint16_t color_char(const char c);
@@ -55,6 +63,28 @@ void vga_init() {
 			buf[(i * vga_width) + j] = color_char(' ');
 }
 
+uint32_t vga_lock() {
+	uint32_t flags = irq_save();
+	uint32_t cpu = smp_processor_id();
+
+	if (owner != cpu) {
+		spin_lock(&lock);
+		owner = cpu;
+	}
+	depth++;
+
+	return flags;
+}
+
+void vga_unlock(uint32_t flags) {
+	if (--depth == 0) {
+		owner = NO_OWNER;
+		spin_unlock(&lock);
+	}
+
+	irq_restore(flags);
+}
+
 // Initializes rest of components to support scrolling.
 void vga_dynamic_init() {
 	// Create our buffer of lines.
@@ -7,6 +7,8 @@
 #define RELEASE_MASK 0x80
 #define KBD_NSCANS 0x80
 #define KBD_ESCAPED_NSCANS 0xE0
+// Number of scan codes which can be waiting to be decoded
+#define KBD_BUFFER_SIZE 64
 
 
 /*
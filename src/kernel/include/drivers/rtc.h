@@ -1,6 +1,8 @@
 #ifndef MOLTAROS_RTC_H
 #define MOLTAROS_RTC_H
 
+#include <include/kernel/workqueue.h>
+
 #include <stdint.h>
 
 /*
@@ -9,6 +11,10 @@
 
 void rtc_init();
 
+// Queues the work after each time the RTC updates its time, which happens once a second. Until the
+// next update begins, the time can be read without it changing underneath.
+void rtc_set_update_work(work_t *work);
+
 uint8_t rtc_get_second();
 
 uint8_t rtc_get_minute();
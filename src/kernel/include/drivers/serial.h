@@ -0,0 +1,41 @@
+#ifndef MOLTAROS_SERIAL_H
+#define MOLTAROS_SERIAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	Driver for the 16550 UART of the first serial port (COM1), to get data off the machine for
+	analysis elsewhere, such as on the host of an emulator, which can capture it to a file.
+
+	Writes go into a transmit ring, which the interrupt handler feeds to the UART a FIFO's worth at
+	a time, so that writers only wait for the port when the ring is full: Tasks sleep until there
+	is room, while anyone who can not (such as with interrupts disabled) pushes bytes out by polling
+	instead. Received bytes are kept in a ring of their own until read.
+
+	Once serial_panic is called, everything is polled, with no locks taken, so a panic still gets
+	its message out no matter what state the rest of the driver (or the CPU holding its lock) is in.
+*/
+
+#define SERIAL_BAUD 115200
+
+// Size of the transmit and receive rings, which must be powers of two
+#define SERIAL_TX_SIZE 4096
+#define SERIAL_RX_SIZE 256
+
+// Sets up the port, returning false if there is none.
+bool serial_init();
+
+void serial_putc(char c);
+
+void serial_write(const char *buf, uint32_t len);
+
+void serial_print(const char *str);
+
+// Blocks until anything has been received, then reads up to 'len' bytes of it. Returns how many were read.
+uint32_t serial_read(char *buf, uint32_t len);
+
+// Flushes the transmit ring by polling and switches to polled writes for good. Called on panics.
+void serial_panic();
+
+#endif /* endif MOLTAROS_SERIAL_H */
@@ -1,17 +1,28 @@
 #ifndef MOLTAROS_TIMER_H
 #define MOLTAROS_TIMER_H
 
+// Frequency of the oscillator which drives all channels of the PIT
+#define PIT_FREQUENCY 1193180
+
 #define PIT_CHANNEL0 0x40
 #define PIT_CHANNEL1 0x41
 #define PIT_CHANNEL2 0x42
 #define PIT_COMMAND 0x43
 #define PIT_REPEAT 0x36
+// Channel 0, mode 0: count down once and interrupt when reaching zero
+#define PIT_ONESHOT 0x30
+
+// Frequency of the periodic tick
+#define TIMER_HZ 1000
 
 #include <stdint.h>
 #include <include/x86/idt.h>
 
+/*
+	Driver for the Programmable Interval Timer (PIT), which drives the tick (see kernel/tick.h) of the
+	boot processor until the LAPIC timer takes over, if it does. It can interrupt either every jiffy,
+	or once after up to ~54 jiffies when the tick is stopped.
+*/
 void timer_init();
 
-void timer_set_handler(uint32_t frequency, void (*cb)(struct registers *registers));
-
 #endif /* MOLTAROS_TIMER_H */
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define MOLTAROS_VGA_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 enum vga_color {
 	COLOR_BLACK = 0,
@@ -30,6 +31,15 @@ extern const size_t vga_height;
 
 void vga_init();
 
+/*
+	Serializes output to the screen between CPUs and interrupt handlers, which is needed around
+	anything which moves the cursor and prints. It may be taken again by the CPU already holding it,
+	so that a panic while printing still gets its message out.
+*/
+uint32_t vga_lock();
+
+void vga_unlock(uint32_t flags);
+
 void vga_dynamic_init();
 
 /*
@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 
@@ -18,8 +19,41 @@ do { \
 // Ceiling of integer divison.
 #define CEILING(x,y) (((x) + (y) - 1) / (y))
 
+// Computes (a * mul) >> shift without losing the upper bits of the 96-bit intermediate product.
+// We avoid 64-bit division entirely in the kernel, so fixed-point multiplication like this is used
+// wherever we would otherwise need to divide (I.E: multiplying by a precomputed inverse).
+static inline uint64_t mul_u64_u32_shr(uint64_t a, uint32_t mul, uint32_t shift) {
+	uint32_t high = (uint32_t) (a >> 32);
+	uint32_t low = (uint32_t) a;
+	uint64_t ret = ((uint64_t) low * mul) >> shift;
+
+	if (high) {
+		ret += ((uint64_t) high * mul) << (32 - shift);
+	}
+
+	return ret;
+}
+
+// Divides a 64-bit number by a 32-bit one, storing the remainder in 'rem'. This is done as two
+// 32-bit divisions (the second being a 64-by-32 'divl'), since libgcc's __udivdi3 is not available.
+static inline uint64_t div_u64_rem(uint64_t dividend, uint32_t divisor, uint32_t *rem) {
+	uint32_t high = (uint32_t) (dividend >> 32);
+	uint32_t low = (uint32_t) dividend;
+	uint32_t quot_high = high / divisor;
+	uint32_t quot_low;
+
+	high %= divisor;
+	asm ("divl %4" : "=a" (quot_low), "=d" (*rem) : "a" (low), "d" (high), "rm" (divisor));
+
+	return ((uint64_t) quot_high << 32) | quot_low;
+}
+
+// Hints to the compiler about which way a branch usually goes, so that the common path is laid out straight.
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
 // Get rid of annoying compiler warnings
-#define UNUSED(x) (__attribute__((__unused__)) x)
+#define UNUSED(x) x __attribute__((__unused__))
 
 /*
 	Helper macros for implementations of a bit array, normally used in the kernel for keeping arrays of flags.
@@ -29,15 +63,15 @@ do { \
 #define BITMAP_SIZE(idx) CEILING(idx, 32)
 
 // Set bit
-#define BITMAP_SET(arr, idx) (arr[(idx / 32)] |= (1 << (idx % 32)))
+#define BITMAP_SET(arr, idx) (arr[(idx / 32)] |= (1u << (idx % 32)))
 
 // Get raw value of bit
-#define BITMAP_GET(arr, idx) (arr[(idx / 32)] & (1 << (idx % 32)))
+#define BITMAP_GET(arr, idx) (arr[(idx / 32)] & (1u << (idx % 32)))
 
 // Get value as 0 (false) or 1 (true)
 #define BITMAP_TEST(arr, idx) (!!BIT_ARRAY_GET(arr, idx))
 
 // Clear bit
-#define BITMAP_CLEAR(arr, idx) (arr[(idx / 32)] &= ~(1 << (idx % 32)))
+#define BITMAP_CLEAR(arr, idx) (arr[(idx / 32)] &= ~(1u << (idx % 32)))
 
 #endif /* end MLTAROS_HELPERS_H */
\ No newline at end of file
@@ -0,0 +1,43 @@
+#ifndef MOLTAROS_KSYMS_H
+#define MOLTAROS_KSYMS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	Symbol table of every function in the kernel, linked into the kernel itself, so that addresses
+	can be turned into names without anything from the host. The kernel is linked twice: The first
+	time without the table, which is then generated (by ksyms.py) from the symbols of the result
+	and linked in the second time. The table goes into .rodata, past all code, so that no function
+	moves between the two.
+
+	Symbols are sorted by address, for a binary search. Their names are compressed: Bytes from
+	KSYM_TOKEN_BASE up each stand for one of the strings in a token table, chosen by ksyms.py as
+	those that save the most. As that leaves no way to find a name but from the one before it, the
+	offset of every KSYM_MARKER_INTERVAL'th name is kept.
+
+	Until the second link, such as in a kernel built without the table, there are no symbols and
+	every lookup fails.
+*/
+
+// Longest name (including the terminator), past which they are cut off
+#define KSYM_NAME_LEN 64
+
+// Space needed by sprint_symbol, for the name, the offset from it, and the terminator.
+#define KSYM_SYMBOL_LEN (KSYM_NAME_LEN + 12)
+
+#define KSYM_MARKER_INTERVAL 16
+#define KSYM_TOKEN_BASE 0x80
+
+/*
+	Finds the function containing 'addr', copying its name into 'name' (which must hold KSYM_NAME_LEN)
+	and setting 'offset' to how far into it the address is. Returns false if the address is not in
+	any function.
+*/
+bool ksym_lookup(uint32_t addr, char *name, uint32_t *offset);
+
+// Writes 'addr' as 'name+0x1a' if it is in a function, or as its plain address otherwise, into 'buf',
+// which must hold KSYM_SYMBOL_LEN. Returns the length written.
+int sprint_symbol(char *buf, uint32_t addr);
+
+#endif /* endif MOLTAROS_KSYMS_H */
@@ -0,0 +1,70 @@
+#ifndef MOLTAROS_KTIMER_H
+#define MOLTAROS_KTIMER_H
+
+#include <include/drivers/timer.h>
+#include <include/kernel/tick.h>
+#include <include/helpers.h>
+
+#include <sys/queue.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	Kernel timers, which run a callback once (or periodically) after some number of milliseconds.
+	Timers are kept in a hierarchical timing wheel, so that starting and cancelling a timer are both
+	O(1) regardless of how many are pending. Each CPU has a wheel of its own, run from its own tick,
+	and a timer goes into the wheel of the CPU it was started on, which is where its callback runs.
+	Callbacks are run from the timer interrupt, and so they must not block.
+*/
+
+// Comparisons of jiffies which remain correct when the counter wraps around.
+#define time_after(a, b) ((int32_t) ((b) - (a)) < 0)
+#define time_before(a, b) time_after(b, a)
+#define time_after_eq(a, b) ((int32_t) ((a) - (b)) >= 0)
+
+#define msecs_to_jiffies(ms) ((uint32_t) CEILING((uint64_t) (ms) * TIMER_HZ, 1000))
+
+struct timer_base;
+
+typedef struct ktimer {
+	// The jiffy at which the timer should fire
+	uint32_t expires;
+	// Number of jiffies between firings for periodic timers, or 0 if it only fires once
+	uint32_t period;
+	void (*callback)(void *data);
+	void *data;
+	bool pending;
+	// Wheel the timer was last started on
+	struct timer_base *base;
+	LIST_ENTRY(ktimer) entry;
+} ktimer_t;
+
+void ktimer_init();
+
+// Prepares the timer to run the callback; it is not started until one of the below is called.
+void ktimer_setup(ktimer_t *timer, void (*callback)(void *data), void *data);
+
+// Fires the timer once, 'ms' milliseconds from now. If it was already pending, it is restarted.
+void ktimer_start(ktimer_t *timer, uint32_t ms);
+
+// Fires the timer every 'ms' milliseconds, starting 'ms' milliseconds from now.
+void ktimer_start_periodic(ktimer_t *timer, uint32_t ms);
+
+// Fires the timer once at the given jiffy.
+void ktimer_start_at(ktimer_t *timer, uint32_t expires);
+
+// Number of jiffies from now until the wheel of this CPU next needs to run, which is 0 if a timer is
+// already due, or UINT32_MAX if it has no timers at all.
+uint32_t ktimer_next_expiry();
+
+// Stops the timer, returning whether it was pending.
+bool ktimer_cancel(ktimer_t *timer);
+
+// Same as ktimer_cancel, but also waits for the callback to finish if it is running on another
+// CPU, after which the timer may be freed. Must not be called from the timer's own callback.
+bool ktimer_cancel_sync(ktimer_t *timer);
+
+// Blocks the current task for at least 'ms' milliseconds.
+void ksleep(uint32_t ms);
+
+#endif /* endif MOLTAROS_KTIMER_H */
@@ -2,8 +2,13 @@
 #define MOLTAROS_LOGGER_H
 
 #include <include/drivers/vga.h>
+#include <include/drivers/serial.h>
+#include <include/kernel/time.h>
+#include <include/kernel/stacktrace.h>
+#include <include/helpers.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 // Our log levels
 #define LEVEL_ALL 0
@@ -12,58 +17,136 @@
 #define LEVEL_INFO 3
 #define LEVEL_WARNING 4
 #define LEVEL_ERROR 5
+#define LEVEL_PANIC 6
 
-// Current log level. Any below this are filtered
-#define LOG_LEVEL LEVEL_INFO
+// Level every subsystem starts out at. Any below it are filtered.
+#define LOG_LEVEL_DEFAULT LEVEL_INFO
 
-#ifndef NDEBUG
-	#define KLOG(level, color, format, ...) \
-		do { \
-			asm volatile ("cli"); \
-			vga_print("["); \
-			vga_print_color(color, level); \
-			vga_print("] "); \
-			printf(format "\n", ##__VA_ARGS__); \
-			asm volatile ("sti"); \
-		} while (0)
-#else
-	#define KLOG(level, color, format, ...)
-#endif
+/*
+	Messages are not written out by whoever logs them. Instead, each is appended as a record to a ring
+	buffer of the CPU it was logged on, which takes no lock, and a console thread (klogd), woken by the
+	first message logged while it sleeps, drains the rings, oldest first, to the screen and the serial
+	port. Until that thread is started, and once we panic, messages are still written out right away.
 
-#if LOG_LEVEL <= LEVEL_TRACE
-	#define KTRACE(format, ...) KLOG("TRACE", COLOR_BROWN, format, ##__VA_ARGS__)
-#else
-	#define KTRACE(format, ...) printf("")
-#endif
+	A record either holds the message, formatted when it is logged, or, for the binary variants such
+	as KTRACE_BIN, only the format and up to LOG_MAX_ARGS (32-bit) arguments, which are not formatted
+	until klogd gets to them. The latter is cheap enough for hot paths, but any strings passed must
+	still be around by then, such as string literals.
 
-#if LOG_LEVEL <= LEVEL_DEBUG
-	#define KDEBUG(format, ...) KLOG("DEBUG", COLOR_BLUE, format, ##__VA_ARGS__)
-#else
-	#define KDEBUG(format, ...) printf("")
-#endif
+	If a ring fills up faster than klogd drains it, further messages are dropped, and counted.
 
-#if LOG_LEVEL <= LEVEL_INFO
-	#define KINFO(format, ...) KLOG("INFO", COLOR_GREEN, format, ##__VA_ARGS__)
-#else
-	#define KINFO(format, ...) printf("")
-#endif
+	Each subsystem (the directory the code is in, as passed to the compiler by the Makefile) has a
+	log level of its own, which can be changed at any time. Messages below it cost a single branch.
+*/
 
-#if LOG_LEVEL <= LEVEL_WARNING
-	#define KWARNING(format, ...) KLOG("WARNING", COLOR_YELLOW, format, ##__VA_ARGS__)
-#else
-	#define KWARNING(format, ...) printf("")
+// Most arguments of a binary record
+#define LOG_MAX_ARGS 6
+
+// Longest formatted message, past which it is cut off
+#define LOG_TEXT_MAX 108
+
+// Records kept per CPU until klogd gets to them
+#define LOG_RECORDS 128
+
+// Where klogd writes to
+#define LOG_CONSOLE_VGA 1 << 0
+#define LOG_CONSOLE_SERIAL 1 << 1
+
+enum log_subsys {
+	LOG_KERNEL,
+	LOG_X86,
+	LOG_DRIVERS,
+	LOG_MM,
+	LOG_SCHED,
+	LOG_DS,
+	NR_LOG_SUBSYS
+};
+
+// Subsystem of each directory, as named by LOG_SUBSYS
+#define LOG_SUBSYS_kernel LOG_KERNEL
+#define LOG_SUBSYS_x86 LOG_X86
+#define LOG_SUBSYS_drivers LOG_DRIVERS
+#define LOG_SUBSYS_mm LOG_MM
+#define LOG_SUBSYS_sched LOG_SCHED
+#define LOG_SUBSYS_ds LOG_DS
+
+#ifndef LOG_SUBSYS
+	#define LOG_SUBSYS kernel
 #endif
 
-#if LOG_LEVEL <= LEVEL_ERROR
-	#define KERROR(format, ...) KLOG("ERROR", COLOR_RED, format, ##__VA_ARGS__)
+#define _LOG_SUBSYS_ID(subsys) LOG_SUBSYS_##subsys
+#define LOG_SUBSYS_ID(subsys) _LOG_SUBSYS_ID(subsys)
+
+// Number of arguments passed, up to LOG_MAX_ARGS
+#define LOG_NARGS(...) _LOG_NARGS(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define _LOG_NARGS(_0, _1, _2, _3, _4, _5, _6, n, ...) n
+
+extern uint8_t log_levels[NR_LOG_SUBSYS];
+
+static inline bool log_enabled(uint32_t subsys, uint32_t level) {
+	return level >= log_levels[subsys];
+}
+
+void log_set_level(uint32_t subsys, uint32_t level);
+
+// Sets the level of every subsystem at once
+void log_set_level_all(uint32_t level);
+
+// Chooses where klogd writes to (LOG_CONSOLE_*)
+void log_set_consoles(uint32_t consoles);
+
+// Appends a message, formatted right away.
+void klog(uint32_t subsys, uint32_t level, const char *format, ...);
+
+// Appends a message, to be formatted by klogd, with 'nargs' 32-bit arguments.
+void klog_binary(uint32_t subsys, uint32_t level, const char *format, uint32_t nargs, ...);
+
+// Writes out everything logged so far, if nobody else is already doing so.
+void log_flush();
+
+// Starts klogd, after which messages are no longer written out right away. Requires the scheduler.
+void log_start_console();
+
+// Whether klogd is waiting on the next tick to be woken, which must not be stopped until then.
+bool log_needs_tick();
+
+// Writes out whatever is left and from then on, writes every message out right away, taking no locks.
+void log_panic();
+
+#ifndef NDEBUG
+	#define KLOG(level, format, ...) \
+		do { \
+			if (unlikely(log_enabled(LOG_SUBSYS_ID(LOG_SUBSYS), level))) \
+				klog(LOG_SUBSYS_ID(LOG_SUBSYS), level, format, ##__VA_ARGS__); \
+		} while (0)
+
+	#define KLOG_BIN(level, format, ...) \
+		do { \
+			if (unlikely(log_enabled(LOG_SUBSYS_ID(LOG_SUBSYS), level))) \
+				klog_binary(LOG_SUBSYS_ID(LOG_SUBSYS), level, format, LOG_NARGS(__VA_ARGS__), ##__VA_ARGS__); \
+		} while (0)
 #else
-	#define KERROR(format, ...) printf("")
+	#define KLOG(level, format, ...)
+	#define KLOG_BIN(level, format, ...)
 #endif
 
+#define KTRACE(format, ...) KLOG(LEVEL_TRACE, format, ##__VA_ARGS__)
+#define KDEBUG(format, ...) KLOG(LEVEL_DEBUG, format, ##__VA_ARGS__)
+#define KINFO(format, ...) KLOG(LEVEL_INFO, format, ##__VA_ARGS__)
+#define KWARNING(format, ...) KLOG(LEVEL_WARNING, format, ##__VA_ARGS__)
+#define KERROR(format, ...) KLOG(LEVEL_ERROR, format, ##__VA_ARGS__)
+
+// Same as KTRACE and KDEBUG, but formatted by klogd (see above).
+#define KTRACE_BIN(format, ...) KLOG_BIN(LEVEL_TRACE, format, ##__VA_ARGS__)
+#define KDEBUG_BIN(format, ...) KLOG_BIN(LEVEL_DEBUG, format, ##__VA_ARGS__)
+
 // Kernel Panic which will just print error message and spin
 #define KPANIC(format, ...) \
 do { \
-	KLOG("PANIC", COLOR_RED, format, ##__VA_ARGS__); \
+	serial_panic(); \
+	log_panic(); \
+	KLOG(LEVEL_PANIC, format, ##__VA_ARGS__); \
+	dump_stack(); \
 	asm volatile ("cli"); \
 	while (true) \
 		asm volatile ("hlt"); \
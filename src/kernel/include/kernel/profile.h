@@ -0,0 +1,55 @@
+#ifndef MOLTAROS_PROFILE_H
+#define MOLTAROS_PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	Sampling profiler: While running, each tick of each CPU takes a sample of where it was
+	interrupted, as the instruction pointer along with the return addresses of the functions it is
+	nested in, found by following the chain of frame pointers (everything is built with
+	-fno-omit-frame-pointer). Samples go into a ring buffer per CPU, from which they are written out
+	over the serial port every PROFILE_DRAIN_MS while profiling, and once more when it stops, one per
+	line:
+
+		<cpu> <task> <eip> <return address> <return address> ...
+
+	innermost first, between a 'profile: begin' and a 'profile: end' line. Addresses are written as
+	'name+0x1a' (see kernel/ksyms.h), or in hexadecimal where that fails, which profile.py can still
+	symbolize against the symbol file made by script.sh. It turns them into a flat profile, or
+	folded stacks for flame graphs.
+
+	As samples are only taken on ticks, a CPU whose tick is stopped while it idles is not sampled.
+
+	A ring holds PROFILE_SAMPLES, a quarter of a second's worth at TIMER_HZ, which is plenty of room
+	between two drains. What bounds a profile is the serial port instead: at SERIAL_BAUD, only a few dozen
+	to a few hundred samples a second can be written out in all, depending on how deep their stacks
+	are. Samples taken while the rings are full are dropped, and counted on the 'profile: end' line.
+*/
+
+// Most return addresses kept with each sample
+#define PROFILE_MAX_DEPTH 14
+
+// Samples kept for each CPU until they are written out; any more are dropped.
+#define PROFILE_SAMPLES 256
+
+// How often the samples are written out while profiling, in milliseconds
+#define PROFILE_DRAIN_MS 50
+
+// Hooks the profiler up to the tick. It does not start sampling until profile_start.
+void profile_init();
+
+void profile_start();
+
+void profile_stop();
+
+bool profile_running();
+
+// Writes out (and with that, discards) every sample taken so far, and ends the dump. This is slow, so
+// it must be called from a task, never with interrupts disabled.
+void profile_dump();
+
+// Starts sampling, or stops it and writes out the samples in the background.
+void profile_toggle();
+
+#endif /* endif MOLTAROS_PROFILE_H */
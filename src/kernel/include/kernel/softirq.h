@@ -0,0 +1,75 @@
+#ifndef MOLTAROS_SOFTIRQ_H
+#define MOLTAROS_SOFTIRQ_H
+
+#include <include/sched/preempt.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	Softirqs are the 'bottom half' of interrupt handling: An interrupt handler only does what must
+	be done right away (I.E: acknowledging the device and reading its data), and raises a softirq
+	for the rest, which then runs with interrupts enabled once the last nested interrupt handler has
+	returned. Softirqs raised on a CPU run on that same CPU, and never nest within each other.
+
+	Should softirqs keep being raised faster than they can be run on the way out of interrupts, the
+	rest are left to a per-CPU thread (ksoftirqd), so that they can not starve tasks of the CPU.
+	They are also run there when raised outside of interrupt handlers.
+
+	Like interrupt handlers, softirqs must not block.
+*/
+enum {
+	SOFTIRQ_HI,
+	SOFTIRQ_TASKLET,
+	NR_SOFTIRQS
+};
+
+// Sets the function run for the softirq
+void open_softirq(uint32_t nr, void (*action)());
+
+// Marks the softirq as pending on this CPU
+void raise_softirq(uint32_t nr);
+
+// Runs the softirqs pending on this CPU, unless we are inside of an interrupt handler or another
+// softirq, in which case they will be run once it returns.
+void do_softirq();
+
+// Starts a ksoftirqd thread for each online CPU.
+void softirq_init();
+
+// Whether we are running a softirq, or they have been disabled (see local_bh_disable)
+static inline bool in_softirq() {
+	return preempt_count() & SOFTIRQ_MASK;
+}
+
+// Keeps softirqs from running on this CPU, for data shared with them. This also disables preemption.
+void local_bh_disable();
+
+// Enables softirqs again, running those which were raised in the meantime.
+void local_bh_enable();
+
+/*
+	Tasklets are a simpler interface on top of softirqs, with dynamically created handlers. A tasklet
+	runs on the CPU it was scheduled on, and is only ever run by one CPU at a time, so it need not
+	be reentrant. Scheduling a tasklet which has not yet run again only runs it once.
+*/
+#define TASKLET_STATE_SCHED (1 << 0)
+#define TASKLET_STATE_RUN (1 << 1)
+
+typedef struct tasklet {
+	struct tasklet *next;
+	volatile uint32_t state;
+	void (*func)(void *data);
+	void *data;
+} tasklet_t;
+
+#define TASKLET_INITIALIZER(func, data) { NULL, 0, func, data }
+
+void tasklet_init(tasklet_t *t, void (*func)(void *data), void *data);
+
+void tasklet_schedule(tasklet_t *t);
+
+// Same as tasklet_schedule, but runs before all other tasklets and softirqs.
+void tasklet_hi_schedule(tasklet_t *t);
+
+#endif /* endif MOLTAROS_SOFTIRQ_H */
@@ -0,0 +1,146 @@
+#ifndef MOLTAROS_SPINLOCK_H
+#define MOLTAROS_SPINLOCK_H
+
+#include <include/x86/irqflags.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	Spinlocks protect data shared between processors. Disabling interrupts is no longer enough
+	once there is more than one CPU, but it is still needed on top of the lock whenever the data is
+	also touched from an interrupt handler, otherwise the handler could spin forever on a lock held
+	by the code it interrupted; the _irqsave variants do both. Spinlocks must only be held briefly,
+	and never while blocking.
+
+	spinlock_t is a ticket lock: each CPU takes a ticket and waits for its number to be served, so
+	the lock is handed out in the order it was asked for, and no CPU can be starved by the others
+	repeatedly winning the race for it.
+*/
+typedef struct spinlock {
+	union {
+		uint32_t value;
+		struct {
+			// Ticket currently being served, and the next one to hand out
+			volatile uint16_t owner;
+			volatile uint16_t next;
+		} tickets;
+	};
+} spinlock_t;
+
+#define SPINLOCK_INITIALIZER { { 0 } }
+
+// Tells the processor we are busy-waiting, which saves power and avoids a pipeline flush on exit.
+static inline void cpu_relax() {
+	asm volatile ("pause" ::: "memory");
+}
+
+static inline void spin_lock_init(spinlock_t *lock) {
+	lock->value = 0;
+}
+
+static inline bool spin_is_locked(spinlock_t *lock) {
+	return lock->tickets.owner != lock->tickets.next;
+}
+
+static inline bool spin_trylock(spinlock_t *lock) {
+	// Only take a ticket if it would be served right away, both halves being compared at once.
+	uint32_t old = __atomic_load_n(&lock->value, __ATOMIC_RELAXED);
+	if ((old & 0xFFFF) != (old >> 16)) {
+		return false;
+	}
+
+	return __atomic_compare_exchange_n(&lock->value, &old, old + (1 << 16), false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static inline void spin_lock(spinlock_t *lock) {
+	uint16_t ticket = __atomic_fetch_add(&lock->tickets.next, 1, __ATOMIC_ACQUIRE);
+	while (__atomic_load_n(&lock->tickets.owner, __ATOMIC_ACQUIRE) != ticket) {
+		cpu_relax();
+	}
+}
+
+static inline void spin_unlock(spinlock_t *lock) {
+	// Only the holder ever changes the owner, so this need not be an atomic increment.
+	__atomic_store_n(&lock->tickets.owner, (uint16_t) (lock->tickets.owner + 1), __ATOMIC_RELEASE);
+}
+
+static inline uint32_t spin_lock_irqsave(spinlock_t *lock) {
+	uint32_t flags = irq_save();
+	spin_lock(lock);
+	return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint32_t flags) {
+	spin_unlock(lock);
+	irq_restore(flags);
+}
+
+/*
+	MCS queue lock, for locks which are often contended. Every ticket lock waiter spins on the same
+	word, which has to bounce between all of their caches each time the lock is handed over. Here,
+	each waiter instead queues a node of its own (usually on its stack) and spins only on that, so
+	the handover touches just the next waiter's cache line. The same node must be passed to unlock.
+*/
+struct mcs_node {
+	struct mcs_node *volatile next;
+	volatile bool locked;
+};
+
+typedef struct mcs_lock {
+	// Last node in the queue, whose owner is either holding the lock or the last to wait for it.
+	struct mcs_node *volatile tail;
+} mcs_lock_t;
+
+#define MCS_LOCK_INITIALIZER { NULL }
+
+static inline void mcs_lock_init(mcs_lock_t *lock) {
+	lock->tail = NULL;
+}
+
+static inline void mcs_lock(mcs_lock_t *lock, struct mcs_node *node) {
+	node->next = NULL;
+	node->locked = true;
+
+	struct mcs_node *prev = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+	if (!prev) {
+		return;
+	}
+
+	// Let whoever is ahead of us know to hand the lock to us, and wait until they do.
+	__atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+	while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE)) {
+		cpu_relax();
+	}
+}
+
+static inline void mcs_unlock(mcs_lock_t *lock, struct mcs_node *node) {
+	struct mcs_node *next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+	if (!next) {
+		// Nobody is waiting, unless someone has just queued themselves and not yet linked to us.
+		struct mcs_node *expected = node;
+		if (__atomic_compare_exchange_n(&lock->tail, &expected, NULL, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+			return;
+		}
+
+		while (!(next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE))) {
+			cpu_relax();
+		}
+	}
+
+	__atomic_store_n(&next->locked, false, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t mcs_lock_irqsave(mcs_lock_t *lock, struct mcs_node *node) {
+	uint32_t flags = irq_save();
+	mcs_lock(lock, node);
+	return flags;
+}
+
+static inline void mcs_unlock_irqrestore(mcs_lock_t *lock, struct mcs_node *node, uint32_t flags) {
+	mcs_unlock(lock, node);
+	irq_restore(flags);
+}
+
+#endif /* endif MOLTAROS_SPINLOCK_H */
@@ -0,0 +1,18 @@
+#ifndef MOLTAROS_STACKTRACE_H
+#define MOLTAROS_STACKTRACE_H
+
+#include <stdint.h>
+
+// Most calls printed by dump_stack
+#define STACK_TRACE_DEPTH 16
+
+/*
+	Saves up to 'max' return addresses, innermost first, by following the chain of frame pointers up
+	from 'fp' (everything is built with -fno-omit-frame-pointer). Returns how many were saved.
+*/
+uint32_t stack_trace_save(uint32_t fp, uint32_t *entries, uint32_t max);
+
+// Prints the calls that led up to its caller, by name (see kernel/ksyms.h).
+void dump_stack();
+
+#endif /* endif MOLTAROS_STACKTRACE_H */
@@ -0,0 +1,63 @@
+#ifndef MOLTAROS_TICK_H
+#define MOLTAROS_TICK_H
+
+#include <include/x86/idt.h>
+
+#include <stdint.h>
+
+/*
+	The tick, which advances jiffies and runs the timer wheel and the scheduler. Each CPU has a tick
+	of its own, driven by its own clock event device, which normally interrupts once every jiffy.
+	Whenever nothing needs to happen on the next jiffy, such as when the CPU is idle or the current
+	task still has a long slice ahead of it with no timer due, its periodic tick is stopped and the
+	device is instead programmed to fire once at the next real deadline.
+
+	Jiffies is shared by all CPUs, and is brought up to date from the clocksource by whichever one
+	gets to it first, so it keeps counting while every tick is stopped. Without a clocksource other
+	than jiffies itself (see kernel/time.h), the boot processor counts them off its own tick instead,
+	which is then never stopped.
+*/
+
+struct clock_event_device {
+	const char *name;
+	// Longest interval, in jiffies, which can be programmed in one-shot mode.
+	uint32_t max_delta_ticks;
+	// Interrupt every jiffy
+	void (*set_periodic)();
+	// Interrupt once, after the given number of jiffies
+	void (*set_oneshot)(uint32_t ticks);
+	// Stop interrupting altogether, once replaced by another device. Optional.
+	void (*shutdown)();
+	// Set by the tick, and called by the device from its interrupt handler.
+	void (*event_handler)(struct registers *regs);
+};
+
+// Number of ticks since the timer was initialized
+extern volatile uint32_t jiffies;
+
+// Drives the tick of the calling CPU from the device, starting in periodic mode. Any device which
+// drove it before is shut down.
+void tick_register_device(struct clock_event_device *dev);
+
+// Registers a callback to be run on each tick, after those registered before it.
+void tick_add_handler(void (*cb)(struct registers *regs));
+
+// Brings jiffies up to date if the tick is stopped. Called on entry to every interrupt.
+void tick_update_jiffies();
+
+// Returns jiffies, brought up to date first. Use this rather than jiffies outside of interrupts.
+uint32_t get_jiffies();
+
+/*
+	Reprograms the device of the calling CPU for its next deadline, stopping (or restarting) the
+	periodic tick as needed. Must be called whenever a deadline may have moved closer: a timer was
+	started, a task was woken, or a different task is now running. It looks at the timers and run
+	queue of the CPU to find the next deadline, so none of their locks may be held by the caller.
+*/
+void tick_nohz_update();
+
+// Makes another CPU, whose run queue just changed, call tick_nohz_update if its tick is stopped.
+// Unlike tick_nohz_update, this may be called with locks held.
+void tick_nohz_kick(uint32_t cpu);
+
+#endif /* endif MOLTAROS_TICK_H */
@@ -0,0 +1,41 @@
+#ifndef MOLTAROS_TIME_H
+#define MOLTAROS_TIME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define NSEC_PER_USEC 1000
+#define NSEC_PER_MSEC 1000000
+#define NSEC_PER_SEC 1000000000
+
+/*
+	A clocksource is a free-running counter which we read to tell the time, as opposed to the
+	tick which only tells us about whole jiffies. Cycles are converted to nanoseconds as
+	(cycles * mult) >> shift, so that no division is needed when reading the time.
+*/
+struct clocksource {
+	const char *name;
+	uint64_t (*read)();
+	uint32_t mult;
+	uint32_t shift;
+};
+
+/*
+	Switches to the clocksource, which counts at 'khz' thousand cycles per second. Time carries on
+	from where the previous clocksource left off. Until one is registered, it is derived from jiffies.
+*/
+void clocksource_register(struct clocksource *cs, uint32_t khz);
+
+// Whether a clocksource has been registered, so that time is kept independently of the tick.
+bool clocksource_continuous();
+
+// Monotonic time since boot, in nanoseconds.
+uint64_t ktime_get_ns();
+
+// Time since boot split into seconds and microseconds, for printing.
+void ktime_get_timestamp(uint32_t *sec, uint32_t *usec);
+
+// Busy-waits for at least the given number of microseconds, for hardware which needs a moment.
+void udelay(uint32_t usec);
+
+#endif /* endif MOLTAROS_TIME_H */
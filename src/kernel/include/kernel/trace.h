@@ -0,0 +1,96 @@
+#ifndef MOLTAROS_TRACE_H
+#define MOLTAROS_TRACE_H
+
+#include <include/helpers.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	Static tracepoints: Fixed points in hot paths which, while enabled, record an event each time
+	they are passed. While disabled, a tracepoint costs a load and a branch predicted not taken, so
+	they are left compiled in everywhere.
+
+	Each event is a fixed-size record of the time, the tracepoint, the current task and up to
+	TRACE_MAX_ARGS arguments, which goes into a ring buffer of the CPU it happened on. Once full,
+	the oldest records are overwritten, so the buffers always hold the last TRACE_RECORDS events of
+	each CPU, such as those leading up to a problem.
+
+	trace_dump writes the buffers out over the serial port as the raw records, in hexadecimal (so
+	that they can be mixed in with the log), between a 'trace: begin' and a 'trace: end' line:
+
+		trace: begin cpus=<cpus> records=<records>
+		tp <id> <name> <format>       For each tracepoint, with the format its arguments are printed with
+		t <cpu> <record>              For each event, oldest first, as the bytes of its struct trace_record
+		trace: end
+
+	trace.py turns that into a timeline, such as for chrome://tracing or Perfetto.
+*/
+
+#define TRACE_MAX_ARGS 4
+
+// Events kept per CPU
+#define TRACE_RECORDS 512
+
+/*
+	Every tracepoint, with the format of its arguments. New ones are added here, and are recorded
+	with trace_event(name, args...).
+*/
+#define TRACEPOINTS(TP) \
+	TP(sched_switch, "prev=%d next=%d prev_state=%d") \
+	TP(irq_entry, "vector=%x") \
+	TP(irq_exit, "vector=%x handled=%d") \
+	TP(kmalloc, "ptr=%x size=%d") \
+	TP(kfree, "ptr=%x") \
+	TP(page_fault, "addr=%x eip=%x error=%x") \
+	TP(frame_alloc, "frame=%x vaddr=%x")
+
+#define TRACEPOINT_ID(name, format) TP_##name,
+enum {
+	TRACEPOINTS(TRACEPOINT_ID)
+	NR_TRACEPOINTS
+};
+#undef TRACEPOINT_ID
+
+struct trace_record {
+	// Nanoseconds since boot (see kernel/time.h)
+	uint64_t time;
+	uint16_t id;
+	uint16_t cpu;
+	uint32_t task;
+	uint32_t args[TRACE_MAX_ARGS];
+} __attribute__((packed));
+
+extern volatile bool tracepoint_enabled[NR_TRACEPOINTS];
+
+void __trace_event(uint32_t id, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+
+// Records the event, if the tracepoint is enabled. Up to TRACE_MAX_ARGS arguments; any missing are 0.
+#define trace_event(name, ...) _trace_event(TP_##name, ##__VA_ARGS__, 0, 0, 0, 0)
+#define _trace_event(id, a0, a1, a2, a3, ...) \
+	do { \
+		if (unlikely(tracepoint_enabled[id])) \
+			__trace_event(id, (uint32_t) (a0), (uint32_t) (a1), (uint32_t) (a2), (uint32_t) (a3)); \
+	} while (0)
+
+void trace_init();
+
+// Enables or disables a tracepoint by name, returning false if there is none such.
+bool trace_set_enabled(const char *name, bool enabled);
+
+// Clears the buffers, then enables every tracepoint. Fails, without blocking, while the buffers
+// are still being written out.
+bool trace_start();
+
+// Disables every tracepoint, leaving the buffers as they are.
+void trace_stop();
+
+bool trace_running();
+
+// Writes out the buffers (see above). Slow, so it must be called from a task.
+void trace_dump();
+
+// Starts tracing, or stops it and writes out the buffers in the background.
+void trace_toggle();
+
+#endif /* endif MOLTAROS_TRACE_H */
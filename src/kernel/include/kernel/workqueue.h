@@ -0,0 +1,82 @@
+#ifndef MOLTAROS_WORKQUEUE_H
+#define MOLTAROS_WORKQUEUE_H
+
+#include <include/kernel/ktimer.h>
+
+#include <sys/queue.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	Work queues hand work off to be done in the background, by a pool of kernel threads (workers)
+	which is shared by all work queues. Unlike softirqs, work runs in a thread of its own, and so
+	it may block. Each CPU has its own pool, and work runs on the CPU it was queued on.
+
+	A pool starts out with a single worker. Whenever a worker starts on an item while no other is
+	idle, it starts another (up to WQ_MAX_WORKERS), and should a worker block in the middle of an item
+	while work is waiting, the scheduler has an idle one take over. As each worker needs a stack of
+	its own, this keeps many background jobs down to a few threads. On top of that,
+	each work queue limits how many of its items may be running on a CPU at once (max_active), the
+	rest waiting their turn without holding up the work of other queues.
+*/
+
+// Most workers a pool will start, per CPU
+#define WQ_MAX_WORKERS 4
+// Default limit of active work items per CPU, for each work queue
+#define WQ_DFL_ACTIVE WQ_MAX_WORKERS
+
+typedef struct workqueue workqueue_t;
+
+typedef struct work {
+	void (*func)(void *data);
+	void *data;
+	// Set from when the work is queued until it starts running; it is only ever queued once at a time.
+	volatile uint32_t pending;
+	workqueue_t *wq;
+	TAILQ_ENTRY(work) entry;
+} work_t;
+
+// Work which is only queued after a delay, by way of a kernel timer.
+typedef struct delayed_work {
+	work_t work;
+	ktimer_t timer;
+	uint32_t cpu;
+} delayed_work_t;
+
+// Shared by everything which has no need for a work queue of its own
+extern workqueue_t *system_wq;
+
+// Starts a worker on each online CPU, and creates system_wq. Must be called before any work is queued.
+void workqueue_init();
+
+// Creates a work queue which runs at most 'max_active' of its items per CPU at once, or WQ_DFL_ACTIVE if 0.
+workqueue_t *workqueue_create(const char *name, uint32_t max_active);
+
+void work_init(work_t *work, void (*func)(void *data), void *data);
+
+void delayed_work_init(delayed_work_t *dwork, void (*func)(void *data), void *data);
+
+// Queues the work on the given CPU, returning false if it was already pending. May be called
+// from interrupt handlers.
+bool queue_work_on(uint32_t cpu, workqueue_t *wq, work_t *work);
+
+// Same as queue_work_on, for the current CPU.
+bool queue_work(workqueue_t *wq, work_t *work);
+
+// Queues the work on the current CPU once 'ms' milliseconds have passed, returning false if it was already pending.
+bool queue_delayed_work(workqueue_t *wq, delayed_work_t *dwork, uint32_t ms);
+
+// Stops the delayed work from being queued, if it has not been yet, returning whether it was stopped.
+bool cancel_delayed_work(delayed_work_t *dwork);
+
+// Queues the work on system_wq.
+bool schedule_work(work_t *work);
+
+bool schedule_delayed_work(delayed_work_t *dwork, uint32_t ms);
+
+struct worker;
+
+// Called by the scheduler once a worker has blocked in the middle of a work item.
+void wq_worker_sleeping(struct worker *worker);
+
+#endif /* endif MOLTAROS_WORKQUEUE_H */
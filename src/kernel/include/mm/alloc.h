@@ -17,4 +17,7 @@ vaddr_t alloc_block();
 
 vaddr_t alloc_page_directory();
 
+// Maps the memory-mapped registers of a device at 'addr' to the same virtual address, uncached.
+vaddr_t alloc_map_device(paddr_t addr);
+
 #endif
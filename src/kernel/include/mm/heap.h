@@ -1,6 +1,8 @@
 #ifndef MOLTAROS_MEMORY_MANAGEMENT_H
 #define MOLTAROS_MEMORY_MANAGEMENT_H
 
+#include <include/kernel/spinlock.h>
+
 #include <stdint.h>
 #include <stddef.h>
 
@@ -28,8 +30,11 @@ struct memblock {
 	uint32_t last_alloc;
 };
 
+// The heap does its own locking, as it has to let go of the lock in the middle of long scans.
+// It may be used from interrupt handlers, as the lock is held with interrupts disabled.
 struct memheap {
 	memblock_t *head;
+	mcs_lock_t lock;
 };
 
 void memheap_init(memheap_t *heap);
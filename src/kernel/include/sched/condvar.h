@@ -0,0 +1,28 @@
+#ifndef MOLTAROS_CONDVAR_H
+#define MOLTAROS_CONDVAR_H
+
+#include <include/sched/wait.h>
+#include <include/sched/mutex.h>
+
+/*
+	Condition variable used together with a mutex_t protecting the condition.
+*/
+typedef struct condvar {
+	wait_queue_t waiters;
+} condvar_t;
+
+#define CONDVAR_INITIALIZER(c) { WAIT_QUEUE_INITIALIZER((c).waiters) }
+
+void cond_init(condvar_t *cond);
+
+// Atomically releases the mutex and blocks until signaled, then reacquires the mutex before returning.
+// As with any condition variable, the condition should be rechecked in a loop afterwards.
+void cond_wait(condvar_t *cond, mutex_t *mutex);
+
+// Wakes one waiter
+void cond_signal(condvar_t *cond);
+
+// Wakes all waiters
+void cond_broadcast(condvar_t *cond);
+
+#endif /* endif MOLTAROS_CONDVAR_H */
@@ -0,0 +1,101 @@
+#ifndef MOLTAROS_FIBER_H
+#define MOLTAROS_FIBER_H
+
+#include <include/kernel/spinlock.h>
+#include <include/sched/task.h>
+
+#include <sys/queue.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	Fibers are cooperative threads of execution which all run inside of a single kernel thread
+	(the host), under a scheduler of their own. They switch only when they yield or wait, never
+	behind each other's backs, so they need no locking among themselves, and switching between
+	them is little more than swapping stack pointers. Each has a small stack of its own rather
+	than the 4MB one of a thread, which makes it cheap to have thousands of them, such as one per
+	driver request or connection.
+
+	Interrupts arrive on whichever stack is in use at the time, so a fiber stack must leave room
+	for them (and the softirqs run on their way out) on top of what the fiber needs. Overflowing it
+	is caught, after the fact, when the fiber next switches out. Fibers share the FPU registers of
+	their host, so kernel_fpu_begin/end must not be held across a switch.
+
+	Blocking the host (such as on a mutex) blocks all of its fibers; a fiber waiting on an event
+	should instead use fiber_prepare_wait and fiber_wait, and have whoever signals it call
+	fiber_wake, which may be done from anywhere, including interrupt handlers.
+*/
+
+// Default and smallest stack size of a fiber, in bytes
+#define FIBER_STACK_SIZE 8192
+#define FIBER_STACK_MIN 4096
+
+#define FIBER_READY 0
+#define FIBER_RUNNING 1
+#define FIBER_WAITING 2
+#define FIBER_DONE 3
+
+typedef struct fiber_sched fiber_sched_t;
+
+typedef struct fiber {
+	// Saved stack pointer while switched out, as for tasks.
+	uint32_t esp;
+	void *stack;
+	uint32_t stack_size;
+	volatile int state;
+
+	void (*func)(void *data);
+	void *data;
+
+	fiber_sched_t *sched;
+	TAILQ_ENTRY(fiber) entry;
+} fiber_t;
+
+struct fiber_sched {
+	spinlock_t lock;
+	TAILQ_HEAD(, fiber) ready;
+	// Fibers which have not yet returned
+	uint32_t nr_fibers;
+	fiber_t *current;
+	// Stack pointer of the host while a fiber is running
+	uint32_t host_esp;
+	task_t *host;
+	// Set while the host is blocked, waiting for a fiber to become ready.
+	bool host_waiting;
+	uint32_t nr_switches;
+};
+
+void fiber_sched_init(fiber_sched_t *sched);
+
+/*
+	Creates a fiber which calls func(data), with a stack of 'stack_size' bytes (FIBER_STACK_SIZE if 0),
+	and makes it ready to run. The fiber, and its stack, are freed once func returns. May be called
+	from any thread, including fibers of the same scheduler.
+*/
+fiber_t *fiber_create(fiber_sched_t *sched, void (*func)(void *data), void *data, uint32_t stack_size);
+
+/*
+	Turns the calling thread into the host of the scheduler, running its fibers in turn until every
+	one of them has returned. While none are ready, the thread blocks until one is woken or created.
+*/
+void fiber_sched_run(fiber_sched_t *sched);
+
+// The fiber currently running, or NULL if not called from a fiber.
+fiber_t *fiber_current();
+
+// Lets the other ready fibers run before we continue.
+void fiber_yield();
+
+/*
+	Waits until the fiber is woken by fiber_wake. As with task_prepare_block, fiber_prepare_wait
+	must be called before checking the condition being waited on, so that a wakeup which comes in
+	between the two is not lost; fiber_wait then simply returns.
+*/
+void fiber_prepare_wait();
+
+void fiber_wait();
+
+// Makes a waiting fiber ready again, returning false if it was not waiting.
+bool fiber_wake(fiber_t *fiber);
+
+#endif /* endif MOLTAROS_FIBER_H */
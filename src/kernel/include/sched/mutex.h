@@ -0,0 +1,30 @@
+#ifndef MOLTAROS_MUTEX_H
+#define MOLTAROS_MUTEX_H
+
+#include <include/sched/wait.h>
+
+/*
+	A sleeping mutual exclusion lock. Contending tasks block rather than spin, and on unlock
+	ownership is handed directly to the longest waiting task, so that the lock can not be stolen
+	out from under it by the releasing task (or anyone else) before it gets to run.
+*/
+typedef struct mutex {
+	task_t *owner;
+	wait_queue_t waiters;
+} mutex_t;
+
+#define MUTEX_INITIALIZER(m) { NULL, WAIT_QUEUE_INITIALIZER((m).waiters) }
+
+void mutex_init(mutex_t *mutex);
+
+void mutex_lock(mutex_t *mutex);
+
+bool mutex_trylock(mutex_t *mutex);
+
+void mutex_unlock(mutex_t *mutex);
+
+// Releases the mutex without rescheduling; the caller must have interrupts disabled. May be
+// called with the lock of another wait queue held.
+void __mutex_unlock(mutex_t *mutex);
+
+#endif /* endif MOLTAROS_MUTEX_H */
@@ -0,0 +1,80 @@
+#ifndef MOLTAROS_PREEMPT_H
+#define MOLTAROS_PREEMPT_H
+
+#include <include/x86/cpu.h>
+#include <include/x86/irqflags.h>
+#include <include/x86/idt.h>
+#include <include/sched/task.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	Disabling preemption keeps the scheduler from switching away from the current task, and so
+	keeps it on this CPU, while interrupts are still allowed in. A reschedule asked for in the
+	meantime (such as by the tick, or by waking up a more deserving task) is held off until the
+	last preempt_enable, which then switches right away. Calls nest, and must be balanced.
+
+	The count lives in this CPU's struct cpu, and is changed with a single instruction on %fs,
+	so that an interrupt can never see it half-updated. Blocking while it is raised is a bug.
+
+	The low byte counts calls to preempt_disable, while the byte above it counts how many times
+	softirqs have been disabled (see kernel/softirq.h), which also keeps the scheduler away.
+*/
+#define PREEMPT_MASK 0x000000FF
+#define SOFTIRQ_OFFSET 0x00000100
+#define SOFTIRQ_MASK 0x0000FF00
+
+static inline uint32_t preempt_count() {
+	uint32_t count;
+	asm volatile ("movl %%fs:%c1, %0" : "=r" (count) : "i" (offsetof(struct cpu, preempt_count)));
+	return count;
+}
+
+static inline void preempt_count_add(uint32_t val) {
+	asm volatile ("addl %0, %%fs:%c1" :: "ri" (val), "i" (offsetof(struct cpu, preempt_count)) : "memory", "cc");
+}
+
+static inline void preempt_count_sub(uint32_t val) {
+	asm volatile ("subl %0, %%fs:%c1" :: "ri" (val), "i" (offsetof(struct cpu, preempt_count)) : "memory", "cc");
+}
+
+static inline void preempt_disable() {
+	asm volatile ("incl %%fs:%c0" :: "i" (offsetof(struct cpu, preempt_count)) : "memory", "cc");
+}
+
+// Enables preemption without checking for a pending reschedule, for when one is about to happen anyway.
+static inline void preempt_enable_no_resched() {
+	asm volatile ("decl %%fs:%c0" :: "i" (offsetof(struct cpu, preempt_count)) : "memory", "cc");
+}
+
+static inline void preempt_enable() {
+	bool zero;
+	asm volatile ("decl %%fs:%c1; sete %0" : "=qm" (zero) : "i" (offsetof(struct cpu, preempt_count)) : "memory", "cc");
+
+	// With interrupts disabled, the caller is still in a critical section of its own, and the
+	// reschedule is left to the next interrupt to return.
+	if (zero && irq_enabled()) {
+		sched_preempt();
+	}
+}
+
+// Whether the scheduler may switch away from us right now.
+static inline bool preemptible() {
+	return preempt_count() == 0 && irq_enabled() && !in_interrupt();
+}
+
+/*
+	An explicit preemption point, for long-running loops in the kernel. If a reschedule is
+	pending, the current task gives up the CPU here instead of holding it until the loop ends.
+	Must not be called while holding a spinlock, although it does nothing when interrupts or
+	preemption are disabled.
+*/
+static inline void cond_resched() {
+	if (irq_enabled()) {
+		sched_preempt();
+	}
+}
+
+#endif /* endif MOLTAROS_PREEMPT_H */
@@ -0,0 +1,193 @@
+#ifndef MOLTAROS_SCHED_H
+#define MOLTAROS_SCHED_H
+
+#include <include/sched/task.h>
+#include <include/drivers/timer.h>
+#include <include/kernel/spinlock.h>
+#include <include/helpers.h>
+
+#include <sys/tree.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	Internal interface shared between the core scheduler (sched/task.c) and the scheduling
+	classes that plug into it. Nothing outside of sched/ should need to include this.
+*/
+
+// Length of a scheduler tick
+#define NSEC_PER_TICK (1000000000ULL / TIMER_HZ)
+
+// Flags passed to sched_class->enqueue_task describing why the task is being enqueued.
+#define ENQUEUE_NEW 1 << 0
+#define ENQUEUE_WAKEUP 1 << 1
+
+// Range of nice levels; lower is 'less nice' and hence receives a larger share of the CPU.
+#define NICE_MIN -20
+#define NICE_MAX 19
+#define NICE_0_LOAD 1024
+
+// Round-robin slice of SCHED_RR tasks (100ms)
+#define SCHED_RR_TIMESLICE 100000000ULL
+
+// Deadline bandwidth (runtime / period) is kept in fixed point with this many fractional bits, and
+// deadline tasks may reserve at most 95% of each CPU, leaving some for everything else.
+#define BW_SHIFT 20
+#define BW_UNIT (1 << BW_SHIFT)
+#define DL_BW_LIMIT ((BW_UNIT * 95) / 100)
+
+struct rq;
+
+// Red-black tree of runnable tasks, ordered by their virtual runtime.
+RB_HEAD(task_tree, task);
+
+// Red-black tree of runnable deadline tasks, ordered by their deadline.
+RB_HEAD(dl_tree, task);
+
+TAILQ_HEAD(rt_queue, task);
+
+/*
+	The run queue for the fair scheduling class. The currently running task is NOT kept
+	inside of the tree, but it is accounted for in nr_running and load.
+*/
+struct cfs_rq {
+	struct task_tree tasks_timeline;
+	// Leftmost (smallest virtual runtime) task in the tree, cached to make picking O(1).
+	task_t *leftmost;
+	// The task currently running from this run queue, if any.
+	task_t *curr;
+	// Monotonically increasing lower bound on the virtual runtime of all runnable tasks,
+	// used to place newly created and woken tasks.
+	uint64_t min_vruntime;
+	// Number of runnable tasks and the sum of their weights
+	uint32_t nr_running;
+	uint32_t load;
+};
+
+/*
+	The run queue for the real-time class: A FIFO queue for each priority, along with a bitmap of
+	which are non-empty so the highest can be found quickly. Unlike the fair class, the current
+	task remains in its queue while it runs.
+*/
+struct rt_rq {
+	struct rt_queue queues[RT_PRIO_MAX + 1];
+	uint32_t bitmap[BITMAP_SIZE(RT_PRIO_MAX + 1)];
+	uint32_t nr_running;
+};
+
+/*
+	The run queue for the deadline class. As with the fair class, the current task is not kept in
+	the tree. Throttled tasks are neither, but still count as runnable.
+*/
+struct dl_rq {
+	struct dl_tree tasks_timeline;
+	task_t *leftmost;
+	task_t *curr;
+	LIST_HEAD(, task) throttled;
+	uint32_t nr_running;
+	// Sum of the bandwidth of all deadline tasks belonging to this CPU, runnable or not.
+	uint32_t total_bw;
+};
+
+struct rq {
+	// Protects the run queue and the scheduling state of its tasks
+	spinlock_t lock;
+	// The CPU this run queue belongs to
+	uint32_t cpu;
+	// Number of runnable tasks of all classes, including the current one (unless it is the idle task).
+	uint32_t nr_running;
+	// Number of context switches, and of tasks moved here from other CPUs
+	uint32_t nr_switches;
+	uint32_t nr_migrations;
+	// Number of times in a row that balancing found another CPU busier, but nothing could be moved.
+	uint32_t nr_balance_failed;
+	// Task which was switched out while no longer allowed to run here, to be moved elsewhere.
+	task_t *push_task;
+	// Work queue worker which blocked in the middle of a work item, for its pool to hear about.
+	struct worker *sleeping_worker;
+	// Scheduler clock in nanoseconds, updated from the clocksource on each scheduling event.
+	uint64_t clock;
+	// Set when the current task should be switched out at the next opportunity.
+	bool need_resched;
+	task_t *curr;
+	// Runs when no other task is runnable (see task_idle).
+	task_t *idle;
+	struct cfs_rq cfs;
+	struct rt_rq rt;
+	struct dl_rq dl;
+	// Accounting for this CPU (see sched_get_histograms)
+	struct sched_histogram wakeup_latency;
+	struct sched_histogram run_length;
+};
+
+/*
+	A scheduling class is a policy which decides which of its runnable tasks runs next. Classes
+	are chained through 'next' in order of priority, and the first class to return a task from
+	pick_next_task wins.
+*/
+struct sched_class {
+	const struct sched_class *next;
+
+	// Adds a runnable task to the class' run queue.
+	void (*enqueue_task)(struct rq *rq, task_t *task, int flags);
+	// Removes a task which is no longer runnable from the class' run queue.
+	void (*dequeue_task)(struct rq *rq, task_t *task);
+	// The current task voluntarily gives up the CPU.
+	void (*yield_task)(struct rq *rq);
+	// Check if a newly woken task should preempt the current one.
+	void (*check_preempt_curr)(struct rq *rq, task_t *task);
+	// Selects (and claims) the next task to run, or NULL if the class has none.
+	task_t *(*pick_next_task)(struct rq *rq);
+	// The previous task is being switched out.
+	void (*put_prev_task)(struct rq *rq, task_t *task);
+	// The current task has just joined the class (see sched_setattr), as though it had been picked.
+	void (*set_curr_task)(struct rq *rq, task_t *task);
+	// Called from the timer interrupt for the current task.
+	void (*task_tick)(struct rq *rq, task_t *task);
+	// A new task has been created from this class.
+	void (*task_fork)(task_t *task);
+	// The nice level of a task has changed.
+	void (*reweight_task)(struct rq *rq, task_t *task, int nice);
+	// Nanoseconds until the current task should be preempted, or UINT64_MAX if there is nothing to
+	// preempt it for. Used to decide for how long the tick can be stopped.
+	uint64_t (*time_slice_left)(struct rq *rq, task_t *task);
+	// Selects a queued task which may be moved to 'dst' (see can_migrate_task), or NULL if there is none.
+	task_t *(*pick_migration_task)(struct rq *rq, struct rq *dst, bool force);
+	// A task which is neither running nor queued is being moved from 'src' to 'dst'. Both are locked.
+	void (*migrate_task_rq)(task_t *task, struct rq *src, struct rq *dst);
+};
+
+extern const struct sched_class dl_sched_class;
+extern const struct sched_class rt_sched_class;
+extern const struct sched_class fair_sched_class;
+extern const struct sched_class idle_sched_class;
+
+// Marks the current task as needing to be rescheduled, interrupting its CPU if it is not ours.
+void resched_curr(struct rq *rq);
+
+/*
+	Whether the queued task may be moved from 'src' to 'dst' by the load balancer: It must be
+	allowed to run there, and it should not have run recently, as it would leave behind a cache
+	which is still warm. 'force' ignores the latter, for when nothing else could be found.
+*/
+bool can_migrate_task(struct rq *src, struct rq *dst, task_t *task, bool force);
+
+/*
+	Checks whether the deadline parameters can be admitted on the CPU of the run queue, which is locked,
+	and if so reserves their bandwidth, releasing whatever the task held before. Tasks leaving the
+	deadline class release theirs.
+*/
+bool dl_admit(struct rq *rq, task_t *task, const struct sched_attr *attr);
+
+// Gives throttled deadline tasks whose next period has begun their runtime back. Called from the
+// tick with the run queue locked.
+void dl_replenish_throttled(struct rq *rq);
+
+// Nanoseconds until the next throttled deadline task of the run queue is due to be replenished, or
+// UINT64_MAX if there are none.
+uint64_t dl_next_replenish(struct rq *rq);
+
+// Returns the current scheduler clock of this CPU, in nanoseconds.
+uint64_t sched_clock();
+
+#endif /* endif MOLTAROS_SCHED_H */
@@ -0,0 +1,30 @@
+#ifndef MOLTAROS_SEMAPHORE_H
+#define MOLTAROS_SEMAPHORE_H
+
+#include <include/sched/wait.h>
+
+#include <stdint.h>
+
+/*
+	A counting semaphore. When there are waiters, a post hands its unit directly to the first
+	of them instead of incrementing the count, so a woken task never finds it already taken.
+*/
+typedef struct semaphore {
+	uint32_t count;
+	wait_queue_t waiters;
+} semaphore_t;
+
+#define SEMAPHORE_INITIALIZER(s, n) { (n), WAIT_QUEUE_INITIALIZER((s).waiters) }
+
+void sem_init(semaphore_t *sem, uint32_t count);
+
+// Takes a unit, blocking until one is available.
+void sem_wait(semaphore_t *sem);
+
+// Takes a unit if one is available without blocking.
+bool sem_trywait(semaphore_t *sem);
+
+// Returns a unit, waking a waiter if there is one. Safe to call from interrupt handlers.
+void sem_post(semaphore_t *sem);
+
+#endif /* endif MOLTAROS_SEMAPHORE_H */
@@ -4,24 +4,233 @@
 #include <include/x86/idt.h>
 
 #include <sys/queue.h>
+#include <sys/tree.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
 
 typedef void (*task_fp)(void *);
 
+struct sched_class;
+
+// Runnable tasks are either running or waiting to run in the run queue, while blocked tasks
+// are waiting on some event (see wait.h) and are not in the run queue at all.
+#define TASK_RUNNING 0
+#define TASK_BLOCKED 1
+
+// Affinity mask allowing a task to run on any CPU (see thread_set_affinity)
+#define CPU_MASK_ALL 0xFFFFFFFF
+
+// Scheduling policies (see sched_setattr)
+#define SCHED_NORMAL 0
+#define SCHED_FIFO 1
+#define SCHED_RR 2
+#define SCHED_DEADLINE 3
+
+// Range of real-time priorities; higher runs first.
+#define RT_PRIO_MIN 1
+#define RT_PRIO_MAX 99
+
 typedef struct task {
-	uint32_t eip;
+	// Saved stack pointer while switched out; everything else is saved on the stack itself.
 	uint32_t esp;
-	uint32_t ebp;
 	uint32_t stack_start;
 	size_t id;
-	volatile uint32_t ticks;
+	volatile int state;
+
+	// Function (and its argument) the thread runs
+	task_fp entry;
+	void *args;
+
+	// Scheduling policy for this task and whether it is currently runnable.
+	const struct sched_class *sched_class;
+	bool on_rq;
+	// CPU whose run queue the task belongs to, the CPUs (as a bitmask) it may run on, and the
+	// number of times it has been moved between them.
+	uint32_t cpu;
+	uint32_t cpus_allowed;
+	uint32_t nr_migrations;
+
+	// Fair scheduling state. The virtual runtime is the amount of time the task ran, scaled
+	// inversely by its weight, which is derived from its nice level.
+	int nice;
+	uint32_t weight;
+	uint64_t vruntime;
+	// Time at which the task last began running, and how long it has run in total.
+	uint64_t exec_start;
+	uint64_t sum_exec_runtime;
+	// sum_exec_runtime at the time this task was last picked, used to measure its slice.
+	uint64_t prev_sum_exec_runtime;
+	RB_ENTRY(task) run_node;
+
+	// Scheduling policy, and real-time priority for SCHED_FIFO and SCHED_RR.
+	int policy;
+	int rt_priority;
+	TAILQ_ENTRY(task) rt_entry;
+
+	// Deadline scheduling parameters: Each period, the task may run for up to dl_runtime, which it
+	// must have received within dl_deadline of the period starting. All are in nanoseconds.
+	uint64_t dl_runtime;
+	uint64_t dl_deadline;
+	uint64_t dl_period;
+	// Runtime left in the current period, and the (absolute) deadline by which it must be used up.
+	int64_t runtime;
+	uint64_t deadline;
+	// Out of runtime, and waiting for the next period to begin.
+	bool dl_throttled;
+	RB_ENTRY(task) dl_node;
+	LIST_ENTRY(task) dl_throttled_entry;
+
+	// Accounting (see sched_get_task_stats): Switches away from the task when it blocked or yielded,
+	// and when it was preempted, and how long it has spent runnable but waiting for the CPU.
+	uint32_t nvcsw;
+	uint32_t nivcsw;
+	uint32_t nr_waits;
+	uint64_t wait_sum;
+	uint64_t wait_max;
+	// When the task last began waiting (0 if it is not), and whether that was because it was woken up.
+	uint64_t wait_start;
+	bool wait_woken;
+	// When the task was last switched to
+	uint64_t run_start;
+
+	// FXSAVE area for the FPU/SSE registers, allocated the first time the task uses them (see x86/fpu.h).
+	void *fpu_state;
+
+	// Scheduler of the fibers this task is hosting, if any (see fiber.h).
+	struct fiber_sched *fiber_sched;
+
+	// Set while the task is a work queue worker running a work item (see workqueue.h).
+	struct worker *wq_worker;
+
 	LIST_ENTRY(task) next_task;
 } task_t;
 
 void task_init();
 
-void thread_create(void (*task)(void *args), void *args);
+task_t *thread_create(void (*task)(void *args), void *args);
+
+// Sets the nice level, from -20 (highest priority) to 19 (lowest), of the task.
+void task_set_nice(task_t *task, int nice);
+
+/*
+	Restricts the task to the CPUs in 'mask', where bit N stands for CPU N. If it is not on one of
+	them, it is moved as soon as it is not running. Returns false, changing nothing, if none of them
+	are online.
+*/
+bool thread_set_affinity(task_t *task, uint32_t mask);
+
+/*
+	Scheduling policy and parameters of a task:
+	- SCHED_NORMAL tasks share the CPU fairly, weighted by their nice level.
+	- SCHED_FIFO tasks run before all normal tasks, highest priority first, and keep the CPU until they
+	  block or yield, or a higher priority one becomes runnable.
+	- SCHED_RR is the same as SCHED_FIFO, except tasks of the same priority take turns every slice.
+	- SCHED_DEADLINE tasks run before all others, earliest deadline first. A task is guaranteed 'runtime'
+	  nanoseconds of CPU time within 'deadline' nanoseconds of the start of each 'period', and is
+	  throttled until its next period should it try to use more. 'deadline' may be 0, which is the same
+	  as the period.
+*/
+struct sched_attr {
+	int policy;
+	int nice;
+	int priority;
+	uint64_t runtime;
+	uint64_t deadline;
+	uint64_t period;
+};
+
+/*
+	Changes the scheduling policy of the task, returning false, changing nothing, if the parameters
+	are invalid. For SCHED_DEADLINE, this also fails if the CPU of the task does not have enough time
+	left over to guarantee the runtime of all of its deadline tasks (admission control).
+*/
+bool sched_setattr(task_t *task, const struct sched_attr *attr);
+
+// Scheduling statistics of a CPU
+struct sched_cpu_stats {
+	uint32_t nr_running;
+	uint32_t nr_switches;
+	// Tasks moved to this CPU by load balancing or a change of affinity
+	uint32_t nr_migrations;
+};
+
+// Fills in the statistics of the CPU, returning false if it is not online.
+bool sched_get_cpu_stats(uint32_t cpu, struct sched_cpu_stats *stats);
+
+// Accounting of a task, with all times in nanoseconds
+struct sched_task_stats {
+	// Time spent running
+	uint64_t runtime;
+	// Switches away from the task because it blocked or yielded, and because it was preempted.
+	uint32_t nvcsw;
+	uint32_t nivcsw;
+	// Number of times the task waited to run once runnable, for how long in total, and the longest.
+	uint32_t nr_waits;
+	uint64_t wait_sum;
+	uint64_t wait_max;
+};
+
+void sched_get_task_stats(task_t *task, struct sched_task_stats *stats);
+
+/*
+	Histogram of scheduling delays, with buckets going up in powers of two. Bucket 0 counts those
+	under a microsecond, and bucket N those from 2^(N-1) up to 2^N microseconds, with the last one
+	counting everything longer than that as well. A microsecond is taken to be 1024 nanoseconds.
+*/
+#define SCHED_HIST_BUCKETS 24
+
+struct sched_histogram {
+	uint32_t buckets[SCHED_HIST_BUCKETS];
+	uint32_t count;
+	// Longest seen, in nanoseconds
+	uint64_t max;
+};
+
+/*
+	Fills in histograms of all CPUs combined: How long tasks waited to run after being woken up
+	(wakeup latency), and for how long tasks ran each time before being switched out (the part of
+	their slice which they used), which leaves out the idle task.
+*/
+void sched_get_histograms(struct sched_histogram *wakeup_latency, struct sched_histogram *run_length);
+
+void sched_reset_histograms();
 
 void yield();
 
+// The task currently running
+task_t *task_current();
+
+/*
+	Blocks the current task, removing it from the run queue until it is woken by task_wake.
+	task_prepare_block must be called first, before whatever lock protects the condition being
+	waited on is released, so that a wakeup which comes in between the two is not lost; task_block
+	then simply returns. Interrupts must be disabled by the caller throughout, and remain disabled
+	once we return. Most code should use the primitives in wait.h rather than using these directly.
+*/
+void task_prepare_block();
+
+void task_block();
+
+// Makes a blocked task runnable again, returning false if it was not blocked.
+bool task_wake(task_t *task);
+
+// Switches away from the current task if it has been marked as needing to be rescheduled,
+// such as after waking up a task which should preempt it. Does nothing inside of an interrupt
+// handler, as the interrupt will do so itself on exit, or while preemption is disabled, as
+// preempt_enable will do so once it is no longer.
+void sched_preempt();
+
+// Number of jiffies until the scheduler next needs the tick of this CPU to preempt its current
+// task, or UINT32_MAX if it does not need it at all.
+uint32_t sched_next_event();
+
+// Turns the calling task into the idle task, which only runs when no other task is runnable,
+// halting the CPU with the tick stopped until there is something to do. Never returns.
+void task_idle();
+
+// Same as task_idle, but for application processors, which start out running on 'stack' with no
+// task at all. Never returns.
+void sched_init_ap(uint32_t stack);
+
 #endif /* endif MOLTAROS_TASK_H */
\ No newline at end of file
@@ -0,0 +1,97 @@
+#ifndef MOLTAROS_WAIT_H
+#define MOLTAROS_WAIT_H
+
+#include <include/sched/task.h>
+#include <include/x86/irqflags.h>
+#include <include/kernel/ktimer.h>
+#include <include/kernel/spinlock.h>
+
+#include <sys/queue.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	A wait queue is a FIFO list of tasks blocked waiting for some event. Blocked tasks are removed
+	from the run queue entirely, so waiting costs no CPU time, and are made runnable again once
+	woken. Each waiter is described by an entry which lives on its own stack for the duration
+	of the wait. The queue has a lock of its own, which also serves to protect the condition being
+	waited on wherever that is convenient.
+*/
+typedef struct wait_queue_entry {
+	task_t *task;
+	// Set by the waker once the entry has been removed from the queue.
+	volatile bool woken;
+	TAILQ_ENTRY(wait_queue_entry) next;
+} wait_queue_entry_t;
+
+typedef struct wait_queue {
+	spinlock_t lock;
+	TAILQ_HEAD(, wait_queue_entry) waiters;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INITIALIZER(wq) { SPINLOCK_INITIALIZER, TAILQ_HEAD_INITIALIZER((wq).waiters) }
+
+void wait_queue_init(wait_queue_t *wq);
+
+bool wait_queue_empty(wait_queue_t *wq);
+
+/*
+	Appends the current task to the end of the queue, and blocks until it has been woken. Must be
+	called with the queue locked (see spin_lock_irqsave), so that the condition being waited on can
+	be checked and the task enqueued without a wakeup slipping in between. The lock is released
+	while blocked, and held again on return.
+*/
+void wait_queue_sleep(wait_queue_t *wq);
+
+// Same as wait_queue_sleep, but also gives up once 'jiffies' reaches 'deadline'. Returns false
+// if the task was woken by the timeout rather than from the queue.
+bool wait_queue_sleep_until(wait_queue_t *wq, uint32_t deadline);
+
+// The two halves of wait_queue_sleep, for when something must be done (I.E: releasing a mutex)
+// after the task has been queued, but before it blocks. The queue must remain locked throughout.
+void wait_queue_add(wait_queue_t *wq, wait_queue_entry_t *entry);
+
+void wait_queue_block(wait_queue_t *wq, wait_queue_entry_t *entry);
+
+// Wakes the task at the head of the queue, and returns it (or NULL if there were no waiters).
+task_t *wake_up_one(wait_queue_t *wq);
+
+// Wakes all tasks in the queue, returning how many there were.
+uint32_t wake_up_all(wait_queue_t *wq);
+
+// Same as the above, for when the queue is already locked.
+task_t *__wake_up_one(wait_queue_t *wq);
+
+uint32_t __wake_up_all(wait_queue_t *wq);
+
+/*
+	Blocks the current task until 'condition' becomes true. The condition is re-evaluated each
+	time the task is woken from 'wq', with the queue locked, so whoever makes it true must also
+	wake the queue afterwards.
+*/
+#define wait_event(wq, condition) \
+	do { \
+		uint32_t __wait_flags = spin_lock_irqsave(&(wq).lock); \
+		while (!(condition)) { \
+			wait_queue_sleep(&(wq)); \
+		} \
+		spin_unlock_irqrestore(&(wq).lock, __wait_flags); \
+	} while (0)
+
+/*
+	Same as wait_event, but gives up after 'ms' milliseconds. Evaluates to whether the condition
+	became true in time.
+*/
+#define wait_event_timeout(wq, condition, ms) \
+	({ \
+		uint32_t __wait_flags = spin_lock_irqsave(&(wq).lock); \
+		uint32_t __wait_deadline = get_jiffies() + msecs_to_jiffies(ms); \
+		bool __wait_done; \
+		while (!(__wait_done = (condition)) && time_before(jiffies, __wait_deadline)) { \
+			wait_queue_sleep_until(&(wq), __wait_deadline); \
+		} \
+		spin_unlock_irqrestore(&(wq).lock, __wait_flags); \
+		__wait_done; \
+	})
+
+#endif /* endif MOLTAROS_WAIT_H */
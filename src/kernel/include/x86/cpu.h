@@ -0,0 +1,103 @@
+#ifndef MOLTAROS_CPU_H
+#define MOLTAROS_CPU_H
+
+#include <include/x86/gdt.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	Per-CPU data, and helpers for querying the features of the processor we are running on.
+*/
+
+// Maximum number of processors we will bring up
+#define MAX_CPUS 8
+
+struct task;
+
+/*
+	Data private to each processor. The %fs segment of each CPU covers exactly its own struct cpu, so
+	that it can always find it without knowing who it is (see this_cpu).
+*/
+struct cpu {
+	// Must be first, as this_cpu reads it from %fs:0
+	struct cpu *self;
+	// Logical identifier, which is also the index into cpus. The boot processor is always 0.
+	uint32_t id;
+	uint8_t apic_id;
+	volatile bool online;
+
+	// The task running on this CPU
+	struct task *current;
+	// How many hardware interrupt handlers we are currently nested inside of.
+	uint32_t interrupt_depth;
+	// How many times preemption has been disabled on this CPU (see sched/preempt.h). This is per-CPU
+	// rather than per-task, as a task is never switched out while it is raised.
+	uint32_t preempt_count;
+	// Bitmap of softirqs raised on this CPU which have yet to run (see kernel/softirq.h).
+	uint32_t softirq_pending;
+	// The task whose FPU state is loaded in this CPU's registers, if any, and whether kernel code is
+	// using the FPU instead (see x86/fpu.h).
+	struct task *fpu_owner;
+	bool in_kernel_fpu;
+
+	struct gdt_entry gdt[GDT_MAX_ENTRIES];
+	struct gdt_ptr gdt_ptr;
+	struct tss_entry tss;
+};
+
+extern struct cpu cpus[MAX_CPUS];
+
+// Number of processors found, whether they could be started or not.
+extern uint32_t nr_cpus;
+
+#define for_each_online_cpu(cpu) \
+	for (cpu = cpus; cpu < cpus + nr_cpus; cpu++) \
+		if (cpu->online)
+
+// The CPU we are running on. Unless interrupts are disabled, the task may be moved to another
+// CPU right after, so the result must be used with care.
+static inline struct cpu *this_cpu() {
+	struct cpu *cpu;
+	asm volatile ("mov %%fs:0, %0" : "=r" (cpu));
+	return cpu;
+}
+
+static inline uint32_t smp_processor_id() {
+	return this_cpu()->id;
+}
+
+// Feature flags returned in EDX by CPUID leaf 1
+#define CPUID_FEAT_EDX_TSC 1 << 4
+#define CPUID_FEAT_EDX_MSR 1 << 5
+#define CPUID_FEAT_EDX_APIC 1 << 9
+#define CPUID_FEAT_EDX_FXSR 1 << 24
+#define CPUID_FEAT_EDX_SSE 1 << 25
+#define CPUID_FEAT_EDX_SSE2 1 << 26
+
+// Feature flags returned in ECX by CPUID leaf 1
+#define CPUID_FEAT_ECX_TSC_DEADLINE 1 << 24
+
+// Flags returned in EDX by CPUID leaf 0x80000007
+#define CPUID_APM_EDX_INVARIANT_TSC 1 << 8
+
+struct cpuid_regs {
+	uint32_t eax, ebx, ecx, edx;
+};
+
+static inline struct cpuid_regs cpuid(uint32_t leaf) {
+	struct cpuid_regs regs;
+	asm volatile ("cpuid" : "=a" (regs.eax), "=b" (regs.ebx), "=c" (regs.ecx), "=d" (regs.edx) : "a" (leaf), "c" (0));
+	return regs;
+}
+
+// Whether the feature in EDX of CPUID leaf 1 is supported.
+static inline bool cpu_has(uint32_t feature) {
+	return cpuid(1).edx & feature;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+	asm volatile ("wrmsr" :: "c" (msr), "A" (value) : "memory");
+}
+
+#endif /* endif MOLTAROS_CPU_H */
@@ -0,0 +1,36 @@
+#ifndef MOLTAROS_FPU_H
+#define MOLTAROS_FPU_H
+
+#include <include/sched/task.h>
+
+#include <stdbool.h>
+
+/*
+	The FPU and SSE registers are switched lazily. A task's registers are only saved when it is
+	switched out after having used them, after which CR0.TS is set so that whichever task next
+	touches them traps (#NM), and only then are its own registers restored. Tasks that never use
+	the FPU pay nothing, and never even get an area to save them in.
+
+	Kernel code is not compiled to use the FPU, so it may only do so between kernel_fpu_begin and
+	kernel_fpu_end, which must be short as preemption is disabled in between.
+*/
+
+// Enables the FPU and SSE on the boot processor, and handles the traps for lazy switching.
+void fpu_init();
+
+// Same as fpu_init, for each application processor.
+void fpu_init_cpu();
+
+// Saves the registers of the task if it used them, as it is being switched out. Interrupts must be disabled.
+void fpu_switch_out(task_t *prev);
+
+// Whether kernel_fpu_begin can be used here; it can not while this CPU is already in between the two.
+bool irq_fpu_usable();
+
+// Hands the FPU and SSE registers over to the kernel, saving those of the current task first. Their
+// contents are left as they were, so whatever is used must be initialized first.
+void kernel_fpu_begin();
+
+void kernel_fpu_end();
+
+#endif /* endif MOLTAROS_FPU_H */
@@ -3,6 +3,22 @@
 
 #include <stdint.h>
 
+/*
+	Each CPU has its own GDT with five entries: The mandatory null descriptor, the flat code and data
+	segments shared by everyone, a data segment covering just the CPU's own per-CPU data (loaded into
+	%fs, see x86/cpu.h) and the CPU's Task State Segment.
+*/
+#define GDT_MAX_ENTRIES 5
+
+#define GDT_DESCRIPTOR_NULL 0
+#define GDT_DESCRIPTOR_CODE 1
+#define GDT_DESCRIPTOR_DATA 2
+#define GDT_DESCRIPTOR_PERCPU 3
+#define GDT_DESCRIPTOR_TSS 4
+
+// Segment selectors are the byte offset of the descriptor (the low 3 bits hold the RPL and table).
+#define GDT_SELECTOR(descriptor) ((descriptor) << 3)
+
 /*
 	Access byte constants used to help with overall readability (and for my own benefit towards
 	fully understanding everything) to use when attempting to read and manage these flags.
@@ -55,9 +71,38 @@ struct __attribute__((packed)) gdt_ptr {
 
 
 /*
-	Initializes the Global Descriptor Table, setting up and initializing the Null, Code, and Data segments
-	as well as loading it into the CPU.
+	The Task State Segment. As we never leave ring 0 it is only required to exist, but it is where
+	the processor would find the stack to switch to when an interrupt arrives from a lower privilege
+	level, which is why each CPU needs its own.
+*/
+struct __attribute__((packed)) tss_entry {
+	uint32_t prev_tss;
+	uint32_t esp0;
+	uint32_t ss0;
+	uint32_t esp1;
+	uint32_t ss1;
+	uint32_t esp2;
+	uint32_t ss2;
+	uint32_t cr3;
+	uint32_t eip;
+	uint32_t eflags;
+	uint32_t eax, ecx, edx, ebx;
+	uint32_t esp, ebp, esi, edi;
+	uint32_t es, cs, ss, ds, fs, gs;
+	uint32_t ldt;
+	uint16_t trap;
+	uint16_t iomap_base;
+};
+
+struct cpu;
+
+/*
+	Initializes the Global Descriptor Table of the boot processor, setting up and initializing the Null,
+	Code, and Data segments as well as loading it into the CPU.
 */
 void gdt_init();
 
+// Same as above, but for the given CPU, which must be the one we are running on.
+void gdt_init_cpu(struct cpu *cpu);
+
 #endif /* MOLTAROS_GDT_H */
\ No newline at end of file
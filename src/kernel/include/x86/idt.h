@@ -2,6 +2,7 @@
 #define MOLTAROS_IDT_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #define IRQ0 32
 #define IRQ1 33
@@ -21,6 +22,14 @@
 #define IRQ15 47
 #define IRQ_YIELD 255
 
+// Vectors delivered by the LAPIC (see x86/lapic.h)
+#define LAPIC_SPURIOUS 0xEF
+#define IPI_RESCHEDULE 0xF0
+#define LAPIC_TIMER 0xF1
+
+// Raised in software to measure the cost of taking an interrupt (see irq_entry_cycles)
+#define IRQ_BENCH 0xF2
+
 #define IDT_FLAGS_GATE_TASK 0x5
 #define IDT_FLAGS_GATE_INTERRUPT16 0x6
 #define IDT_FLAGS_GATE_INTERRUPT32 0xE
@@ -95,11 +104,28 @@ typedef void (*interrupt_handler)(struct registers *);
 
 void idt_init();
 
+// Loads the IDT set up by idt_init on another CPU, which all CPUs share.
+void idt_init_cpu();
+
 /*
-	Registers an interrupt handler to the specified interrupt number
+	Registers an interrupt handler to the specified interrupt number, which must not have one already.
+	This is for exceptions only; hardware interrupts are requested with request_irq (see x86/irq.h).
 */
 void register_interrupt_handler(uint8_t int_num, void (*handler)(struct registers *));
 
+// Masks every line of both PICs, once the I/O APIC has taken over (see x86/ioapic.h).
+void pic_disable();
+
+/*
+	Measures how many cycles it takes, on average, to take an interrupt through the same path as a
+	hardware one and return from it, with a handler which does nothing. Returns 0 if it can not be
+	measured, which needs the TSC, and the I/O APIC to be in charge of interrupts.
+*/
+uint32_t irq_entry_cycles();
+
+// Whether we are currently running inside of a hardware interrupt handler
+bool in_interrupt();
+
 /*
 	Below are generic interrupt handler functions that can be used to call assembly labels.
 
@@ -138,6 +164,10 @@ extern void interrupt_service_request_29();
 extern void interrupt_service_request_30();
 extern void interrupt_service_request_31();
 extern void interrupt_service_request_255();
+extern void interrupt_request_reschedule();
+extern void interrupt_request_lapic_timer();
+extern void interrupt_request_bench();
+extern void interrupt_spurious();
 
 extern void interrupt_request_0 ();
 extern void interrupt_request_1 ();
@@ -0,0 +1,47 @@
+#ifndef MOLTAROS_IOAPIC_H
+#define MOLTAROS_IOAPIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	The I/O APIC takes over from the legacy 8259 PICs, routing each device interrupt to the LAPIC of
+	any processor through its redirection table. The interrupt is then acknowledged by a write to
+	the LAPIC rather than a command to each PIC over (slow) port I/O. ISA interrupts keep the vectors
+	they had under the PIC (IRQ0 to IRQ15), and are all delivered to the boot processor to begin with.
+*/
+
+// Register select and data window, the only memory-mapped registers
+#define IOAPIC_REGSEL 0x00
+#define IOAPIC_WIN 0x10
+
+// Registers reached through the window
+#define IOAPIC_ID 0x00
+#define IOAPIC_VERSION 0x01
+// Redirection table entry for each pin, two registers each
+#define IOAPIC_REDTBL(pin) (0x10u + (pin) * 2u)
+
+// Redirection entry: delivery mode (fixed), polarity, trigger mode and mask
+#define IOAPIC_REDIR_FIXED 0x000
+#define IOAPIC_REDIR_ACTIVE_LOW 1u << 13
+#define IOAPIC_REDIR_LEVEL 1u << 15
+#define IOAPIC_REDIR_MASKED 1u << 16
+
+#define ISA_IRQS 16
+
+// Programs the I/O APIC found in the MP tables and disables the PICs, returning false (leaving the
+// PICs in charge) if there is none. The LAPIC must already be initialized.
+bool ioapic_init();
+
+// Whether interrupts are being routed through the I/O APIC
+bool ioapic_enabled();
+
+// Stops or resumes delivery of the ISA interrupt.
+void ioapic_mask(uint8_t irq);
+
+void ioapic_unmask(uint8_t irq);
+
+// Delivers the ISA interrupt to the given CPU from now on, returning false if it is not online.
+bool ioapic_set_affinity(uint8_t irq, uint32_t cpu);
+
+#endif /* endif MOLTAROS_IOAPIC_H */
@@ -0,0 +1,108 @@
+#ifndef MOLTAROS_IRQ_H
+#define MOLTAROS_IRQ_H
+
+#include <include/x86/idt.h>
+#include <include/x86/tsc.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	Handlers of hardware interrupts (and IPIs), as opposed to exceptions, which are registered with
+	register_interrupt_handler. A vector may be shared between several handlers, such as devices on
+	the same interrupt line, each of which is called in turn and says whether the interrupt was its
+	own. They are called in the order they were requested.
+
+	A handler may also come with a thread function, in which case it is threaded: Its handler only
+	does what can not wait (such as quieting the device) and returns IRQ_WAKE_THREAD, after which the
+	thread function runs in a kernel thread of its own. That thread has a real-time priority, so it
+	still runs ahead of all normal tasks, but it may block, and it no longer keeps every other
+	interrupt waiting while it works.
+*/
+
+// Returned by handlers: Not ours, handled, or handled with the rest left to the thread.
+#define IRQ_NONE 0
+#define IRQ_HANDLED 1
+#define IRQ_WAKE_THREAD 2
+
+// Allows other handlers to share the vector. Every handler of a vector must agree to it.
+#define IRQF_SHARED 1 << 0
+
+// Real-time priority (see sched_setattr) of the threads of threaded handlers
+#define IRQ_THREAD_PRIORITY 50
+
+// Most handlers which can be requested, for all vectors together
+#define IRQ_MAX_ACTIONS 32
+
+typedef int (*irq_handler_t)(struct registers *regs, void *data);
+
+/*
+	Adds the handler to the vector, called with 'data' whenever it is raised. Returns false if the
+	vector is already taken, and either it or we do not allow sharing it.
+*/
+bool request_irq(uint8_t vector, irq_handler_t handler, uint32_t flags, const char *name, void *data);
+
+/*
+	Same as request_irq, but also starts a thread which calls thread_fn(data) every time the handler
+	returns IRQ_WAKE_THREAD. Wakeups which come in while it is still running are merged into a single
+	call after it. The handler may be NULL, in which case it always wakes the thread. Requires the
+	scheduler.
+*/
+bool request_threaded_irq(uint8_t vector, irq_handler_t handler, void (*thread_fn)(void *data),
+	uint32_t flags, const char *name, void *data);
+
+// Removes the handler requested with 'data' from the vector. The thread of a threaded handler is
+// left asleep for good, as threads can not exit yet.
+void free_irq(uint8_t vector, void *data);
+
+// Calls the handlers of the vector in the registers, returning whether any of them handled it.
+// Called by irq_handler.
+bool handle_irq(struct registers *regs);
+
+/*
+	Statistics of how often each vector is raised on each CPU, and how long it takes to handle. The
+	time from entering irq_handler until the handlers return is spent with interrupts disabled, and
+	is kept per vector, as well as in a histogram per CPU. The time until we leave again, after the
+	softirqs it raised have run, goes into a second histogram. Times are in TSC cycles, and are only
+	kept with a TSC; without one, only the counts are.
+
+	Bucket 0 of the histograms holds everything below 2^IRQ_HIST_SHIFT cycles, and each bucket after
+	holds twice as long a range as the one before, with the last one holding everything beyond.
+*/
+#define IRQ_HIST_BUCKETS 16
+#define IRQ_HIST_SHIFT 10
+
+struct irq_stats {
+	// Times raised
+	uint32_t count;
+	// Time spent with interrupts disabled handling it, in total and at most
+	uint64_t cycles;
+	uint32_t max_cycles;
+};
+
+// Timestamp to be passed to irq_stats_record, if there is a TSC to take it from.
+static inline uint64_t irq_timestamp() {
+	return tsc_khz ? rdtsc() : 0;
+}
+
+/*
+	Records an interrupt on this CPU, taken at 'entry', with its handlers done at 'handled' and the
+	softirqs after them at 'exit'. Called by irq_handler with interrupts disabled.
+*/
+void irq_stats_record(uint32_t vector, uint64_t entry, uint64_t handled, uint64_t exit);
+
+// Counts an exception (or any other interrupt which does not go through irq_handler) on this CPU.
+void irq_stats_count(uint32_t vector);
+
+// Sums up the statistics of the vector over all CPUs. They are updated without any locking, so
+// while interrupts keep coming in, they are only ever roughly consistent.
+void irq_stats_get(uint32_t vector, struct irq_stats *stats);
+
+// Prints the statistics of every vector raised so far, followed by the histograms of each CPU.
+// Takes a while, so it should not be called with interrupts disabled.
+void irq_stats_dump();
+
+// Clears all statistics, such as to see only what is raised from now on.
+void irq_stats_reset();
+
+#endif /* endif MOLTAROS_IRQ_H */
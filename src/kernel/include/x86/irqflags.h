@@ -0,0 +1,40 @@
+#ifndef MOLTAROS_IRQFLAGS_H
+#define MOLTAROS_IRQFLAGS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	Helpers to disable interrupts and later restore them to whatever state they were in before,
+	so that critical sections can safely nest (I.E: when called from inside of an interrupt handler,
+	a plain 'sti' at the end of a critical section would re-enable interrupts too early).
+*/
+
+// The interrupt flag within EFLAGS
+#define EFLAGS_IF 1 << 9
+
+static inline uint32_t irq_save() {
+	uint32_t flags;
+	asm volatile ("pushf; pop %0; cli" : "=r" (flags) :: "memory");
+	return flags;
+}
+
+static inline void irq_restore(uint32_t flags) {
+	asm volatile ("push %0; popf" :: "r" (flags) : "memory", "cc");
+}
+
+static inline void irq_enable() {
+	asm volatile ("sti" ::: "memory");
+}
+
+static inline void irq_disable() {
+	asm volatile ("cli" ::: "memory");
+}
+
+static inline bool irq_enabled() {
+	uint32_t flags;
+	asm volatile ("pushf; pop %0" : "=r" (flags));
+	return flags & (EFLAGS_IF);
+}
+
+#endif /* endif MOLTAROS_IRQFLAGS_H */
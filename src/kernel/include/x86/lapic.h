@@ -0,0 +1,81 @@
+#ifndef MOLTAROS_LAPIC_H
+#define MOLTAROS_LAPIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	Each processor has its own Local APIC, which receives interrupts on its behalf and lets it send
+	Inter-Processor Interrupts (IPIs) to the others. Its registers are memory-mapped, and every CPU sees
+	its own LAPIC at the same address.
+*/
+
+#define LAPIC_DEFAULT_ADDRESS 0xFEE00000
+
+// Register offsets
+#define LAPIC_ID 0x20
+#define LAPIC_VERSION 0x30
+#define LAPIC_TPR 0x80
+#define LAPIC_EOI 0xB0
+#define LAPIC_SVR 0xF0
+#define LAPIC_ESR 0x280
+#define LAPIC_ICR_LOW 0x300
+#define LAPIC_ICR_HIGH 0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_TIMER_INITIAL 0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIVIDE 0x3E0
+
+// Spurious-interrupt vector register: software enable
+#define LAPIC_SVR_ENABLE 1 << 8
+
+// Local vector table entries: masked, and the mode of the timer
+#define LAPIC_LVT_MASKED 1 << 16
+#define LAPIC_TIMER_ONESHOT 0 << 17
+#define LAPIC_TIMER_PERIODIC 1 << 17
+#define LAPIC_TIMER_TSC_DEADLINE 2 << 17
+
+// Timer divide configuration: count once every 16 bus cycles
+#define LAPIC_TIMER_DIVIDE_16 0x3
+
+// Once the timer is in TSC-deadline mode, it fires when the TSC reaches the value written to this MSR.
+#define MSR_IA32_TSC_DEADLINE 0x6E0
+
+// Interrupt command register: delivery modes and flags
+#define LAPIC_ICR_FIXED 0x000
+#define LAPIC_ICR_INIT 0x500
+#define LAPIC_ICR_STARTUP 0x600
+#define LAPIC_ICR_PENDING 1 << 12
+#define LAPIC_ICR_ASSERT 1 << 14
+#define LAPIC_ICR_LEVEL 1 << 15
+
+// Maps the LAPIC registers, found at the given physical address.
+void lapic_init(uint32_t address);
+
+// Enables the LAPIC of the CPU we are running on.
+void lapic_enable();
+
+uint8_t lapic_id();
+
+// Signals the end of the interrupt being handled.
+void lapic_eoi();
+
+// Sends an IPI to the CPU with the given LAPIC id. 'icr' is the delivery mode and vector.
+void lapic_send_ipi(uint8_t apic_id, uint32_t icr);
+
+/*
+	The LAPIC timer of each processor drives its tick (see kernel/tick.h), taking over from the PIT,
+	which is slow to program and can only interrupt a single processor. It counts down at the bus
+	frequency, which is unknown, so it is calibrated once at boot by the boot processor, the others
+	assuming theirs runs at the same rate. One-shot deadlines are programmed straight in terms of the
+	TSC where the processor supports TSC-deadline mode.
+
+	Starts the timer of the boot processor, returning false (leaving the PIT in charge) if it could
+	not be calibrated. Requires the LAPIC to be enabled.
+*/
+bool lapic_timer_init();
+
+// Starts the timer of an application processor, once lapic_timer_init has been called.
+void lapic_timer_init_cpu();
+
+#endif /* endif MOLTAROS_LAPIC_H */
@@ -0,0 +1,75 @@
+#ifndef MOLTAROS_MP_H
+#define MOLTAROS_MP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	The Intel MultiProcessor Specification tables, which the BIOS leaves in low memory to describe the
+	processors, I/O APICs and how ISA/PCI interrupts are wired up to them. These predate ACPI, but are
+	much simpler to parse and are still provided by every emulator we care about.
+*/
+
+#define MP_MAX_IRQS 32
+
+// Interrupt types of I/O and local interrupt entries
+#define MP_IRQ_INT 0
+#define MP_IRQ_NMI 1
+#define MP_IRQ_SMI 2
+#define MP_IRQ_EXTINT 3
+
+struct __attribute__((packed)) mp_floating_pointer {
+	char signature[4];
+	uint32_t config;
+	uint8_t length;
+	uint8_t revision;
+	uint8_t checksum;
+	uint8_t features[5];
+};
+
+struct __attribute__((packed)) mp_config_table {
+	char signature[4];
+	uint16_t length;
+	uint8_t revision;
+	uint8_t checksum;
+	char oem[8];
+	char product[12];
+	uint32_t oem_table;
+	uint16_t oem_size;
+	uint16_t entry_count;
+	uint32_t lapic_address;
+	uint16_t extended_length;
+	uint8_t extended_checksum;
+	uint8_t reserved;
+};
+
+// Where an interrupt from a bus is routed to. Only entries for the ISA bus are kept.
+struct mp_irq {
+	uint8_t type;
+	// Polarity (bits 0-1) and trigger mode (bits 2-3); 0 means the default for the bus.
+	uint16_t flags;
+	uint8_t source_irq;
+	uint8_t ioapic_id;
+	uint8_t ioapic_pin;
+};
+
+struct mp_info {
+	// Whether the interrupt mode configuration register must be switched over to route interrupts
+	// to the APICs rather than straight from the PIC to the processor (see ioapic_init).
+	bool imcr;
+	uint32_t lapic_address;
+	uint32_t ioapic_address;
+	uint8_t ioapic_id;
+	uint32_t nr_irqs;
+	struct mp_irq irqs[MP_MAX_IRQS];
+};
+
+extern struct mp_info mp_info;
+
+/*
+	Finds and parses the MP tables, filling in mp_info as well as the LAPIC id of each processor in
+	cpus (see x86/cpu.h). Returns false if there are none, in which case we only know of ourselves.
+*/
+bool mp_init();
+
+#endif /* endif MOLTAROS_MP_H */
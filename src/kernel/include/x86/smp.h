@@ -0,0 +1,23 @@
+#ifndef MOLTAROS_SMP_H
+#define MOLTAROS_SMP_H
+
+#include <include/x86/cpu.h>
+
+#include <stdint.h>
+
+/*
+	Symmetric multiprocessing: Starting the other (application) processors, which are discovered
+	from the MP tables, and signalling between processors with IPIs.
+*/
+
+// Starts all application processors, returning how many CPUs are now online, including ourselves.
+// Requires the scheduler, as each one runs its own idle task once started.
+uint32_t smp_init();
+
+// Number of CPUs currently online
+uint32_t num_online_cpus();
+
+// Makes the CPU re-evaluate what it should be running.
+void smp_send_reschedule(uint32_t cpu);
+
+#endif /* endif MOLTAROS_SMP_H */
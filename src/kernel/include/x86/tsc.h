@@ -0,0 +1,35 @@
+#ifndef MOLTAROS_TSC_H
+#define MOLTAROS_TSC_H
+
+#include <stdint.h>
+
+/*
+	The Time Stamp Counter is incremented every cycle (or, on newer processors, at a constant rate
+	regardless of frequency scaling) and can be read in a handful of cycles, making it the best
+	time base available to us. It has no fixed frequency though, so it is calibrated against the
+	PIT at boot, after which it is registered as the clocksource (see kernel/time.h).
+*/
+
+// Calibrated frequency of the TSC, or 0 if it is not available.
+extern uint32_t tsc_khz;
+
+// Reads the TSC. The processor may execute it out of order with respect to surrounding instructions,
+// so this is only suitable where being off by a few dozen cycles does not matter.
+static inline uint64_t rdtsc() {
+	uint64_t ret;
+	asm volatile ("rdtsc" : "=A" (ret));
+	return ret;
+}
+
+// Reads the TSC only once all prior instructions have completed, for measuring short sections of code.
+// Note that 'lfence' requires SSE2, which any processor we would care to measure on has.
+static inline uint64_t rdtsc_ordered() {
+	uint64_t ret;
+	asm volatile ("lfence; rdtsc" : "=A" (ret) :: "memory");
+	return ret;
+}
+
+// Calibrates the TSC and makes it the clocksource, if the processor has one.
+void tsc_init();
+
+#endif /* endif MOLTAROS_TSC_H */
@@ -9,12 +9,21 @@
 #include <include/drivers/vga.h>
 #include <include/x86/gdt.h>
 #include <include/x86/idt.h>
+#include <include/x86/fpu.h>
 #include <include/drivers/timer.h>
+#include <include/x86/tsc.h>
+#include <include/x86/smp.h>
 #include <include/drivers/kbd.h>
 #include <include/drivers/rtc.h>
+#include <include/drivers/serial.h>
 #include <include/kernel/multiboot.h>
 #include <include/kernel/logger.h>
 #include <include/kernel/mem.h>
+#include <include/kernel/ktimer.h>
+#include <include/kernel/softirq.h>
+#include <include/kernel/workqueue.h>
+#include <include/kernel/profile.h>
+#include <include/kernel/trace.h>
 #include <include/sched/task.h>
 #include <include/helpers.h>
 
@@ -23,37 +32,49 @@ uint32_t PHYSICAL_MEMORY_START;
 
 uint32_t STACK_START;
 
-static void thread_task(void *UNUSED(args)) {
+static work_t clock_work;
 
-	for (;;) {
-		asm volatile ("cli");
-	
-		uint32_t x = vga_get_x();
-		uint32_t y = vga_get_y();
-		vga_set_x(70);
-		vga_set_y(0);
-		rtc_print();
-		vga_set_x(x);
-		vga_set_y(y);
-
-		asm volatile ("sti");
-
-		yield();
-	}
+// Displays the time after each update of the RTC, without needing a thread of its own.
+static void clock_update(void *UNUSED(data)) {
+	uint32_t flags = vga_lock();
+	uint32_t x = vga_get_x();
+	uint32_t y = vga_get_y();
+	vga_set_x(70);
+	vga_set_y(0);
+	rtc_print();
+	vga_set_x(x);
+	vga_set_y(y);
+	vga_unlock(flags);
 }
 
 void kernel_init(struct multiboot_info *info, uint32_t esp) {
 	STACK_START = esp;
 	vga_init();
+
+	// Logging needs to know which CPU it is on, which is found through the GDT.
+	gdt_init();
 	KTRACE("Stack Start: %x", esp);
 	KINFO("Virtual Memory (Paging) Initialized...");
 	KINFO("Video Graphics Array (VGA) Initialized...");
-	gdt_init();
 	KINFO("Global Descriptor Table (GDT) Initialized...");
 	idt_init();
 	KINFO("Interrupt Descriptor Table (IDT) Initialized...");
+	// Everything logged from here on is also sent over the serial port.
+	if (serial_init()) {
+		KINFO("Serial Port (COM1) Initialized...");
+	}
+	fpu_init();
+	KINFO("Floating Point Unit (FPU/SSE) Initialized...");
 	timer_init();
 	KINFO("System Timer (PIT) Initialized...");
+	tsc_init();
+	if (tsc_khz) {
+		KINFO("Time Stamp Counter (TSC) Calibrated at %d KHz...", tsc_khz);
+	}
+	ktimer_init();
+	KINFO("Kernel Timers Initialized...");
+	rtc_init();
+	KINFO("Real-Time Clock (RTC) Initialized...");
 	if (!multiboot_RAM(info, &PHYSICAL_MEMORY_START, &PHYSICAL_MEMORY_END)) {
 		KPANIC("Failed to detect physical memory (RAM)!!!");
 	}
@@ -66,14 +87,26 @@ void kernel_init(struct multiboot_info *info, uint32_t esp) {
 void kernel_main(void) {
 	KINFO("Initializing Multitasking...");
 	task_init();
-	thread_create(thread_task, NULL);
+	uint32_t online = smp_init();
+	KINFO("Symmetric Multiprocessing (SMP) Initialized: %d CPUs online...", online);
+	KDEBUG("Interrupt entry and exit: %d cycles", irq_entry_cycles());
+	softirq_init();
+	KINFO("Softirqs Initialized...");
+	workqueue_init();
+	KINFO("Work Queues Initialized...");
+	log_start_console();
+	KINFO("Console Thread (klogd) Started...");
+	profile_init();
+	KINFO("Profiler Initialized...");
+	trace_init();
+	KINFO("Tracing Initialized...");
+	work_init(&clock_work, clock_update, NULL);
+	rtc_set_update_work(&clock_work);
 
 	keyboard_init();
 	KINFO("Keyboard Initialized...");
 	KINFO("Kernel Fully Initialized!");
 
-	// Loop infinitely
-	while (true) {
-		asm volatile ("hlt");
-	}
+	// We have nothing left to do, so become the idle task, which halts until there is work.
+	task_idle();
 }
@@ -0,0 +1,82 @@
+#include <include/kernel/ksyms.h>
+#include <stdio.h>
+
+/*
+	Generated by ksyms.py for the second link (see ksyms.h). Until then they are missing, which the
+	weak references turn into NULL rather than an error.
+*/
+extern const uint32_t ksym_count __attribute__((weak));
+extern const uint32_t ksym_addresses[] __attribute__((weak));
+extern const uint8_t ksym_names[] __attribute__((weak));
+extern const uint32_t ksym_markers[] __attribute__((weak));
+// Offset into the token table of each token, which are all terminated.
+extern const uint16_t ksym_token_index[] __attribute__((weak));
+extern const char ksym_token_table[] __attribute__((weak));
+
+// End of the code (see linker.ld), past which nothing belongs to the last function.
+extern char _etext[];
+
+// Finds where the index'th name begins, starting from the closest marker before it. Each name
+// starts with its (compressed) length.
+static uint32_t name_offset(uint32_t index) {
+	uint32_t offset = ksym_markers[index / KSYM_MARKER_INTERVAL];
+	for (uint32_t i = index - index % KSYM_MARKER_INTERVAL; i < index; i++) {
+		offset += 1 + ksym_names[offset];
+	}
+
+	return offset;
+}
+
+static void expand_name(uint32_t offset, char *name) {
+	uint32_t len = 0;
+	const uint8_t *data = &ksym_names[offset + 1];
+
+	for (uint32_t i = 0; i < ksym_names[offset]; i++) {
+		if (data[i] < KSYM_TOKEN_BASE) {
+			if (len < KSYM_NAME_LEN - 1) {
+				name[len++] = (char) data[i];
+			}
+			continue;
+		}
+
+		const char *token = &ksym_token_table[ksym_token_index[data[i] - KSYM_TOKEN_BASE]];
+		while (*token && len < KSYM_NAME_LEN - 1) {
+			name[len++] = *token++;
+		}
+	}
+
+	name[len] = '\0';
+}
+
+bool ksym_lookup(uint32_t addr, char *name, uint32_t *offset) {
+	if (!&ksym_count || !ksym_count || addr < ksym_addresses[0] || addr >= (uint32_t) _etext) {
+		return false;
+	}
+
+	// Last symbol at or below the address
+	uint32_t low = 0;
+	uint32_t high = ksym_count - 1;
+	while (low < high) {
+		uint32_t mid = low + (high - low + 1) / 2;
+		if (ksym_addresses[mid] <= addr) {
+			low = mid;
+		} else {
+			high = mid - 1;
+		}
+	}
+
+	expand_name(name_offset(low), name);
+	*offset = addr - ksym_addresses[low];
+	return true;
+}
+
+int sprint_symbol(char *buf, uint32_t addr) {
+	char name[KSYM_NAME_LEN];
+	uint32_t offset;
+
+	if (!ksym_lookup(addr, name, &offset)) {
+		return sprintf(buf, "%x", addr);
+	}
+
+	return sprintf(buf, "%s+0x%x", name, offset);
+}
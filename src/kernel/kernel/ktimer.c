@@ -0,0 +1,312 @@
+#include <include/kernel/ktimer.h>
+#include <include/kernel/tick.h>
+#include <include/kernel/spinlock.h>
+#include <include/sched/wait.h>
+#include <include/x86/cpu.h>
+#include <include/helpers.h>
+
+/*
+	The wheel consists of five levels. The first has a slot for each of the next 256 jiffies, and
+	each level after it has 64 slots, each covering 64 times as many jiffies as a slot of the level
+	before it. A timer is placed directly into the slot of the level whose range its expiry falls
+	into. Whenever the first level wraps around, the next slot of the second level is 'cascaded',
+	which is to say its timers are redistributed into the first level, and so on up the levels.
+	Hence timers far in the future are only touched once per level they pass through.
+*/
+#define TVR_BITS 8
+#define TVN_BITS 6
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_MASK (TVR_SIZE - 1)
+#define TVN_MASK (TVN_SIZE - 1)
+
+// Slot of level N + 2 which the next jiffy to process maps to.
+#define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
+
+LIST_HEAD(ktimer_list, ktimer);
+
+// The wheel of a CPU
+struct timer_base {
+	struct ktimer_list tv1[TVR_SIZE];
+	struct ktimer_list tv2[TVN_SIZE];
+	struct ktimer_list tv3[TVN_SIZE];
+	struct ktimer_list tv4[TVN_SIZE];
+	struct ktimer_list tv5[TVN_SIZE];
+
+	// The next jiffy which has yet to be processed by the wheel
+	uint32_t timer_jiffies;
+	// Timers in the wheel, which can be skipped ahead when there are none.
+	uint32_t nr_timers;
+
+	// Protects the wheel and the timers in it. It is dropped while running a callback, which may
+	// well start or cancel timers itself.
+	spinlock_t lock;
+
+	// The timer whose callback is currently running, if any (see ktimer_cancel_sync).
+	ktimer_t *volatile running_timer;
+};
+
+static struct timer_base bases[MAX_CPUS];
+
+static struct timer_base *this_base() {
+	return &bases[smp_processor_id()];
+}
+
+/*
+	Locks the wheel the timer is on. It may be moved to another wheel until we hold the lock, and
+	has no wheel at all while it is being moved, which we wait out.
+*/
+static struct timer_base *lock_timer_base(ktimer_t *timer, uint32_t *flags) {
+	for (;;) {
+		struct timer_base *base = timer->base;
+		if (base) {
+			*flags = spin_lock_irqsave(&base->lock);
+			if (base == timer->base) {
+				return base;
+			}
+			spin_unlock_irqrestore(&base->lock, *flags);
+		}
+
+		cpu_relax();
+	}
+}
+
+static void internal_add_timer(struct timer_base *base, ktimer_t *timer) {
+	uint32_t expires = timer->expires;
+	uint32_t idx = expires - base->timer_jiffies;
+	struct ktimer_list *vec;
+
+	if (idx < TVR_SIZE) {
+		vec = base->tv1 + (expires & TVR_MASK);
+	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
+		vec = base->tv2 + ((expires >> TVR_BITS) & TVN_MASK);
+	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
+		vec = base->tv3 + ((expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK);
+	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
+		vec = base->tv4 + ((expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK);
+	} else if ((int32_t) idx < 0) {
+		// Already expired, so it is run on the very next jiffy
+		vec = base->tv1 + (base->timer_jiffies & TVR_MASK);
+	} else {
+		vec = base->tv5 + ((expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK);
+	}
+
+	LIST_INSERT_HEAD(vec, timer, entry);
+	timer->pending = true;
+	base->nr_timers++;
+}
+
+static void detach_timer(struct timer_base *base, ktimer_t *timer) {
+	LIST_REMOVE(timer, entry);
+	timer->pending = false;
+	base->nr_timers--;
+}
+
+// Moves all timers in the slot down into the levels below. The index is returned so the caller
+// knows whether this level has wrapped around too, and the level above should be cascaded as well.
+static uint32_t cascade(struct timer_base *base, struct ktimer_list *tv, uint32_t index) {
+	struct ktimer_list list = LIST_HEAD_INITIALIZER(list);
+	LIST_SWAP(&list, tv + index, ktimer, entry);
+
+	ktimer_t *timer;
+	while ((timer = LIST_FIRST(&list))) {
+		LIST_REMOVE(timer, entry);
+		base->nr_timers--;
+		internal_add_timer(base, timer);
+	}
+
+	return index;
+}
+
+// Runs all timers on this CPU which have expired, catching up on any jiffies that were missed.
+static void run_timers() {
+	struct timer_base *base = this_base();
+
+	spin_lock(&base->lock);
+	while (time_after_eq(jiffies, base->timer_jiffies)) {
+		// Nothing to cascade or run, however long the tick was stopped for.
+		if (!base->nr_timers) {
+			base->timer_jiffies = jiffies + 1;
+			break;
+		}
+
+		uint32_t index = base->timer_jiffies & TVR_MASK;
+
+		if (!index && !cascade(base, base->tv2, INDEX(0)) && !cascade(base, base->tv3, INDEX(1)) &&
+				!cascade(base, base->tv4, INDEX(2))) {
+			cascade(base, base->tv5, INDEX(3));
+		}
+		base->timer_jiffies++;
+
+		ktimer_t *timer;
+		while ((timer = LIST_FIRST(base->tv1 + index))) {
+			detach_timer(base, timer);
+
+			// Rearm periodic timers before running them, so that the callback may cancel them.
+			if (timer->period) {
+				timer->expires += timer->period;
+				internal_add_timer(base, timer);
+			}
+
+			// The timer may be freed by its owner as soon as we let go of the lock, unless they
+			// wait for us to finish with it first, so everything needed is copied out beforehand.
+			void (*callback)(void *data) = timer->callback;
+			void *data = timer->data;
+			base->running_timer = timer;
+
+			spin_unlock(&base->lock);
+			callback(data);
+			spin_lock(&base->lock);
+
+			base->running_timer = NULL;
+		}
+	}
+	spin_unlock(&base->lock);
+}
+
+static void ktimer_tick(struct registers *UNUSED(regs)) {
+	run_timers();
+}
+
+void ktimer_init() {
+	for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+		struct timer_base *base = &bases[cpu];
+		for (uint32_t i = 0; i < TVR_SIZE; i++) {
+			LIST_INIT(base->tv1 + i);
+		}
+
+		for (uint32_t i = 0; i < TVN_SIZE; i++) {
+			LIST_INIT(base->tv2 + i);
+			LIST_INIT(base->tv3 + i);
+			LIST_INIT(base->tv4 + i);
+			LIST_INIT(base->tv5 + i);
+		}
+
+		spin_lock_init(&base->lock);
+		base->timer_jiffies = jiffies;
+	}
+
+	tick_add_handler(ktimer_tick);
+}
+
+void ktimer_setup(ktimer_t *timer, void (*callback)(void *data), void *data) {
+	timer->callback = callback;
+	timer->data = data;
+	timer->period = 0;
+	timer->pending = false;
+	timer->base = this_base();
+}
+
+static void start_timer(ktimer_t *timer, uint32_t expires, uint32_t period) {
+	uint32_t flags;
+	struct timer_base *base = lock_timer_base(timer, &flags);
+
+	if (timer->pending) {
+		detach_timer(base, timer);
+	}
+
+	timer->expires = expires;
+	timer->period = period;
+
+	// Timers follow whoever starts them onto their CPU, unless their callback is still running where
+	// they were, which ktimer_cancel_sync needs to be able to find.
+	struct timer_base *new_base = this_base();
+	if (base != new_base && base->running_timer != timer) {
+		timer->base = NULL;
+		spin_unlock(&base->lock);
+		spin_lock(&new_base->lock);
+		timer->base = base = new_base;
+	}
+
+	internal_add_timer(base, timer);
+	spin_unlock(&base->lock);
+
+	// The tick may be stopped for longer than this timer is willing to wait.
+	tick_nohz_update();
+
+	irq_restore(flags);
+}
+void ktimer_start(ktimer_t *timer, uint32_t ms) {
+	start_timer(timer, get_jiffies() + msecs_to_jiffies(ms), 0);
+}
+
+void ktimer_start_periodic(ktimer_t *timer, uint32_t ms) {
+	uint32_t period = MAX(msecs_to_jiffies(ms), 1);
+	start_timer(timer, get_jiffies() + period, period);
+}
+
+void ktimer_start_at(ktimer_t *timer, uint32_t expires) {
+	start_timer(timer, expires, 0);
+}
+
+uint32_t ktimer_next_expiry() {
+	struct timer_base *base = this_base();
+	uint32_t flags = spin_lock_irqsave(&base->lock);
+
+	if (!base->nr_timers) {
+		spin_unlock_irqrestore(&base->lock, flags);
+		return UINT32_MAX;
+	}
+
+	// Timers in the higher levels are only cascaded into the first level once it wraps around,
+	// so we need to be woken up by then at the latest, even if they are not due yet.
+	uint32_t next = (base->timer_jiffies + TVR_MASK) & ~(uint32_t) TVR_MASK;
+	for (uint32_t j = base->timer_jiffies; time_before(j, next); j++) {
+		if (!LIST_EMPTY(base->tv1 + (j & TVR_MASK))) {
+			next = j;
+			break;
+		}
+	}
+
+	spin_unlock_irqrestore(&base->lock, flags);
+	return time_after(next, jiffies) ? next - jiffies : 0;
+}
+
+bool ktimer_cancel(ktimer_t *timer) {
+	uint32_t flags;
+	struct timer_base *base = lock_timer_base(timer, &flags);
+
+	bool pending = timer->pending;
+	if (pending) {
+		detach_timer(base, timer);
+	}
+	timer->period = 0;
+
+	spin_unlock_irqrestore(&base->lock, flags);
+	return pending;
+}
+
+bool ktimer_cancel_sync(ktimer_t *timer) {
+	for (;;) {
+		uint32_t flags;
+		struct timer_base *base = lock_timer_base(timer, &flags);
+
+		bool pending = timer->pending;
+		if (pending) {
+			detach_timer(base, timer);
+		}
+		timer->period = 0;
+
+		bool running = base->running_timer == timer;
+		spin_unlock_irqrestore(&base->lock, flags);
+
+		if (!running) {
+			return pending;
+		}
+
+		// The callback is running on another CPU, which we must wait for.
+		cpu_relax();
+	}
+}
+
+void ksleep(uint32_t ms) {
+	wait_queue_t wq = WAIT_QUEUE_INITIALIZER(wq);
+	uint32_t deadline = get_jiffies() + msecs_to_jiffies(ms);
+
+	// Nothing else knows about our wait queue, so only the timeout can wake us.
+	uint32_t flags = spin_lock_irqsave(&wq.lock);
+	while (time_before(jiffies, deadline)) {
+		wait_queue_sleep_until(&wq, deadline);
+	}
+	spin_unlock_irqrestore(&wq.lock, flags);
+}
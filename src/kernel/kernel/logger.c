@@ -0,0 +1,361 @@
+#include <include/kernel/logger.h>
+#include <include/kernel/time.h>
+#include <include/kernel/softirq.h>
+#include <include/kernel/tick.h>
+#include <include/drivers/vga.h>
+#include <include/drivers/serial.h>
+#include <include/sched/task.h>
+#include <include/sched/wait.h>
+#include <include/x86/cpu.h>
+#include <include/x86/irqflags.h>
+#include <include/helpers.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// Set on a record with only the format and arguments, to be formatted by klogd.
+#define RECORD_BINARY 1 << 0
+
+struct log_record {
+	// Index of the record plus one, once it has been written in full.
+	volatile uint32_t seq;
+	uint64_t time;
+	uint8_t level;
+	uint8_t subsys;
+	uint8_t flags;
+	union {
+		char text[LOG_TEXT_MAX];
+		struct {
+			const char *format;
+			uint32_t args[LOG_MAX_ARGS];
+		};
+	};
+};
+
+/*
+	Records of a CPU. Only that CPU appends them, reserving a slot at 'tail' with interrupts disabled
+	(so that an interrupt handler logging in the middle of it gets a slot of its own) and filling it
+	in after, while only the flusher (see 'flushing') takes them from 'head'. A record may be
+	reserved but not yet written, which the flusher waits out by stopping there until its 'seq' is set.
+*/
+struct log_ring {
+	struct log_record records[LOG_RECORDS];
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	volatile uint32_t dropped;
+};
+
+static struct log_ring rings[MAX_CPUS];
+
+uint8_t log_levels[NR_LOG_SUBSYS] = {
+	[0 ... NR_LOG_SUBSYS - 1] = LOG_LEVEL_DEFAULT
+};
+
+static const char *subsys_names[NR_LOG_SUBSYS] = {
+	[LOG_KERNEL] = "kernel",
+	[LOG_X86] = "x86",
+	[LOG_DRIVERS] = "drivers",
+	[LOG_MM] = "mm",
+	[LOG_SCHED] = "sched",
+	[LOG_DS] = "ds"
+};
+
+static const char *level_names[] = {
+	[LEVEL_ALL] = "ALL",
+	[LEVEL_TRACE] = "TRACE",
+	[LEVEL_DEBUG] = "DEBUG",
+	[LEVEL_INFO] = "INFO",
+	[LEVEL_WARNING] = "WARNING",
+	[LEVEL_ERROR] = "ERROR",
+	[LEVEL_PANIC] = "PANIC"
+};
+
+static const enum vga_color level_colors[] = {
+	[LEVEL_ALL] = COLOR_LIGHT_GREY,
+	[LEVEL_TRACE] = COLOR_BROWN,
+	[LEVEL_DEBUG] = COLOR_BLUE,
+	[LEVEL_INFO] = COLOR_GREEN,
+	[LEVEL_WARNING] = COLOR_YELLOW,
+	[LEVEL_ERROR] = COLOR_RED,
+	[LEVEL_PANIC] = COLOR_RED
+};
+
+static uint32_t consoles = LOG_CONSOLE_VGA | LOG_CONSOLE_SERIAL;
+
+// Whether klogd is draining the rings, rather than everyone writing out their own messages.
+static volatile bool deferred;
+
+// Set once we panic; from then on, nothing waits for anyone.
+static volatile bool panicking;
+
+/*
+	Set while someone is writing out the rings. Not a spinlock, as writing to the serial port may
+	sleep until there is room, and klogd may be preempted in the middle of it.
+*/
+static volatile bool flushing;
+
+// Messages are formatted here by the flusher.
+static char line[48 + LOG_TEXT_MAX];
+
+// klogd sleeps on this until there is something to write out.
+static wait_queue_t klogd_wait = WAIT_QUEUE_INITIALIZER(klogd_wait);
+
+// Set by the first message logged since klogd last looked at the rings, which is the one to wake it.
+static volatile bool klogd_pending;
+
+/*
+	Waking klogd takes the lock of its run queue, which may be held by whoever is logging. They would
+	have interrupts disabled, so only with interrupts enabled is it woken right away. Otherwise, it is
+	left to the way out of the interrupt handler or softirq we are in, or failing that, to the tick
+	(see log_needs_tick).
+*/
+static tasklet_t klogd_tasklet;
+static volatile bool wake_deferred;
+
+void log_set_level(uint32_t subsys, uint32_t level) {
+	if (subsys < NR_LOG_SUBSYS) {
+		log_levels[subsys] = (uint8_t) MIN(level, LEVEL_PANIC);
+	}
+}
+
+void log_set_level_all(uint32_t level) {
+	for (uint32_t i = 0; i < NR_LOG_SUBSYS; i++) {
+		log_set_level(i, level);
+	}
+}
+
+void log_set_consoles(uint32_t value) {
+	consoles = value;
+}
+
+// Reserves the next record of this CPU, or returns NULL if the ring is full.
+static struct log_record *log_reserve(uint32_t *seq) {
+	uint32_t flags = irq_save();
+	struct log_ring *ring = &rings[smp_processor_id()];
+
+	if (ring->tail - ring->head >= LOG_RECORDS) {
+		ring->dropped++;
+		irq_restore(flags);
+		return NULL;
+	}
+
+	*seq = ring->tail++;
+	irq_restore(flags);
+
+	return &ring->records[*seq % LOG_RECORDS];
+}
+
+static void wake_klogd() {
+	if (__atomic_exchange_n(&klogd_pending, true, __ATOMIC_ACQ_REL)) {
+		return;
+	}
+
+	if (irq_enabled()) {
+		wake_up_one(&klogd_wait);
+	} else if (in_interrupt() || in_softirq()) {
+		tasklet_schedule(&klogd_tasklet);
+	} else {
+		wake_deferred = true;
+	}
+}
+
+static void klogd_tasklet_func(void *UNUSED(data)) {
+	wake_up_one(&klogd_wait);
+}
+
+static void log_tick(struct registers *UNUSED(regs)) {
+	if (__atomic_exchange_n(&wake_deferred, false, __ATOMIC_ACQ_REL)) {
+		wake_up_one(&klogd_wait);
+	}
+}
+
+bool log_needs_tick() {
+	return wake_deferred;
+}
+
+static void log_commit(struct log_record *record, uint32_t seq) {
+	__atomic_store_n(&record->seq, seq + 1, __ATOMIC_RELEASE);
+
+	// Without klogd, whoever logs has to write it out.
+	if (!deferred) {
+		log_flush();
+	} else {
+		wake_klogd();
+	}
+}
+
+void klog(uint32_t subsys, uint32_t level, const char *format, ...) {
+	uint32_t seq;
+	struct log_record *record = log_reserve(&seq);
+	if (!record) {
+		return;
+	}
+
+	record->time = ktime_get_ns();
+	record->level = (uint8_t) level;
+	record->subsys = (uint8_t) subsys;
+	record->flags = 0;
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(record->text, LOG_TEXT_MAX, format, args);
+	va_end(args);
+
+	log_commit(record, seq);
+}
+
+void klog_binary(uint32_t subsys, uint32_t level, const char *format, uint32_t nargs, ...) {
+	uint32_t seq;
+	struct log_record *record = log_reserve(&seq);
+	if (!record) {
+		return;
+	}
+
+	record->time = ktime_get_ns();
+	record->level = (uint8_t) level;
+	record->subsys = (uint8_t) subsys;
+	record->flags = RECORD_BINARY;
+	record->format = format;
+
+	va_list args;
+	va_start(args, nargs);
+	for (uint32_t i = 0; i < LOG_MAX_ARGS; i++) {
+		record->args[i] = i < nargs ? va_arg(args, uint32_t) : 0;
+	}
+	va_end(args);
+
+	log_commit(record, seq);
+}
+
+static void console_write(const char *str, uint32_t len) {
+	if (consoles & (LOG_CONSOLE_SERIAL)) {
+		serial_write(str, len);
+	}
+}
+
+static void write_record(uint32_t cpu, struct log_record *record) {
+	uint32_t sec, nsec;
+	sec = (uint32_t) div_u64_rem(record->time, NSEC_PER_SEC, &nsec);
+
+	// The header is split around the level, which is colored on the screen.
+	int prefix = sprintf(line, "[%5d.%06d] [%d] [%s] [", sec, nsec / NSEC_PER_USEC, cpu, subsys_names[record->subsys]);
+	const char *level = level_names[record->level];
+
+	const char *text = record->text;
+	char *msg = line + prefix + 1;
+	if (record->flags & (RECORD_BINARY)) {
+		uint32_t *a = record->args;
+		snprintf(msg, LOG_TEXT_MAX, record->format, a[0], a[1], a[2], a[3], a[4], a[5]);
+		text = msg;
+	}
+
+	uint32_t flags = vga_lock();
+	if (consoles & (LOG_CONSOLE_VGA)) {
+		line[prefix] = '\0';
+		vga_print(line);
+		vga_print_color(level_colors[record->level], level);
+		vga_print("] ");
+		vga_print(text);
+		vga_print("\n");
+	}
+	vga_unlock(flags);
+
+	console_write(line, (uint32_t) prefix);
+	console_write(level, (uint32_t) strlen(level));
+	console_write("] ", 2);
+	console_write(text, (uint32_t) strlen(text));
+	console_write("\n", 1);
+}
+
+// Oldest record waiting to be written out, or NULL if there are none (or the oldest of some CPU is
+// still being written).
+static struct log_record *next_record(uint32_t *cpu) {
+	struct log_record *oldest = NULL;
+
+	for (uint32_t i = 0; i < MAX_CPUS; i++) {
+		struct log_ring *ring = &rings[i];
+		uint32_t head = ring->head;
+		if (head == ring->tail) {
+			continue;
+		}
+
+		struct log_record *record = &ring->records[head % LOG_RECORDS];
+		if (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) != head + 1) {
+			continue;
+		}
+
+		if (!oldest || record->time < oldest->time) {
+			oldest = record;
+			*cpu = i;
+		}
+	}
+
+	return oldest;
+}
+
+static void __log_flush() {
+	uint32_t cpu;
+	struct log_record *record;
+
+	while ((record = next_record(&cpu))) {
+		write_record(cpu, record);
+		__atomic_store_n(&rings[cpu].head, rings[cpu].head + 1, __ATOMIC_RELEASE);
+	}
+
+	for (uint32_t i = 0; i < MAX_CPUS; i++) {
+		uint32_t dropped = __atomic_exchange_n(&rings[i].dropped, 0, __ATOMIC_RELAXED);
+		if (dropped) {
+			int len = sprintf(line, "CPU %d: %d messages dropped\n", i, dropped);
+			if (consoles & (LOG_CONSOLE_VGA)) {
+				uint32_t flags = vga_lock();
+				vga_print(line);
+				vga_unlock(flags);
+			}
+			console_write(line, (uint32_t) len);
+		}
+	}
+}
+
+void log_flush() {
+	if (panicking) {
+		__log_flush();
+		return;
+	}
+
+	/*
+		Whoever is already flushing will get to ours as well. That includes whoever we interrupted,
+		which is why this never waits for them, and why interrupts can be left enabled while writing
+		out, which takes a while. Records committed just as they finish would be missed by both of
+		us, so they look once more after letting go.
+	*/
+	uint32_t cpu;
+	do {
+		if (__atomic_exchange_n(&flushing, true, __ATOMIC_ACQUIRE)) {
+			return;
+		}
+
+		__log_flush();
+		__atomic_store_n(&flushing, false, __ATOMIC_RELEASE);
+	} while (next_record(&cpu));
+}
+
+static void klogd(void *UNUSED(args)) {
+	for (;;) {
+		// Whatever is logged after the flag is cleared sets it again, so we go around once more.
+		wait_event(klogd_wait, __atomic_exchange_n(&klogd_pending, false, __ATOMIC_ACQ_REL));
+		log_flush();
+	}
+}
+
+void log_start_console() {
+	tasklet_init(&klogd_tasklet, klogd_tasklet_func, NULL);
+	tick_add_handler(log_tick);
+	thread_create(klogd, NULL);
+	deferred = true;
+}
+
+void log_panic() {
+	panicking = true;
+	deferred = false;
+	__log_flush();
+}
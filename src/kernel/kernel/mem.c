@@ -1,8 +1,10 @@
 #include <include/kernel/mem.h>
 #include <include/kernel/logger.h>
+#include <include/kernel/trace.h>
 #include <include/mm/heap.h>
 #include <include/mm/alloc.h>
 
+// Every CPU allocates from the same heap, so its lock is the most contended one we have.
 static memheap_t kheap = {0};
 
 static void more_memory() {
@@ -23,7 +25,8 @@ void *kmalloc(size_t sz) {
 		KPANIC("Bad Allocation Size... Max: %x, Attempt: %x", PAGE_SIZE, sz);
 	}
 
-	// Check allocation of heap and add more if need be
+	// Check allocation of heap and add more if need be. The heap is not locked while more memory
+	// is added, so another CPU may add some at the same time, which just leaves us with extra.
 	void *data = memheap_alloc(&kheap, sz);
 	if (!data) {
 		more_memory();
@@ -34,11 +37,13 @@ void *kmalloc(size_t sz) {
 		KPANIC("Heap Allocation Failed!");
 	}
 
+	trace_event(kmalloc, data, sz);
 	return data;
 }
 
 void kfree(void *ptr) {
 	if (ptr) {
+		trace_event(kfree, ptr);
 		memheap_free(&kheap, ptr);
 	}
 }
\ No newline at end of file
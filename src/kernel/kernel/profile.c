@@ -0,0 +1,171 @@
+#include <include/kernel/profile.h>
+#include <include/kernel/tick.h>
+#include <include/kernel/workqueue.h>
+#include <include/kernel/logger.h>
+#include <include/kernel/stacktrace.h>
+#include <include/kernel/ksyms.h>
+#include <include/drivers/serial.h>
+#include <include/drivers/timer.h>
+#include <include/sched/task.h>
+#include <include/sched/mutex.h>
+#include <include/x86/cpu.h>
+#include <include/x86/idt.h>
+#include <include/helpers.h>
+#include <stdio.h>
+
+struct profile_sample {
+	uint32_t task;
+	uint32_t eip;
+	uint32_t depth;
+	uint32_t callchain[PROFILE_MAX_DEPTH];
+};
+
+/*
+	Samples of a CPU. Only that CPU adds them, at 'tail', and only the writer, holding dump_lock, takes
+	them from 'head', so neither needs a lock as long as each sees the other's update of the samples
+	before that of the index.
+*/
+struct profile_buffer {
+	struct profile_sample samples[PROFILE_SAMPLES];
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	uint32_t dropped;
+};
+
+static struct profile_buffer buffers[MAX_CPUS];
+
+static volatile bool running;
+
+// Only one writer at a time, or they would both take the same samples. Also protects the below.
+static mutex_t dump_lock = MUTEX_INITIALIZER(dump_lock);
+
+// Whether the 'profile: begin' line has been written, and what has been written since.
+static bool begun;
+static uint32_t total;
+static uint32_t dropped;
+
+// A line of the dump, for a single sample, only used with dump_lock held.
+static char line[16 + (KSYM_SYMBOL_LEN + 1) * (PROFILE_MAX_DEPTH + 1)];
+
+// Writes out the samples every PROFILE_DRAIN_MS while profiling.
+static delayed_work_t drain_work;
+
+// Writes out the rest of the samples once profiling is stopped by profile_toggle.
+static work_t dump_work;
+
+static void profile_tick(struct registers *regs) {
+	if (!running) {
+		return;
+	}
+
+	struct profile_buffer *buf = &buffers[smp_processor_id()];
+	uint32_t tail = buf->tail;
+	if (tail - buf->head == PROFILE_SAMPLES) {
+		__atomic_add_fetch(&buf->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	struct profile_sample *sample = &buf->samples[tail % PROFILE_SAMPLES];
+	task_t *task = task_current();
+	sample->task = task ? task->id : 0;
+	sample->eip = regs->eip;
+	sample->depth = stack_trace_save(regs->ebp, sample->callchain, PROFILE_MAX_DEPTH);
+
+	__atomic_store_n(&buf->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// Writes out the samples taken so far, starting the dump if it has not been yet. dump_lock must be held.
+static void drain() {
+	if (!begun) {
+		sprintf(line, "profile: begin hz=%d\n", TIMER_HZ);
+		serial_print(line);
+		begun = true;
+	}
+
+	struct cpu *cpu;
+	for_each_online_cpu(cpu) {
+		struct profile_buffer *buf = &buffers[cpu->id];
+		uint32_t tail = __atomic_load_n(&buf->tail, __ATOMIC_ACQUIRE);
+
+		for (uint32_t i = buf->head; i != tail; i++) {
+			struct profile_sample *sample = &buf->samples[i % PROFILE_SAMPLES];
+
+			char *pos = line + sprintf(line, "%x %x ", cpu->id, sample->task);
+			pos += sprint_symbol(pos, sample->eip);
+			for (uint32_t j = 0; j < sample->depth; j++) {
+				*pos++ = ' ';
+				pos += sprint_symbol(pos, sample->callchain[j]);
+			}
+			sprintf(pos, "\n");
+			serial_print(line);
+
+			// Let the slot be reused only once we are done with it.
+			__atomic_store_n(&buf->head, i + 1, __ATOMIC_RELEASE);
+			total++;
+		}
+
+		dropped += __atomic_exchange_n(&buf->dropped, 0, __ATOMIC_RELAXED);
+	}
+}
+
+static void drain_work_func(void *UNUSED(data)) {
+	// Once stopped, what is left is written out by dump_work, which also ends the dump.
+	mutex_lock(&dump_lock);
+	if (running) {
+		drain();
+	}
+	mutex_unlock(&dump_lock);
+
+	if (running) {
+		schedule_delayed_work(&drain_work, PROFILE_DRAIN_MS);
+	}
+}
+
+static void dump_work_func(void *UNUSED(data)) {
+	profile_dump();
+}
+
+void profile_init() {
+	delayed_work_init(&drain_work, drain_work_func, NULL);
+	work_init(&dump_work, dump_work_func, NULL);
+	tick_add_handler(profile_tick);
+}
+
+void profile_start() {
+	running = true;
+	schedule_delayed_work(&drain_work, PROFILE_DRAIN_MS);
+	KINFO("Profiling...");
+}
+
+void profile_stop() {
+	running = false;
+	KINFO("Profiling stopped");
+}
+
+bool profile_running() {
+	return running;
+}
+
+void profile_dump() {
+	mutex_lock(&dump_lock);
+	drain();
+
+	uint32_t written = total, lost = dropped;
+	sprintf(line, "profile: end samples=%d dropped=%d\n", written, lost);
+	serial_print(line);
+
+	begun = false;
+	total = dropped = 0;
+	mutex_unlock(&dump_lock);
+
+	KINFO("Profile written out: %d samples, %d dropped", written, lost);
+}
+
+void profile_toggle() {
+	if (!running) {
+		profile_start();
+	} else {
+		profile_stop();
+		schedule_work(&dump_work);
+	}
+}
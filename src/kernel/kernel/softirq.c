@@ -0,0 +1,218 @@
+#include <include/kernel/softirq.h>
+#include <include/kernel/logger.h>
+#include <include/sched/task.h>
+#include <include/x86/cpu.h>
+#include <include/x86/idt.h>
+#include <include/x86/irqflags.h>
+#include <include/helpers.h>
+
+#include <stddef.h>
+
+// How many times pending softirqs are run again on the way out of an interrupt, if they were raised
+// again in the meantime, before the rest are left to ksoftirqd.
+#define MAX_SOFTIRQ_RESTART 10
+
+static void tasklet_action();
+static void tasklet_hi_action();
+
+static void (*softirq_vec[NR_SOFTIRQS])() = {
+	[SOFTIRQ_HI] = tasklet_hi_action,
+	[SOFTIRQ_TASKLET] = tasklet_action
+};
+
+// Each CPU runs its own tasklets. A list is only touched by its own CPU, with interrupts disabled.
+struct tasklet_list {
+	tasklet_t *head;
+	tasklet_t **tail;
+};
+
+static struct tasklet_list tasklet_vec[MAX_CPUS];
+static struct tasklet_list tasklet_hi_vec[MAX_CPUS];
+
+static task_t *softirqd[MAX_CPUS];
+
+void open_softirq(uint32_t nr, void (*action)()) {
+	softirq_vec[nr] = action;
+}
+
+static void wakeup_softirqd() {
+	task_t *task = softirqd[this_cpu()->id];
+	if (task) {
+		task_wake(task);
+	}
+}
+
+void raise_softirq(uint32_t nr) {
+	uint32_t flags = irq_save();
+	this_cpu()->softirq_pending |= 1 << nr;
+
+	// Interrupts run them on their way out, but elsewhere no one would get around to them.
+	if (!in_interrupt() && !in_softirq()) {
+		wakeup_softirqd();
+	}
+	irq_restore(flags);
+}
+
+// Runs pending softirqs, entered and left with interrupts disabled.
+static void __do_softirq() {
+	struct cpu *cpu = this_cpu();
+	uint32_t restart = MAX_SOFTIRQ_RESTART;
+	uint32_t pending = cpu->softirq_pending;
+
+	// We can not be moved to another CPU while this is raised, so 'cpu' remains ours.
+	preempt_count_add(SOFTIRQ_OFFSET);
+
+	do {
+		cpu->softirq_pending = 0;
+		irq_enable();
+
+		for (uint32_t nr = 0; pending; nr++, pending >>= 1) {
+			if (pending & 1) {
+				softirq_vec[nr]();
+			}
+		}
+
+		irq_disable();
+		pending = cpu->softirq_pending;
+	} while (pending && --restart);
+
+	if (pending) {
+		wakeup_softirqd();
+	}
+
+	preempt_count_sub(SOFTIRQ_OFFSET);
+}
+
+void do_softirq() {
+	if (in_interrupt() || in_softirq()) {
+		return;
+	}
+
+	uint32_t flags = irq_save();
+	if (this_cpu()->softirq_pending) {
+		__do_softirq();
+	}
+	irq_restore(flags);
+}
+
+void local_bh_disable() {
+	preempt_count_add(SOFTIRQ_OFFSET);
+}
+
+void local_bh_enable() {
+	uint32_t flags = irq_save();
+	preempt_count_sub(SOFTIRQ_OFFSET);
+
+	// Run those which were raised in the meantime, unless they are still disabled further out.
+	if (!in_interrupt() && !in_softirq() && this_cpu()->softirq_pending) {
+		__do_softirq();
+	}
+	irq_restore(flags);
+
+	// Preemption was disabled all along too, and a reschedule may have been held off by it.
+	cond_resched();
+}
+
+static void ksoftirqd(void *UNUSED(args)) {
+	while (true) {
+		// Only this CPU raises its own softirqs, and it can not do so while interrupts are disabled,
+		// so there is no chance of missing a wake up between checking and blocking.
+		uint32_t flags = irq_save();
+		if (!this_cpu()->softirq_pending) {
+			task_prepare_block();
+			task_block();
+		}
+
+		if (this_cpu()->softirq_pending) {
+			__do_softirq();
+		}
+		irq_restore(flags);
+
+		// Softirqs may be raised faster than we can run them, so give others a chance in between.
+		cond_resched();
+	}
+}
+
+void softirq_init() {
+	struct cpu *cpu;
+	for_each_online_cpu(cpu) {
+		task_t *task = thread_create(ksoftirqd, NULL);
+		thread_set_affinity(task, 1 << cpu->id);
+		softirqd[cpu->id] = task;
+	}
+}
+
+static void __tasklet_schedule(tasklet_t *t, struct tasklet_list *vec, uint32_t nr) {
+	// Already scheduled, and not yet run
+	if (__atomic_fetch_or(&t->state, TASKLET_STATE_SCHED, __ATOMIC_ACQUIRE) & TASKLET_STATE_SCHED) {
+		return;
+	}
+
+	uint32_t flags = irq_save();
+	struct tasklet_list *list = &vec[this_cpu()->id];
+
+	// Lists start out zeroed, before anything was ever put on them
+	if (!list->tail) {
+		list->tail = &list->head;
+	}
+
+	t->next = NULL;
+	*list->tail = t;
+	list->tail = &t->next;
+	raise_softirq(nr);
+	irq_restore(flags);
+}
+
+void tasklet_init(tasklet_t *t, void (*func)(void *data), void *data) {
+	t->next = NULL;
+	t->state = 0;
+	t->func = func;
+	t->data = data;
+}
+
+void tasklet_schedule(tasklet_t *t) {
+	__tasklet_schedule(t, tasklet_vec, SOFTIRQ_TASKLET);
+}
+
+void tasklet_hi_schedule(tasklet_t *t) {
+	__tasklet_schedule(t, tasklet_hi_vec, SOFTIRQ_HI);
+}
+
+static void run_tasklets(struct tasklet_list *vec, uint32_t nr) {
+	// Take the whole list, so tasklets scheduled from now on are left for the next time around.
+	irq_disable();
+	struct tasklet_list *list = &vec[this_cpu()->id];
+	tasklet_t *t = list->head;
+	list->head = NULL;
+	list->tail = &list->head;
+	irq_enable();
+
+	while (t) {
+		tasklet_t *next = t->next;
+
+		// Still running on another CPU, where it was scheduled before, so it has to wait its turn.
+		if (__atomic_fetch_or(&t->state, TASKLET_STATE_RUN, __ATOMIC_ACQUIRE) & TASKLET_STATE_RUN) {
+			irq_disable();
+			t->next = NULL;
+			*list->tail = t;
+			list->tail = &t->next;
+			this_cpu()->softirq_pending |= 1 << nr;
+			irq_enable();
+		} else {
+			// Cleared before running it, so that it may be scheduled again from within itself.
+			__atomic_fetch_and(&t->state, ~TASKLET_STATE_SCHED, __ATOMIC_RELEASE);
+			t->func(t->data);
+			__atomic_fetch_and(&t->state, ~TASKLET_STATE_RUN, __ATOMIC_RELEASE);
+		}
+
+		t = next;
+	}
+}
+
+static void tasklet_action() {
+	run_tasklets(tasklet_vec, SOFTIRQ_TASKLET);
+}
+
+static void tasklet_hi_action() {
+	run_tasklets(tasklet_hi_vec, SOFTIRQ_HI);
+}
@@ -0,0 +1,41 @@
+#include <include/kernel/stacktrace.h>
+#include <include/kernel/ksyms.h>
+#include <include/kernel/mem.h>
+#include <stdio.h>
+
+/*
+	Each frame holds the frame pointer of its caller, followed by the address to return to. Thread
+	stacks start out with a zero frame pointer, which ends the chain, but anything which does not
+	look like part of it ends it just as well: Frames only ever lie further up the same stack.
+*/
+uint32_t stack_trace_save(uint32_t fp, uint32_t *entries, uint32_t max) {
+	uint32_t depth = 0;
+
+	while (fp && !(fp & 3) && depth < max) {
+		uint32_t *frame = (uint32_t *) fp;
+		if (!frame[1]) {
+			break;
+		}
+		entries[depth++] = frame[1];
+
+		uint32_t next = frame[0];
+		if (next <= fp || next - fp >= PAGE_SIZE) {
+			break;
+		}
+		fp = next;
+	}
+
+	return depth;
+}
+
+void dump_stack() {
+	uint32_t entries[STACK_TRACE_DEPTH];
+	uint32_t depth = stack_trace_save((uint32_t) __builtin_frame_address(0), entries, STACK_TRACE_DEPTH);
+
+	printf("Call Trace:\n");
+	for (uint32_t i = 0; i < depth; i++) {
+		char sym[KSYM_SYMBOL_LEN];
+		sprint_symbol(sym, entries[i]);
+		printf("  [%x] %s\n", entries[i], sym);
+	}
+}
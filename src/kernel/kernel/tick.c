@@ -0,0 +1,193 @@
+#include <include/kernel/tick.h>
+#include <include/kernel/ktimer.h>
+#include <include/kernel/time.h>
+#include <include/kernel/logger.h>
+#include <include/kernel/spinlock.h>
+#include <include/sched/task.h>
+#include <include/x86/cpu.h>
+#include <include/x86/smp.h>
+#include <include/x86/irqflags.h>
+#include <include/helpers.h>
+
+#include <stdbool.h>
+
+// Maximum number of subsystems that can be driven from the tick
+#define TICK_MAX_HANDLERS 4
+
+// Length of a jiffy, in nanoseconds
+#define TICK_NSEC (NSEC_PER_SEC / TIMER_HZ)
+
+// CPU which counts off jiffies on each of its ticks while there is no clocksource to derive them from.
+#define TICK_DO_TIMER_CPU 0
+
+volatile uint32_t jiffies;
+
+// Called, in order of registration, on each tick.
+static interrupt_handler handlers[TICK_MAX_HANDLERS];
+static uint32_t num_handlers;
+
+/*
+	The tick of each CPU. While it is stopped, the device has been programmed to fire once, at the
+	jiffy 'oneshot_expires'. Once it fires, it is no longer armed until it is reprogrammed. Only the
+	CPU itself touches its tick, and always with interrupts disabled, so no lock is needed, except
+	that others look at 'stopped' to decide whether they need to kick it (see tick_nohz_kick).
+*/
+struct tick_sched {
+	struct clock_event_device *dev;
+	volatile bool stopped;
+	bool oneshot_armed;
+	uint32_t oneshot_expires;
+};
+
+static struct tick_sched tick_cpus[MAX_CPUS];
+
+// Protects jiffies, as well as the time (per the clocksource) up to which it has been counted.
+static spinlock_t jiffies_lock = SPINLOCK_INITIALIZER;
+static uint64_t last_jiffies_update;
+
+// Brings jiffies up to date from the clocksource with jiffies_lock held, returning false if there is
+// none to do so with.
+static bool __tick_update_jiffies() {
+	if (!clocksource_continuous()) {
+		return false;
+	}
+
+	// Jiffies carries on from wherever it was counted up to before the clocksource was registered.
+	uint64_t now = ktime_get_ns();
+	if (!last_jiffies_update) {
+		last_jiffies_update = now;
+	} else if (now >= last_jiffies_update + TICK_NSEC) {
+		uint32_t rem;
+		jiffies += (uint32_t) div_u64_rem(now - last_jiffies_update, TICK_NSEC, &rem);
+		last_jiffies_update = now - rem;
+	}
+
+	return true;
+}
+
+static void tick_handler(struct registers *regs) {
+	struct tick_sched *ts = &tick_cpus[smp_processor_id()];
+
+	spin_lock(&jiffies_lock);
+	if (!__tick_update_jiffies() && smp_processor_id() == TICK_DO_TIMER_CPU) {
+		jiffies++;
+	}
+	spin_unlock(&jiffies_lock);
+
+	ts->oneshot_armed = false;
+
+	for (uint32_t i = 0; i < num_handlers; i++) {
+		handlers[i](regs);
+	}
+
+	tick_nohz_update();
+}
+
+void tick_register_device(struct clock_event_device *dev) {
+	uint32_t flags = irq_save();
+	struct tick_sched *ts = &tick_cpus[smp_processor_id()];
+
+	if (ts->dev) {
+		ts->dev->event_handler = NULL;
+		if (ts->dev->shutdown) {
+			ts->dev->shutdown();
+		}
+	}
+
+	ts->dev = dev;
+	ts->stopped = false;
+	ts->oneshot_armed = false;
+	dev->event_handler = tick_handler;
+	dev->set_periodic();
+
+	irq_restore(flags);
+	KTRACE("CPU %d: Tick device: %s, max one-shot: %d jiffies", smp_processor_id(), dev->name, dev->max_delta_ticks);
+}
+
+void tick_add_handler(void (*cb)(struct registers *regs)) {
+	if (num_handlers == TICK_MAX_HANDLERS) {
+		KPANIC("Too many timer tick handlers!");
+	}
+
+	handlers[num_handlers++] = cb;
+}
+
+void tick_update_jiffies() {
+	uint32_t flags = spin_lock_irqsave(&jiffies_lock);
+	__tick_update_jiffies();
+	spin_unlock_irqrestore(&jiffies_lock, flags);
+}
+
+uint32_t get_jiffies() {
+	tick_update_jiffies();
+	return jiffies;
+}
+
+void tick_nohz_update() {
+	uint32_t flags = irq_save();
+	struct tick_sched *ts = &tick_cpus[smp_processor_id()];
+
+	// Without a clocksource, nothing would count the jiffies that pass while the tick is stopped.
+	if (!ts->dev || !clocksource_continuous()) {
+		irq_restore(flags);
+		return;
+	}
+
+	/*
+		Others check whether the tick is stopped after changing our run queue, so it is marked as such
+		before we look at the run queue for the last time. Either they see it, and kick us, or we see
+		their change. If it turns out the tick is needed after all, that only costs a needless kick.
+	*/
+	bool was_stopped = ts->stopped;
+	ts->stopped = true;
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	tick_update_jiffies();
+
+	// The next deadline is either the next timer expiring, or the current task's slice running out.
+	uint32_t delta = MIN(ktimer_next_expiry(), sched_next_event());
+
+	// klogd may be waiting on the tick to be woken.
+	if (log_needs_tick()) {
+		delta = 0;
+	}
+
+	// Something needs to happen by the next jiffy anyway
+	if (delta <= 1) {
+		ts->stopped = false;
+		if (was_stopped) {
+			ts->oneshot_armed = false;
+			ts->dev->set_periodic();
+		}
+
+		irq_restore(flags);
+		return;
+	}
+
+	delta = MIN(delta, ts->dev->max_delta_ticks);
+	uint32_t expires = jiffies + delta;
+
+	// Already set to fire early enough; it will be reprogrammed once it does.
+	if (was_stopped && ts->oneshot_armed && !time_after(ts->oneshot_expires, expires)) {
+		irq_restore(flags);
+		return;
+	}
+
+	ts->oneshot_armed = true;
+	ts->oneshot_expires = expires;
+	ts->dev->set_oneshot(delta);
+
+	irq_restore(flags);
+}
+
+void tick_nohz_kick(uint32_t cpu) {
+	// Our own tick is taken care of by the tick_nohz_update that follows any such change.
+	if (cpu == smp_processor_id()) {
+		return;
+	}
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (tick_cpus[cpu].stopped) {
+		smp_send_reschedule(cpu);
+	}
+}
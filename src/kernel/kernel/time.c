@@ -0,0 +1,71 @@
+#include <include/kernel/time.h>
+#include <include/kernel/tick.h>
+#include <include/kernel/logger.h>
+#include <include/drivers/timer.h>
+#include <include/x86/irqflags.h>
+#include <include/helpers.h>
+
+static uint64_t jiffies_read() {
+	return get_jiffies();
+}
+
+// Only as precise as a jiffy, but always there.
+static struct clocksource jiffies_clocksource = {
+	.name = "jiffies",
+	.read = jiffies_read,
+	.mult = NSEC_PER_SEC / TIMER_HZ,
+	.shift = 0,
+};
+
+static struct clocksource *clock = &jiffies_clocksource;
+
+// Time at which the current clocksource was registered, and what it read at the time.
+static uint64_t base_ns;
+static uint64_t base_cycles;
+
+static inline uint64_t cycles_to_ns(struct clocksource *cs, uint64_t cycles) {
+	return mul_u64_u32_shr(cycles, cs->mult, cs->shift);
+}
+
+void clocksource_register(struct clocksource *cs, uint32_t khz) {
+	// Use the largest shift for which mult still fits in 32 bits, for the best precision.
+	uint32_t rem;
+	uint32_t shift = 32;
+	uint64_t mult = div_u64_rem((uint64_t) NSEC_PER_MSEC << shift, khz, &rem);
+	while (mult >> 32) {
+		shift--;
+		mult = div_u64_rem((uint64_t) NSEC_PER_MSEC << shift, khz, &rem);
+	}
+
+	cs->mult = (uint32_t) mult;
+	cs->shift = shift;
+
+	uint32_t flags = irq_save();
+	base_ns = ktime_get_ns();
+	base_cycles = cs->read();
+	clock = cs;
+	irq_restore(flags);
+
+	KTRACE("Clocksource: %s, mult: %d, shift: %d", cs->name, cs->mult, cs->shift);
+}
+
+bool clocksource_continuous() {
+	return clock != &jiffies_clocksource;
+}
+
+uint64_t ktime_get_ns() {
+	return base_ns + cycles_to_ns(clock, clock->read() - base_cycles);
+}
+
+void ktime_get_timestamp(uint32_t *sec, uint32_t *usec) {
+	uint32_t nsec;
+	*sec = (uint32_t) div_u64_rem(ktime_get_ns(), NSEC_PER_SEC, &nsec);
+	*usec = nsec / NSEC_PER_USEC;
+}
+
+void udelay(uint32_t usec) {
+	uint64_t end = ktime_get_ns() + (uint64_t) usec * NSEC_PER_USEC;
+	while (ktime_get_ns() < end) {
+		asm volatile ("pause");
+	}
+}
@@ -0,0 +1,186 @@
+#include <include/kernel/trace.h>
+#include <include/kernel/time.h>
+#include <include/kernel/workqueue.h>
+#include <include/kernel/logger.h>
+#include <include/drivers/serial.h>
+#include <include/sched/task.h>
+#include <include/sched/mutex.h>
+#include <include/x86/cpu.h>
+#include <include/x86/irqflags.h>
+#include <string.h>
+#include <stdio.h>
+
+#define TRACEPOINT_NAME(name, format) #name,
+static const char *tracepoint_names[NR_TRACEPOINTS] = {
+	TRACEPOINTS(TRACEPOINT_NAME)
+};
+#undef TRACEPOINT_NAME
+
+#define TRACEPOINT_FORMAT(name, format) format,
+static const char *tracepoint_formats[NR_TRACEPOINTS] = {
+	TRACEPOINTS(TRACEPOINT_FORMAT)
+};
+#undef TRACEPOINT_FORMAT
+
+volatile bool tracepoint_enabled[NR_TRACEPOINTS];
+
+/*
+	Events of a CPU, of which only the last TRACE_RECORDS are kept. Only that CPU records them, with
+	interrupts disabled, so that nothing else gets in between; they are only read once tracing has
+	been stopped.
+*/
+struct trace_buffer {
+	struct trace_record records[TRACE_RECORDS];
+	uint32_t tail;
+};
+
+static struct trace_buffer buffers[MAX_CPUS];
+
+static volatile bool running;
+
+// Only one dump at a time.
+static mutex_t dump_lock = MUTEX_INITIALIZER(dump_lock);
+
+/*
+	Dumps requested but not yet finished. Tracing is not started again until they are, since that
+	clears the buffers; trace_start may be called from a softirq, so it cannot wait on dump_lock.
+*/
+static uint32_t dumps_pending;
+
+// A line of the dump, for a single record in hexadecimal.
+static char line[32 + 2 * sizeof(struct trace_record)];
+
+// Writes out the buffers once tracing is stopped by trace_toggle.
+static work_t dump_work;
+
+void __trace_event(uint32_t id, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {
+	uint32_t flags = irq_save();
+	uint32_t cpu = smp_processor_id();
+	struct trace_buffer *buf = &buffers[cpu];
+	struct trace_record *record = &buf->records[buf->tail++ % TRACE_RECORDS];
+
+	task_t *task = task_current();
+	record->time = ktime_get_ns();
+	record->id = (uint16_t) id;
+	record->cpu = (uint16_t) cpu;
+	record->task = task ? task->id : 0;
+	record->args[0] = a0;
+	record->args[1] = a1;
+	record->args[2] = a2;
+	record->args[3] = a3;
+
+	irq_restore(flags);
+}
+
+bool trace_set_enabled(const char *name, bool enabled) {
+	for (uint32_t i = 0; i < NR_TRACEPOINTS; i++) {
+		if (!strcmp(tracepoint_names[i], name)) {
+			tracepoint_enabled[i] = enabled;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool trace_start() {
+	if (__atomic_load_n(&dumps_pending, __ATOMIC_ACQUIRE)) {
+		KWARNING("Trace is still being written out, not starting");
+		return false;
+	}
+
+	for (uint32_t i = 0; i < MAX_CPUS; i++) {
+		buffers[i].tail = 0;
+	}
+
+	running = true;
+	for (uint32_t i = 0; i < NR_TRACEPOINTS; i++) {
+		tracepoint_enabled[i] = true;
+	}
+
+	KINFO("Tracing...");
+	return true;
+}
+
+void trace_stop() {
+	for (uint32_t i = 0; i < NR_TRACEPOINTS; i++) {
+		tracepoint_enabled[i] = false;
+	}
+	running = false;
+
+	KINFO("Tracing stopped");
+}
+
+bool trace_running() {
+	return running;
+}
+
+static void dump_record(struct trace_record *record) {
+	const uint8_t *bytes = (const uint8_t *) record;
+	char *pos = line + sprintf(line, "t %x ", record->cpu);
+	for (uint32_t i = 0; i < sizeof(*record); i++) {
+		pos += sprintf(pos, "%02x", bytes[i]);
+	}
+	sprintf(pos, "\n");
+	serial_print(line);
+}
+
+static void do_dump() {
+	uint32_t total = 0;
+	mutex_lock(&dump_lock);
+
+	sprintf(line, "trace: begin cpus=%d records=%d\n", nr_cpus, TRACE_RECORDS);
+	serial_print(line);
+
+	for (uint32_t i = 0; i < NR_TRACEPOINTS; i++) {
+		serial_print("tp ");
+		sprintf(line, "%d %s ", i, tracepoint_names[i]);
+		serial_print(line);
+		serial_print(tracepoint_formats[i]);
+		serial_print("\n");
+	}
+
+	struct cpu *cpu;
+	for_each_online_cpu(cpu) {
+		struct trace_buffer *buf = &buffers[cpu->id];
+		uint32_t start = buf->tail > TRACE_RECORDS ? buf->tail - TRACE_RECORDS : 0;
+		for (uint32_t i = start; i != buf->tail; i++) {
+			dump_record(&buf->records[i % TRACE_RECORDS]);
+			total++;
+		}
+	}
+
+	serial_print("trace: end\n");
+	mutex_unlock(&dump_lock);
+	__atomic_sub_fetch(&dumps_pending, 1, __ATOMIC_RELEASE);
+
+	KINFO("Trace written out: %d events", total);
+}
+
+void trace_dump() {
+	__atomic_add_fetch(&dumps_pending, 1, __ATOMIC_ACQUIRE);
+	do_dump();
+}
+
+static void dump_work_func(void *UNUSED(data)) {
+	do_dump();
+}
+
+void trace_init() {
+	work_init(&dump_work, dump_work_func, NULL);
+}
+
+void trace_toggle() {
+	if (!running) {
+		trace_start();
+	} else {
+		trace_stop();
+
+		// Counted before it is queued, so that it can not finish first. Already queued, it is
+		// counted once already.
+		__atomic_add_fetch(&dumps_pending, 1, __ATOMIC_ACQUIRE);
+		if (!schedule_work(&dump_work)) {
+			__atomic_sub_fetch(&dumps_pending, 1, __ATOMIC_RELEASE);
+		}
+	}
+}
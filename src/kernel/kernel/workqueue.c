@@ -0,0 +1,265 @@
+#include <include/kernel/workqueue.h>
+#include <include/kernel/spinlock.h>
+#include <include/kernel/logger.h>
+#include <include/kernel/mem.h>
+#include <include/sched/task.h>
+#include <include/x86/cpu.h>
+#include <include/helpers.h>
+
+TAILQ_HEAD(work_list, work);
+
+struct worker {
+	task_t *task;
+	struct worker_pool *pool;
+	// Set while on the idle list, and cleared by whoever takes it off to wake it.
+	bool idle;
+	LIST_ENTRY(worker) idle_entry;
+};
+
+// The workers of a CPU, and the work they have yet to get to.
+struct worker_pool {
+	spinlock_t lock;
+	uint32_t cpu;
+	struct work_list worklist;
+	LIST_HEAD(, worker) idle_list;
+	uint32_t nr_workers;
+	uint32_t nr_idle;
+	// Set while one of the workers is busy starting another
+	bool creating;
+};
+
+// What a work queue has going on in the pool of a CPU, protected by the lock of that pool.
+struct pool_workqueue {
+	// Items in the pool's worklist or running
+	uint32_t nr_active;
+	// Items held back by max_active
+	struct work_list inactive;
+};
+
+struct workqueue {
+	const char *name;
+	uint32_t max_active;
+	struct pool_workqueue pwqs[MAX_CPUS];
+};
+
+static struct worker_pool pools[MAX_CPUS];
+
+workqueue_t *system_wq;
+
+static void worker_thread(void *args);
+
+static void create_worker(struct worker_pool *pool) {
+	struct worker *worker = kmalloc(sizeof(*worker));
+	worker->pool = pool;
+	worker->idle = false;
+
+	uint32_t flags = spin_lock_irqsave(&pool->lock);
+	pool->nr_workers++;
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	task_t *task = thread_create(worker_thread, worker);
+	thread_set_affinity(task, 1 << pool->cpu);
+}
+
+// Must be called with the pool locked.
+static void wake_idle_worker(struct worker_pool *pool) {
+	struct worker *worker = LIST_FIRST(&pool->idle_list);
+	if (worker) {
+		LIST_REMOVE(worker, idle_entry);
+		worker->idle = false;
+		pool->nr_idle--;
+		task_wake(worker->task);
+	}
+}
+
+// Must be called with the pool locked.
+static void insert_work(struct worker_pool *pool, workqueue_t *wq, work_t *work) {
+	struct pool_workqueue *pwq = &wq->pwqs[pool->cpu];
+	work->wq = wq;
+
+	if (pwq->nr_active < wq->max_active) {
+		pwq->nr_active++;
+		TAILQ_INSERT_TAIL(&pool->worklist, work, entry);
+		wake_idle_worker(pool);
+	} else {
+		TAILQ_INSERT_TAIL(&pwq->inactive, work, entry);
+	}
+}
+
+// Called once a work item of the queue has finished, with the pool locked, to let in the next one.
+static void work_done(struct worker_pool *pool, workqueue_t *wq) {
+	struct pool_workqueue *pwq = &wq->pwqs[pool->cpu];
+	pwq->nr_active--;
+
+	work_t *work = TAILQ_FIRST(&pwq->inactive);
+	if (work) {
+		TAILQ_REMOVE(&pwq->inactive, work, entry);
+		pwq->nr_active++;
+		TAILQ_INSERT_TAIL(&pool->worklist, work, entry);
+		wake_idle_worker(pool);
+	}
+}
+
+static void worker_thread(void *args) {
+	struct worker *worker = args;
+	struct worker_pool *pool = worker->pool;
+	worker->task = task_current();
+
+	uint32_t flags = spin_lock_irqsave(&pool->lock);
+	while (true) {
+		work_t *work = TAILQ_FIRST(&pool->worklist);
+		if (!work) {
+			LIST_INSERT_HEAD(&pool->idle_list, worker, idle_entry);
+			worker->idle = true;
+			pool->nr_idle++;
+
+			// Whoever wakes us holds the lock, so they can not have seen us yet, and wake us even
+			// if we have not quite blocked by the time they do (see wait_queue_block).
+			while (worker->idle) {
+				task_prepare_block();
+				spin_unlock(&pool->lock);
+				task_block();
+				spin_lock(&pool->lock);
+			}
+			continue;
+		}
+
+		TAILQ_REMOVE(&pool->worklist, work, entry);
+
+		// Keep a worker idle, for work queued while this item runs, or left waiting should it block
+		// (see wq_worker_sleeping). Workers are started from here rather than where work is queued,
+		// as that may be an interrupt handler.
+		if (!pool->nr_idle && !pool->creating && pool->nr_workers < WQ_MAX_WORKERS) {
+			pool->creating = true;
+			spin_unlock_irqrestore(&pool->lock, flags);
+			create_worker(pool);
+			flags = spin_lock_irqsave(&pool->lock);
+			pool->creating = false;
+		}
+
+		// The work may be freed or queued again as soon as it runs, so everything we need of it is
+		// copied out, and it is no longer pending from here on.
+		workqueue_t *wq = work->wq;
+		void (*func)(void *data) = work->func;
+		void *data = work->data;
+		__atomic_store_n(&work->pending, 0, __ATOMIC_RELEASE);
+
+		spin_unlock_irqrestore(&pool->lock, flags);
+		worker->task->wq_worker = worker;
+		func(data);
+		worker->task->wq_worker = NULL;
+		flags = spin_lock_irqsave(&pool->lock);
+
+		work_done(pool, wq);
+	}
+}
+
+void wq_worker_sleeping(struct worker *worker) {
+	struct worker_pool *pool = worker->pool;
+
+	uint32_t flags = spin_lock_irqsave(&pool->lock);
+	if (!TAILQ_EMPTY(&pool->worklist)) {
+		wake_idle_worker(pool);
+	}
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+void workqueue_init() {
+	struct cpu *cpu;
+	for_each_online_cpu(cpu) {
+		struct worker_pool *pool = &pools[cpu->id];
+		spin_lock_init(&pool->lock);
+		pool->cpu = cpu->id;
+		TAILQ_INIT(&pool->worklist);
+		LIST_INIT(&pool->idle_list);
+		create_worker(pool);
+	}
+
+	system_wq = workqueue_create("events", 0);
+}
+
+workqueue_t *workqueue_create(const char *name, uint32_t max_active) {
+	workqueue_t *wq = kmalloc(sizeof(*wq));
+	wq->name = name;
+	wq->max_active = max_active ? max_active : WQ_DFL_ACTIVE;
+
+	for (uint32_t i = 0; i < MAX_CPUS; i++) {
+		wq->pwqs[i].nr_active = 0;
+		TAILQ_INIT(&wq->pwqs[i].inactive);
+	}
+
+	return wq;
+}
+
+void work_init(work_t *work, void (*func)(void *data), void *data) {
+	work->func = func;
+	work->data = data;
+	work->pending = 0;
+	work->wq = NULL;
+}
+
+static void delayed_work_timer(void *data) {
+	delayed_work_t *dwork = data;
+	struct worker_pool *pool = &pools[dwork->cpu];
+
+	uint32_t flags = spin_lock_irqsave(&pool->lock);
+	insert_work(pool, dwork->work.wq, &dwork->work);
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+void delayed_work_init(delayed_work_t *dwork, void (*func)(void *data), void *data) {
+	work_init(&dwork->work, func, data);
+	ktimer_setup(&dwork->timer, delayed_work_timer, dwork);
+}
+
+static bool test_and_set_pending(work_t *work) {
+	return __atomic_exchange_n(&work->pending, 1, __ATOMIC_ACQUIRE);
+}
+
+bool queue_work_on(uint32_t cpu, workqueue_t *wq, work_t *work) {
+	if (test_and_set_pending(work)) {
+		return false;
+	}
+
+	struct worker_pool *pool = &pools[cpu];
+	uint32_t flags = spin_lock_irqsave(&pool->lock);
+	insert_work(pool, wq, work);
+	spin_unlock_irqrestore(&pool->lock, flags);
+	return true;
+}
+
+bool queue_work(workqueue_t *wq, work_t *work) {
+	return queue_work_on(smp_processor_id(), wq, work);
+}
+
+bool queue_delayed_work(workqueue_t *wq, delayed_work_t *dwork, uint32_t ms) {
+	if (!ms) {
+		return queue_work(wq, &dwork->work);
+	}
+
+	if (test_and_set_pending(&dwork->work)) {
+		return false;
+	}
+
+	dwork->cpu = smp_processor_id();
+	dwork->work.wq = wq;
+	ktimer_start(&dwork->timer, ms);
+	return true;
+}
+
+bool cancel_delayed_work(delayed_work_t *dwork) {
+	if (!ktimer_cancel(&dwork->timer)) {
+		return false;
+	}
+
+	__atomic_store_n(&dwork->work.pending, 0, __ATOMIC_RELEASE);
+	return true;
+}
+
+bool schedule_work(work_t *work) {
+	return queue_work(system_wq, work);
+}
+
+bool schedule_delayed_work(delayed_work_t *dwork, uint32_t ms) {
+	return queue_delayed_work(system_wq, dwork, ms);
+}
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""
+Generates the symbol table linked into the kernel (see include/kernel/ksyms.h), as C source, from
+the output of 'nm -n' on the first link of it.
+
+	nm -n MoltarOS.kernel.tmp | ./ksyms.py > ksyms_table.c
+"""
+import collections
+import sys
+
+# Must match include/kernel/ksyms.h
+KSYM_NAME_LEN = 64
+KSYM_MARKER_INTERVAL = 16
+KSYM_TOKEN_BASE = 0x80
+MAX_TOKENS = 0x100 - KSYM_TOKEN_BASE
+
+
+def read_symbols(f):
+	"""Functions (global or static) by address, keeping only the first of any at the same address."""
+	symbols = []
+	for line in f:
+		parts = line.split()
+		if len(parts) != 3 or parts[1] not in "Tt":
+			continue
+		addr, name = int(parts[0], 16), parts[2][:KSYM_NAME_LEN - 1]
+		if symbols and symbols[-1][0] == addr:
+			continue
+		symbols.append((addr, name))
+	return symbols
+
+
+def replace_pair(seq, pair, token):
+	out = []
+	i = 0
+	while i < len(seq):
+		if i + 1 < len(seq) and (seq[i], seq[i + 1]) == pair:
+			out.append(token)
+			i += 2
+		else:
+			out.append(seq[i])
+			i += 1
+	return out
+
+
+def compress(names):
+	"""
+	Byte pair encoding: The pair of bytes which occurs most often is replaced with a token of its own,
+	until the tokens run out or no pair is worth one. Returns the compressed names, and what each
+	token expands to.
+	"""
+	seqs = [list(name.encode("ascii")) for name in names]
+	expansions = {byte: bytes([byte]) for byte in range(KSYM_TOKEN_BASE)}
+	tokens = []
+
+	while len(tokens) < MAX_TOKENS:
+		pairs = collections.Counter()
+		for seq in seqs:
+			pairs.update(zip(seq, seq[1:]))
+		if not pairs:
+			break
+
+		pair, count = pairs.most_common(1)[0]
+		# Each use saves a byte, but the expansion costs a few in the table.
+		if count < 4:
+			break
+
+		token = KSYM_TOKEN_BASE + len(tokens)
+		expansions[token] = expansions[pair[0]] + expansions[pair[1]]
+		tokens.append(expansions[token])
+		seqs = [replace_pair(seq, pair, token) for seq in seqs]
+
+	return seqs, tokens
+
+
+def c_array(values, per_line=12, fmt="0x%02x"):
+	lines = []
+	for i in range(0, len(values), per_line):
+		lines.append("\t" + ", ".join(fmt % value for value in values[i:i + per_line]) + ",")
+	return "\n".join(lines)
+
+
+def main():
+	symbols = read_symbols(sys.stdin)
+	seqs, tokens = compress([name for addr, name in symbols])
+
+	names = []
+	markers = []
+	for i, seq in enumerate(seqs):
+		if i % KSYM_MARKER_INTERVAL == 0:
+			markers.append(len(names))
+		names.append(len(seq))
+		names.extend(seq)
+
+	token_table = []
+	token_index = []
+	for token in tokens:
+		token_index.append(len(token_table))
+		token_table.extend(token)
+		token_table.append(0)
+
+	out = sys.stdout
+	out.write("// Generated by ksyms.py, do not edit.\n")
+	out.write("#include <stdint.h>\n\n")
+	out.write("const uint32_t ksym_count = %d;\n\n" % len(symbols))
+	out.write("const uint32_t ksym_addresses[] = {\n%s\n};\n\n" % c_array([addr for addr, name in symbols], 6, "0x%08x"))
+	out.write("const uint8_t ksym_names[] = {\n%s\n};\n\n" % c_array(names))
+	out.write("const uint32_t ksym_markers[] = {\n%s\n};\n\n" % c_array(markers, 8, "%d"))
+	out.write("const uint16_t ksym_token_index[] = {\n%s\n};\n\n" % c_array(token_index or [0], 8, "%d"))
+	out.write("const char ksym_token_table[] = {\n%s\n};\n" % c_array(token_table or [0]))
+
+	raw = sum(len(name) + 1 for addr, name in symbols)
+	sys.stderr.write("ksyms: %d symbols, names %d bytes (%d uncompressed)\n"
+		% (len(symbols), len(names) + len(token_table) + 2 * len(token_index), raw))
+
+
+if __name__ == "__main__":
+	main()
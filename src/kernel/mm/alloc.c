@@ -1,5 +1,8 @@
 #include <include/mm/alloc.h>
 #include <include/kernel/logger.h>
+#include <include/kernel/spinlock.h>
+#include <include/kernel/trace.h>
+#include <include/sched/preempt.h>
 #include <include/helpers.h>
 #include <string.h>
 #include <stdint.h>
@@ -7,9 +10,14 @@
 const uint32_t PAGE_SIZE = 4 * 1024 * 1024;
 const uint32_t CHUNK_SIZE = 4 * 1024;
 const uint32_t NUM_FRAMES = 1024;
+// Blocks are cleared this much at a time, with a preemption point in between (see alloc_block).
+static const uint32_t CLEAR_CHUNK_SIZE = 64 * 1024;
 static const uint32_t PRESENT = 0x1;
 static const uint32_t READ_WRITE = 0x2;
 static const uint32_t PAGE_MB = 1 << 7;
+// Disables caching of the page, which memory-mapped device registers require.
+static const uint32_t CACHE_DISABLE = 1 << 4;
+static const uint32_t WRITE_THROUGH = 1 << 3;
 
 // Maximum number of frames is 1024 / 32 = 32, so -1 is a valid error number.
 static const uint32_t PAGE_ERR = (uint32_t) -1;
@@ -21,6 +29,9 @@ static uint32_t *page_directory;
 static uint32_t frame_bitmap[NUM_FRAMES / 32];
 static uint32_t dir_bitmap[NUM_FRAMES / 32];
 
+// Protects all of the above, as any CPU may allocate.
+static spinlock_t alloc_lock = SPINLOCK_INITIALIZER;
+
 extern uint32_t PHYSICAL_MEMORY_START;
 extern uint32_t PHYSICAL_MEMORY_END;
 
@@ -79,6 +90,8 @@ void alloc_init() {
 }
 
 vaddr_t alloc_block() {
+	uint32_t flags = spin_lock_irqsave(&alloc_lock);
+
 	// Obtain the first free frame by cycling through all possible frames for one without it's PRESENT bit set.
 	bool found = false;
 	for (int i = 0; i < 1024; i++) {
@@ -96,6 +109,7 @@ vaddr_t alloc_block() {
 
 			// Claim the frame
 			BITMAP_SET(frame_bitmap, frame_idx);
+			trace_event(frame_alloc, frame_idx * PAGE_SIZE, virtual_addr);
 
 			// Mark frame as present and invalidate for TLB
 			page_directory[idx] = (frame_idx * PAGE_SIZE) | PAGE_MB | PRESENT | READ_WRITE;
@@ -117,9 +131,31 @@ vaddr_t alloc_block() {
 
 	uint32_t retval = virtual_addr;
 	virtual_addr += PAGE_SIZE;
+	spin_unlock_irqrestore(&alloc_lock, flags);
 
-	// Clear the memory allocated frame for the user
+	// Clear the memory allocated frame for the user, a chunk at a time so that a pending reschedule
+	// does not have to wait for all of it to be cleared.
 	// KTRACE("Clearing chunk %x for user...", retval);
-	memset(retval, 0, PAGE_SIZE);
+	for (uint32_t offset = 0; offset < PAGE_SIZE; offset += CLEAR_CHUNK_SIZE) {
+		memset((void *) (retval + offset), 0, CLEAR_CHUNK_SIZE);
+		cond_resched();
+	}
 	return retval;
+}
+
+vaddr_t alloc_map_device(paddr_t addr) {
+	uint32_t idx = addr / PAGE_SIZE;
+	uint32_t flags = spin_lock_irqsave(&alloc_lock);
+
+	// Devices are usually mapped near the top of the address space, well out of the way of our allocations.
+	if (!(page_directory[idx] & PRESENT)) {
+		BITMAP_SET(frame_bitmap, idx);
+		page_directory[idx] = (idx * PAGE_SIZE) | PAGE_MB | CACHE_DISABLE | WRITE_THROUGH | PRESENT | READ_WRITE;
+		asm volatile ("invlpg (%0)" :: "r" (addr) : "memory");
+	} else if ((page_directory[idx] & 0xFFC00000) != idx * PAGE_SIZE) {
+		KPANIC("Can not map device at %x, as its address is already in use!", addr);
+	}
+
+	spin_unlock_irqrestore(&alloc_lock, flags);
+	return addr;
 }
\ No newline at end of file
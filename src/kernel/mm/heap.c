@@ -1,12 +1,18 @@
 #include <include/mm/heap.h>
+#include <include/sched/preempt.h>
 #include <include/helpers.h>
 #include <string.h>
 
 // Idenitifies that the bitmap's entry is free to use
 static const uint8_t FREE = 0;
 
+// Number of bitmap entries scanned between preemption points in memheap_alloc. A fresh 4MB superblock
+// of 16 byte blocks has over 250000 of them, which is far too long to keep interrupts disabled for.
+#define SCAN_BATCH 1024
+
 void memheap_init(memheap_t *heap) {
 	heap->head = NULL;
+	mcs_lock_init(&heap->lock);
 }
 
 // The bitmap of a superblock is located directly after the superblock itself.
@@ -34,10 +40,6 @@ void memheap_add_block(memheap_t *heap, uintptr_t addr, uint32_t size, uint32_t
 	sblock->total_size = size - sizeof(memblock_t);
 	sblock->block_size = block_size;
 
-	// Make this the head of the heap's list of blocks
-	sblock->next = heap->head;
-	heap->head = sblock;
-
 	uint32_t block_count = sblock->total_size / sblock->block_size;
 	uint8_t *bitmap = memblock_get_bitmap(sblock);
 
@@ -50,9 +52,26 @@ void memheap_add_block(memheap_t *heap, uintptr_t addr, uint32_t size, uint32_t
 
 	// We used some space for the bitmap, so we need to keep track of that.
 	sblock->used = block_count;
+
+	// Make this the head of the heap's list of blocks, now that it is ready for use. Superblocks are
+	// only ever added at the head, which memheap_alloc relies on when it lets go of the lock.
+	struct mcs_node node;
+	uint32_t flags = mcs_lock_irqsave(&heap->lock, &node);
+	sblock->next = heap->head;
+	heap->head = sblock;
+	mcs_unlock_irqrestore(&heap->lock, &node, flags);
 }
 
 void *memheap_alloc(memheap_t *heap, uint32_t size) {
+	// The lock is only ever let go of to give way to interrupts and other tasks if the caller
+	// could have been interrupted anyway.
+	bool can_relax = preemptible();
+	uint32_t scanned = 0;
+	void *retval = NULL;
+
+	struct mcs_node node;
+	uint32_t flags = mcs_lock_irqsave(&heap->lock, &node);
+
 	// For each superblock...
 	for (memblock_t *sblock = heap->head; sblock; sblock = sblock->next) {
 		// If this superblock is large enough
@@ -64,6 +83,14 @@ void *memheap_alloc(memheap_t *heap, uint32_t size) {
 
 			// For each bitmap entry...
 			for (uint32_t i = 0; i < block_count; i++) {
+				// Preemption point: The bitmap may change while the lock is let go of, but entry 'i'
+				// is checked again from scratch, and the superblocks themselves never go away.
+				if (can_relax && ++scanned % SCAN_BATCH == 0) {
+					mcs_unlock_irqrestore(&heap->lock, &node, flags);
+					cond_resched();
+					flags = mcs_lock_irqsave(&heap->lock, &node);
+				}
+
 				// Try to find enough contiguous blocks that can satisfy this request
 				if (bitmap[i] == FREE) {
 					// Determine if there is enough free blocks at this offset. There is enough if the following conditions are met...
@@ -86,7 +113,8 @@ void *memheap_alloc(memheap_t *heap, uint32_t size) {
 						// Update count
 						sblock->used += n;
 
-						return (void *) (i * sblock->block_size + (uintptr_t) &sblock[1]);
+						retval = (void *) (i * sblock->block_size + (uintptr_t) &sblock[1]);
+						goto out;
 					}
 
 					// This chunk of memory is not in use, skip over it. i gets incremented in next iteration.
@@ -98,10 +126,15 @@ void *memheap_alloc(memheap_t *heap, uint32_t size) {
 	}
 
 	// No memory found...
-	return NULL;
+out:
+	mcs_unlock_irqrestore(&heap->lock, &node, flags);
+	return retval;
 }
 
 void memheap_free(memheap_t *heap, void *ptr) {
+	struct mcs_node node;
+	uint32_t flags = mcs_lock_irqsave(&heap->lock, &node);
+
 	// For each superblock...
 	for (memblock_t *sblock = heap->head; sblock; sblock = sblock->next) {
 		// If the pointer is within the superblock
@@ -121,4 +154,6 @@ void memheap_free(memheap_t *heap, void *ptr) {
 			sblock->used -= block_offset - block_start;
 		}
 	}
+
+	mcs_unlock_irqrestore(&heap->lock, &node, flags);
 }
\ No newline at end of file
@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""
+Reads the samples written out over the serial port by the profiler (see include/kernel/profile.h)
+and prints either a flat profile or folded stacks, which flamegraph.pl turns into a flame graph.
+The kernel symbolizes them itself; addresses it could not are symbolized against the symbol file
+made by script.sh, if given.
+
+	./profile.py serial.log
+	./profile.py --folded serial.log | flamegraph.pl > profile.svg
+	./script.sh MoltarOS.kernel && ./profile.py --symbols MoltarOS.kernel.sym serial.log
+"""
+import argparse
+import bisect
+import collections
+import sys
+
+
+def load_symbols(path):
+	addrs, names = [], []
+	with open(path) as f:
+		for line in f:
+			parts = line.split()
+			if len(parts) == 2:
+				addrs.append(int(parts[0], 16))
+				names.append(parts[1])
+	return addrs, names
+
+
+def symbolize(symbols, addr):
+	addrs, names = symbols
+	i = bisect.bisect_right(addrs, addr) - 1
+	return names[i] if i >= 0 else hex(addr)
+
+
+def frame_name(symbols, frame, is_return):
+	"""Name of a frame, which is either already symbolized, as 'name+0x1a', or a plain address."""
+	if "+" in frame:
+		return frame.split("+", 1)[0]
+	addr = int(frame, 16)
+	if not symbols:
+		return hex(addr)
+	# Return addresses point just past the call, which may already be the next function.
+	return symbolize(symbols, addr - 1 if is_return else addr)
+
+
+def read_samples(path):
+	"""Yields (cpu, task, frames), innermost first, of every sample between begin and end lines."""
+	inside = False
+	with open(path, errors="replace") as f:
+		for line in f:
+			line = line.strip()
+			if line.startswith("profile: begin"):
+				inside = True
+			elif line.startswith("profile: end"):
+				inside = False
+			elif inside and line:
+				fields = line.split()
+				try:
+					cpu, task = int(fields[0], 16), int(fields[1], 16)
+				except (ValueError, IndexError):
+					continue
+				if len(fields) >= 3:
+					yield cpu, task, fields[2:]
+
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+	parser.add_argument("--folded", action="store_true", help="print folded stacks instead of a flat profile")
+	parser.add_argument("--cpu", type=int, help="only count samples taken on this CPU")
+	parser.add_argument("--symbols", help="symbol file made by script.sh, for addresses the kernel could not symbolize")
+	parser.add_argument("log")
+	args = parser.parse_args()
+
+	symbols = load_symbols(args.symbols) if args.symbols else None
+
+	total = 0
+	self_counts = collections.Counter()
+	total_counts = collections.Counter()
+	stacks = collections.Counter()
+
+	for cpu, task, frames in read_samples(args.log):
+		if args.cpu is not None and cpu != args.cpu:
+			continue
+
+		try:
+			names = [frame_name(symbols, frame, i > 0) for i, frame in enumerate(frames)]
+		except ValueError:
+			continue
+		total += 1
+		self_counts[names[0]] += 1
+		for name in set(names):
+			total_counts[name] += 1
+		stacks[";".join(reversed(names))] += 1
+
+	if args.folded:
+		for stack, count in stacks.most_common():
+			print(stack, count)
+		return
+
+	if not total:
+		sys.exit("No samples found")
+
+	print("%d samples" % total)
+	print("%7s %7s  %s" % ("self", "total", "function"))
+	for name, count in self_counts.most_common():
+		print("%6.2f%% %6.2f%%  %s" % (100.0 * count / total, 100.0 * total_counts[name] / total, name))
+
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,29 @@
+#include <include/sched/condvar.h>
+
+void cond_init(condvar_t *cond) {
+	wait_queue_init(&cond->waiters);
+}
+
+void cond_wait(condvar_t *cond, mutex_t *mutex) {
+	uint32_t flags = spin_lock_irqsave(&cond->waiters.lock);
+
+	// We must be on the wait queue before the mutex is released, otherwise a signal sent
+	// in between would be lost.
+	wait_queue_entry_t entry;
+	wait_queue_add(&cond->waiters, &entry);
+	__mutex_unlock(mutex);
+	wait_queue_block(&cond->waiters, &entry);
+
+	spin_unlock_irqrestore(&cond->waiters.lock, flags);
+	mutex_lock(mutex);
+}
+
+void cond_signal(condvar_t *cond) {
+	wake_up_one(&cond->waiters);
+	sched_preempt();
+}
+
+void cond_broadcast(condvar_t *cond) {
+	wake_up_all(&cond->waiters);
+	sched_preempt();
+}
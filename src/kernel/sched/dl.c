@@ -0,0 +1,315 @@
+#include <include/sched/sched.h>
+#include <include/helpers.h>
+
+/*
+	The deadline class runs the task with the earliest deadline first (EDF), before any other class.
+	Each task reserves a share of its CPU, its bandwidth (runtime / period), and so long as the sum of
+	all reservations does not exceed the CPU (see dl_admit), EDF is guaranteed to meet every deadline.
+	To keep a task from taking more than it reserved and causing others to miss theirs, it is
+	throttled once it has used up its runtime, until its next period begins. Since that is checked
+	from the tick, a task may overrun by up to a tick, which is then taken out of its next period.
+
+	Deadline tasks are not moved by the load balancer, as their bandwidth is reserved on their CPU.
+*/
+
+// Deadlines are allowed to wrap, so they must always be compared by their difference.
+static inline bool deadline_before(uint64_t a, uint64_t b) {
+	return (int64_t) (a - b) < 0;
+}
+
+static int task_deadline_cmp(task_t *a, task_t *b) {
+	if (deadline_before(a->deadline, b->deadline)) {
+		return -1;
+	} else if (deadline_before(b->deadline, a->deadline)) {
+		return 1;
+	}
+
+	// Ties are broken by address, as the tree requires each key to be unique.
+	return (uintptr_t) a < (uintptr_t) b ? -1 : (uintptr_t) a > (uintptr_t) b;
+}
+
+RB_GENERATE_INTERNAL(dl_tree, task, dl_node, task_deadline_cmp, __attribute__((__unused__)) static)
+
+// Bandwidth in fixed point (see BW_SHIFT); the period always fits in 32 bits (see dl_admit).
+static uint32_t to_bw(uint64_t runtime, uint64_t period) {
+	uint32_t rem;
+	return (uint32_t) div_u64_rem(runtime << BW_SHIFT, (uint32_t) period, &rem);
+}
+
+// When the next period of the task begins, and with it, its runtime is replenished.
+static inline uint64_t replenish_time(task_t *task) {
+	return task->deadline - task->dl_deadline + task->dl_period;
+}
+
+static void tree_insert(struct dl_rq *dl_rq, task_t *task) {
+	RB_INSERT(dl_tree, &dl_rq->tasks_timeline, task);
+
+	if (!dl_rq->leftmost || task_deadline_cmp(task, dl_rq->leftmost) < 0) {
+		dl_rq->leftmost = task;
+	}
+}
+
+static void tree_remove(struct dl_rq *dl_rq, task_t *task) {
+	if (task == dl_rq->leftmost) {
+		dl_rq->leftmost = RB_NEXT(dl_tree, &dl_rq->tasks_timeline, task);
+	}
+
+	RB_REMOVE(dl_tree, &dl_rq->tasks_timeline, task);
+}
+
+static void throttle(struct dl_rq *dl_rq, task_t *task) {
+	LIST_INSERT_HEAD(&dl_rq->throttled, task, dl_throttled_entry);
+	task->dl_throttled = true;
+}
+
+static void unthrottle(task_t *task) {
+	LIST_REMOVE(task, dl_throttled_entry);
+	task->dl_throttled = false;
+}
+
+// Starts a brand new period from now.
+static void start_period(struct rq *rq, task_t *task) {
+	task->deadline = rq->clock + task->dl_deadline;
+	task->runtime = (int64_t) task->dl_runtime;
+}
+
+// Moves on to the next period, which pays for any overrun of the last one.
+static void replenish(struct rq *rq, task_t *task) {
+	task->deadline += task->dl_period;
+	task->runtime += (int64_t) task->dl_runtime;
+
+	// Too far behind to ever catch up, so it starts over from now.
+	if (task->runtime <= 0 || !deadline_before(rq->clock, task->deadline)) {
+		start_period(rq, task);
+	}
+}
+
+/*
+	A task which was not runnable for a while can not simply carry on with what it had left, as
+	running that much before its old deadline might need more than its share of the CPU. If so (or
+	the deadline has already passed), it starts a new period instead.
+*/
+static void update_dl_entity(struct rq *rq, task_t *task) {
+	if (!deadline_before(rq->clock, task->deadline)) {
+		start_period(rq, task);
+		return;
+	}
+
+	// runtime / (deadline - now) > dl_runtime / dl_period, without dividing
+	if (task->runtime > 0 && (uint64_t) task->runtime * task->dl_period > (task->deadline - rq->clock) * task->dl_runtime) {
+		start_period(rq, task);
+	}
+}
+
+// Charges the current task for the time it has run since we last checked, throttling it once it runs out.
+static void update_curr(struct rq *rq) {
+	struct dl_rq *dl_rq = &rq->dl;
+	task_t *curr = dl_rq->curr;
+	if (!curr) {
+		return;
+	}
+
+	uint64_t delta = rq->clock - curr->exec_start;
+	if ((int64_t) delta <= 0) {
+		return;
+	}
+
+	curr->exec_start = rq->clock;
+	curr->sum_exec_runtime += delta;
+	curr->runtime -= (int64_t) delta;
+
+	if (curr->runtime <= 0 && curr->on_rq && !curr->dl_throttled) {
+		throttle(dl_rq, curr);
+		resched_curr(rq);
+	}
+}
+
+static void enqueue_task_dl(struct rq *rq, task_t *task, int flags) {
+	struct dl_rq *dl_rq = &rq->dl;
+
+	if (flags & ((ENQUEUE_NEW) | (ENQUEUE_WAKEUP))) {
+		update_dl_entity(rq, task);
+	}
+
+	if (task->runtime <= 0) {
+		throttle(dl_rq, task);
+	} else if (task != dl_rq->curr) {
+		tree_insert(dl_rq, task);
+	}
+
+	dl_rq->nr_running++;
+	task->on_rq = true;
+}
+
+static void dequeue_task_dl(struct rq *rq, task_t *task) {
+	struct dl_rq *dl_rq = &rq->dl;
+
+	update_curr(rq);
+
+	// Still throttled once it wakes up, if it wakes up before its next period.
+	if (task->dl_throttled) {
+		unthrottle(task);
+	} else if (task != dl_rq->curr) {
+		tree_remove(dl_rq, task);
+	}
+
+	dl_rq->nr_running--;
+	task->on_rq = false;
+}
+
+// Yielding gives up whatever is left of the runtime of this period.
+static void yield_task_dl(struct rq *rq) {
+	task_t *curr = rq->dl.curr;
+	if (!curr) {
+		return;
+	}
+
+	update_curr(rq);
+	if (!curr->dl_throttled) {
+		curr->runtime = 0;
+		throttle(&rq->dl, curr);
+	}
+}
+
+static void check_preempt_curr_dl(struct rq *rq, task_t *task) {
+	if (deadline_before(task->deadline, rq->curr->deadline)) {
+		resched_curr(rq);
+	}
+}
+
+static task_t *pick_next_task_dl(struct rq *rq) {
+	struct dl_rq *dl_rq = &rq->dl;
+	task_t *task = dl_rq->leftmost;
+	if (!task) {
+		return NULL;
+	}
+
+	// The running task is kept outside of the tree.
+	tree_remove(dl_rq, task);
+	dl_rq->curr = task;
+	task->exec_start = rq->clock;
+
+	return task;
+}
+
+static void put_prev_task_dl(struct rq *rq, task_t *task) {
+	struct dl_rq *dl_rq = &rq->dl;
+
+	update_curr(rq);
+
+	if (task->on_rq && !task->dl_throttled) {
+		tree_insert(dl_rq, task);
+	}
+
+	dl_rq->curr = NULL;
+}
+
+static void set_curr_task_dl(struct rq *rq, task_t *task) {
+	struct dl_rq *dl_rq = &rq->dl;
+
+	if (task->on_rq && !task->dl_throttled) {
+		tree_remove(dl_rq, task);
+	}
+
+	dl_rq->curr = task;
+	task->exec_start = rq->clock;
+}
+
+static void task_tick_dl(struct rq *rq, task_t *UNUSED(curr)) {
+	update_curr(rq);
+}
+
+static void task_fork_dl(task_t *UNUSED(task)) {
+}
+
+// Nice levels have no meaning here, but are kept for when the task goes back to the fair class.
+static void reweight_task_dl(struct rq *UNUSED(rq), task_t *task, int nice) {
+	task->nice = nice;
+}
+
+// Runtime left, at which point the task is throttled. Earlier deadlines preempt it when they wake up.
+static uint64_t time_slice_left_dl(struct rq *UNUSED(rq), task_t *curr) {
+	return curr->runtime > 0 ? (uint64_t) curr->runtime : 0;
+}
+
+static task_t *pick_migration_task_dl(struct rq *UNUSED(rq), struct rq *UNUSED(dst), bool UNUSED(force)) {
+	return NULL;
+}
+
+// Only a change of affinity moves a deadline task, and its reservation goes along with it.
+static void migrate_task_rq_dl(task_t *task, struct rq *src, struct rq *dst) {
+	uint32_t bw = to_bw(task->dl_runtime, task->dl_period);
+	src->dl.total_bw -= bw;
+	dst->dl.total_bw += bw;
+}
+
+bool dl_admit(struct rq *rq, task_t *task, const struct sched_attr *attr) {
+	uint32_t old_bw = task->sched_class == &dl_sched_class ? to_bw(task->dl_runtime, task->dl_period) : 0;
+	uint32_t new_bw = 0;
+
+	if (attr->policy == SCHED_DEADLINE) {
+		uint64_t deadline = attr->deadline ? attr->deadline : attr->period;
+		if (!attr->runtime || attr->runtime > deadline || deadline > attr->period || attr->period > UINT32_MAX) {
+			return false;
+		}
+
+		new_bw = to_bw(attr->runtime, attr->period);
+		if (rq->dl.total_bw - old_bw + new_bw > DL_BW_LIMIT) {
+			return false;
+		}
+	}
+
+	rq->dl.total_bw = rq->dl.total_bw - old_bw + new_bw;
+	return true;
+}
+
+void dl_replenish_throttled(struct rq *rq) {
+	struct dl_rq *dl_rq = &rq->dl;
+	task_t *task, *tmp;
+
+	LIST_FOREACH_SAFE(task, &dl_rq->throttled, dl_throttled_entry, tmp) {
+		if (deadline_before(rq->clock, replenish_time(task))) {
+			continue;
+		}
+
+		unthrottle(task);
+		replenish(rq, task);
+		if (task != dl_rq->curr) {
+			tree_insert(dl_rq, task);
+		}
+
+		// Deadline tasks come before all others, and among themselves, the earliest deadline first.
+		if (rq->curr->sched_class != &dl_sched_class || deadline_before(task->deadline, rq->curr->deadline)) {
+			resched_curr(rq);
+		}
+	}
+}
+
+uint64_t dl_next_replenish(struct rq *rq) {
+	uint64_t next = UINT64_MAX;
+	task_t *task;
+
+	LIST_FOREACH(task, &rq->dl.throttled, dl_throttled_entry) {
+		uint64_t at = replenish_time(task);
+		next = MIN(next, deadline_before(rq->clock, at) ? at - rq->clock : 0);
+	}
+
+	return next;
+}
+
+const struct sched_class dl_sched_class = {
+	.next = &rt_sched_class,
+	.enqueue_task = enqueue_task_dl,
+	.dequeue_task = dequeue_task_dl,
+	.yield_task = yield_task_dl,
+	.check_preempt_curr = check_preempt_curr_dl,
+	.pick_next_task = pick_next_task_dl,
+	.put_prev_task = put_prev_task_dl,
+	.set_curr_task = set_curr_task_dl,
+	.task_tick = task_tick_dl,
+	.task_fork = task_fork_dl,
+	.reweight_task = reweight_task_dl,
+	.time_slice_left = time_slice_left_dl,
+	.pick_migration_task = pick_migration_task_dl,
+	.migrate_task_rq = migrate_task_rq_dl,
+};
@@ -0,0 +1,396 @@
+#include <include/sched/sched.h>
+#include <include/helpers.h>
+
+// Every runnable task should get to run at least once within this period (20ms)...
+static const uint64_t sched_latency = 20000000ULL;
+// ...unless there are so many of them that each would run for less than this (4ms), in which case
+// the period is stretched instead, so that context switches do not dominate and throughput stays high.
+static const uint64_t sched_min_granularity = 4000000ULL;
+static const uint32_t sched_nr_latency = 5;
+// A woken task must be behind the current one by at least this much (1ms) to preempt it.
+static const uint64_t sched_wakeup_granularity = 1000000ULL;
+
+/*
+	Weights for each nice level, where each step in nice is a ~10% change in CPU share. Nice 0
+	has a weight of NICE_0_LOAD. The second table is the inverse (2^32 / weight), used so that
+	scaling by a weight is a multiplication rather than a 64-bit division.
+*/
+static const uint32_t prio_to_weight[40] = {
+	/* -20 */ 88761, 71755, 56483, 46273, 36291,
+	/* -15 */ 29154, 23254, 18705, 14949, 11916,
+	/* -10 */ 9548, 7620, 6100, 4904, 3906,
+	/*  -5 */ 3121, 2501, 1991, 1586, 1277,
+	/*   0 */ 1024, 820, 655, 526, 423,
+	/*   5 */ 335, 272, 215, 172, 137,
+	/*  10 */ 110, 87, 70, 56, 45,
+	/*  15 */ 36, 29, 23, 18, 15,
+};
+
+static const uint32_t prio_to_wmult[40] = {
+	/* -20 */ 48388, 59856, 76040, 92818, 118348,
+	/* -15 */ 147320, 184698, 229616, 287308, 360437,
+	/* -10 */ 449829, 563644, 704093, 875809, 1099582,
+	/*  -5 */ 1376151, 1717300, 2157191, 2708050, 3363326,
+	/*   0 */ 4194304, 5237765, 6557202, 8165337, 10153587,
+	/*   5 */ 12820798, 15790321, 19976592, 24970740, 31350126,
+	/*  10 */ 39045157, 49367440, 61356676, 76695844, 95443717,
+	/*  15 */ 119304647, 148102320, 186737708, 238609294, 286331153,
+};
+
+// Virtual runtimes are allowed to wrap, so they must always be compared by their difference.
+static inline int64_t vruntime_diff(uint64_t a, uint64_t b) {
+	return (int64_t) (a - b);
+}
+
+static int task_vruntime_cmp(task_t *a, task_t *b) {
+	int64_t diff = vruntime_diff(a->vruntime, b->vruntime);
+	if (diff < 0) {
+		return -1;
+	} else if (diff > 0) {
+		return 1;
+	}
+
+	// Ties are broken by address, as the tree requires each key to be unique.
+	return (uintptr_t) a < (uintptr_t) b ? -1 : (uintptr_t) a > (uintptr_t) b;
+}
+
+RB_GENERATE_INTERNAL(task_tree, task, run_node, task_vruntime_cmp, __attribute__((__unused__)) static)
+
+// Scales the real time 'delta' by NICE_0_LOAD / weight of the task.
+static uint64_t calc_delta_fair(uint64_t delta, task_t *task) {
+	if (task->weight == NICE_0_LOAD) {
+		return delta;
+	}
+
+	return mul_u64_u32_shr(delta * NICE_0_LOAD, prio_to_wmult[task->nice - NICE_MIN], 32);
+}
+
+// The period in which all runnable tasks should run once.
+static uint64_t sched_period(uint32_t nr_running) {
+	if (nr_running > sched_nr_latency) {
+		return nr_running * sched_min_granularity;
+	}
+
+	return sched_latency;
+}
+
+// The wall-clock time slice the task is entitled to, which is its share of the period
+// proportional to its weight.
+static uint64_t sched_slice(struct cfs_rq *cfs_rq, task_t *task) {
+	uint32_t nr_running = cfs_rq->nr_running + !task->on_rq;
+	uint32_t load = cfs_rq->load + (task->on_rq ? 0 : task->weight);
+	uint64_t slice = sched_period(nr_running);
+
+	if (load != task->weight) {
+		slice = mul_u64_u32_shr(slice * task->weight, 0xFFFFFFFF / load, 32);
+	}
+
+	return slice;
+}
+
+// The slice converted to virtual time, used for placing new tasks.
+static uint64_t sched_vslice(struct cfs_rq *cfs_rq, task_t *task) {
+	return calc_delta_fair(sched_slice(cfs_rq, task), task);
+}
+
+static void update_min_vruntime(struct cfs_rq *cfs_rq) {
+	uint64_t vruntime = cfs_rq->min_vruntime;
+	task_t *curr = cfs_rq->curr;
+
+	// A current task which is about to block no longer holds back min_vruntime
+	if (curr && !curr->on_rq) {
+		curr = NULL;
+	}
+
+	if (curr) {
+		vruntime = curr->vruntime;
+	}
+
+	task_t *leftmost = cfs_rq->leftmost;
+	if (leftmost) {
+		if (!curr || vruntime_diff(leftmost->vruntime, vruntime) < 0) {
+			vruntime = leftmost->vruntime;
+		}
+	}
+
+	// Ensure we never go backwards
+	if (vruntime_diff(vruntime, cfs_rq->min_vruntime) > 0) {
+		cfs_rq->min_vruntime = vruntime;
+	}
+}
+
+// Charges the current task for the time it has run since we last checked.
+static void update_curr(struct rq *rq) {
+	struct cfs_rq *cfs_rq = &rq->cfs;
+	task_t *curr = cfs_rq->curr;
+	if (!curr) {
+		return;
+	}
+
+	uint64_t now = rq->clock;
+	uint64_t delta = now - curr->exec_start;
+	if ((int64_t) delta <= 0) {
+		return;
+	}
+
+	curr->exec_start = now;
+	curr->sum_exec_runtime += delta;
+	curr->vruntime += calc_delta_fair(delta, curr);
+	update_min_vruntime(cfs_rq);
+}
+
+static void tree_insert(struct cfs_rq *cfs_rq, task_t *task) {
+	RB_INSERT(task_tree, &cfs_rq->tasks_timeline, task);
+
+	if (!cfs_rq->leftmost || task_vruntime_cmp(task, cfs_rq->leftmost) < 0) {
+		cfs_rq->leftmost = task;
+	}
+}
+
+static void tree_remove(struct cfs_rq *cfs_rq, task_t *task) {
+	if (task == cfs_rq->leftmost) {
+		cfs_rq->leftmost = RB_NEXT(task_tree, &cfs_rq->tasks_timeline, task);
+	}
+
+	RB_REMOVE(task_tree, &cfs_rq->tasks_timeline, task);
+}
+
+/*
+	Decides where a task that has just been created or woken up belongs in the timeline.
+	New tasks are placed one virtual slice after min_vruntime so that creating threads can
+	not be used to starve the tasks already running. Waking tasks are given credit for at most
+	half a latency period of sleep: enough that an interactive task which mostly sleeps runs
+	promptly once woken, but not so much that it can monopolize the CPU afterwards.
+*/
+static void place_task(struct cfs_rq *cfs_rq, task_t *task, bool initial) {
+	uint64_t vruntime = cfs_rq->min_vruntime;
+
+	if (initial) {
+		vruntime += sched_vslice(cfs_rq, task);
+	} else {
+		vruntime -= sched_latency / 2;
+	}
+
+	// Never gain time by sleeping, only lose the lag accumulated while asleep.
+	if (vruntime_diff(task->vruntime, vruntime) > 0) {
+		vruntime = task->vruntime;
+	}
+
+	task->vruntime = vruntime;
+}
+
+static void enqueue_task_fair(struct rq *rq, task_t *task, int flags) {
+	struct cfs_rq *cfs_rq = &rq->cfs;
+
+	update_curr(rq);
+
+	if (flags & ENQUEUE_NEW) {
+		place_task(cfs_rq, task, true);
+	} else if (flags & ENQUEUE_WAKEUP) {
+		place_task(cfs_rq, task, false);
+	}
+
+	if (task != cfs_rq->curr) {
+		tree_insert(cfs_rq, task);
+	}
+
+	cfs_rq->nr_running++;
+	cfs_rq->load += task->weight;
+	task->on_rq = true;
+}
+
+static void dequeue_task_fair(struct rq *rq, task_t *task) {
+	struct cfs_rq *cfs_rq = &rq->cfs;
+
+	update_curr(rq);
+
+	if (task != cfs_rq->curr) {
+		tree_remove(cfs_rq, task);
+	}
+
+	cfs_rq->nr_running--;
+	cfs_rq->load -= task->weight;
+	task->on_rq = false;
+	update_min_vruntime(cfs_rq);
+}
+
+/*
+	Yielding moves the current task behind every other runnable task, otherwise a task which
+	has run less than the others (I.E: one that mostly yields) would simply be picked again.
+*/
+static void yield_task_fair(struct rq *rq) {
+	struct cfs_rq *cfs_rq = &rq->cfs;
+	task_t *curr = cfs_rq->curr;
+	if (!curr) {
+		return;
+	}
+
+	update_curr(rq);
+
+	task_t *last = RB_MAX(task_tree, &cfs_rq->tasks_timeline);
+	if (last && vruntime_diff(last->vruntime, curr->vruntime) >= 0) {
+		curr->vruntime = last->vruntime + 1;
+	}
+}
+
+// A woken task preempts the current one if it is sufficiently far behind in virtual runtime.
+static void check_preempt_wakeup(struct rq *rq, task_t *task) {
+	task_t *curr = rq->cfs.curr;
+	if (!curr || curr == task) {
+		return;
+	}
+
+	update_curr(rq);
+
+	int64_t diff = vruntime_diff(curr->vruntime, task->vruntime);
+	if (diff > (int64_t) calc_delta_fair(sched_wakeup_granularity, task)) {
+		resched_curr(rq);
+	}
+}
+
+static task_t *pick_next_task_fair(struct rq *rq) {
+	struct cfs_rq *cfs_rq = &rq->cfs;
+	task_t *task = cfs_rq->leftmost;
+	if (!task) {
+		return NULL;
+	}
+
+	// The running task is kept outside of the tree.
+	tree_remove(cfs_rq, task);
+	cfs_rq->curr = task;
+	task->exec_start = rq->clock;
+	task->prev_sum_exec_runtime = task->sum_exec_runtime;
+
+	return task;
+}
+
+static void put_prev_task_fair(struct rq *rq, task_t *task) {
+	struct cfs_rq *cfs_rq = &rq->cfs;
+
+	update_curr(rq);
+
+	// Still runnable, so it goes back into the tree
+	if (task->on_rq) {
+		tree_insert(cfs_rq, task);
+	}
+
+	cfs_rq->curr = NULL;
+}
+
+static void set_curr_task_fair(struct rq *rq, task_t *task) {
+	struct cfs_rq *cfs_rq = &rq->cfs;
+
+	if (task->on_rq) {
+		tree_remove(cfs_rq, task);
+	}
+
+	cfs_rq->curr = task;
+	task->exec_start = rq->clock;
+	task->prev_sum_exec_runtime = task->sum_exec_runtime;
+}
+
+/*
+	Preempt the current task once it has used up its slice, or once it has run for at least
+	the minimum granularity and is further ahead of the leftmost task than a whole slice.
+*/
+static void task_tick_fair(struct rq *rq, task_t *curr) {
+	struct cfs_rq *cfs_rq = &rq->cfs;
+
+	update_curr(rq);
+
+	if (cfs_rq->nr_running < 2) {
+		return;
+	}
+
+	uint64_t ideal_runtime = sched_slice(cfs_rq, curr);
+	uint64_t delta_exec = curr->sum_exec_runtime - curr->prev_sum_exec_runtime;
+	if (delta_exec > ideal_runtime) {
+		resched_curr(rq);
+		return;
+	}
+
+	task_t *leftmost = cfs_rq->leftmost;
+	if (delta_exec < sched_min_granularity || !leftmost) {
+		return;
+	}
+
+	int64_t delta = vruntime_diff(curr->vruntime, leftmost->vruntime);
+	if (delta > (int64_t) ideal_runtime) {
+		resched_curr(rq);
+	}
+}
+
+static uint64_t time_slice_left_fair(struct rq *rq, task_t *curr) {
+	struct cfs_rq *cfs_rq = &rq->cfs;
+
+	if (cfs_rq->nr_running < 2) {
+		return UINT64_MAX;
+	}
+
+	uint64_t ideal_runtime = sched_slice(cfs_rq, curr);
+	uint64_t delta_exec = curr->sum_exec_runtime - curr->prev_sum_exec_runtime;
+	return delta_exec < ideal_runtime ? ideal_runtime - delta_exec : 0;
+}
+
+// The leftmost tasks have waited the longest, and hence are the least likely to still be cache hot.
+static task_t *pick_migration_task_fair(struct rq *rq, struct rq *dst, bool force) {
+	task_t *task;
+	RB_FOREACH(task, task_tree, &rq->cfs.tasks_timeline) {
+		if (can_migrate_task(rq, dst, task, force)) {
+			return task;
+		}
+	}
+
+	return NULL;
+}
+
+// Virtual runtimes are only meaningful relative to the min_vruntime of the same run queue.
+static void migrate_task_rq_fair(task_t *task, struct rq *src, struct rq *dst) {
+	task->vruntime = task->vruntime - src->cfs.min_vruntime + dst->cfs.min_vruntime;
+}
+
+static void task_fork_fair(task_t *task) {
+	task->nice = 0;
+	task->weight = NICE_0_LOAD;
+}
+
+static void reweight_task_fair(struct rq *rq, task_t *task, int nice) {
+	struct cfs_rq *cfs_rq = &rq->cfs;
+	bool queued = task->on_rq;
+
+	// Remove with the old weight, and add back with the new one.
+	if (queued) {
+		update_curr(rq);
+		if (task != cfs_rq->curr) {
+			tree_remove(cfs_rq, task);
+		}
+		cfs_rq->load -= task->weight;
+	}
+
+	task->nice = nice;
+	task->weight = prio_to_weight[nice - NICE_MIN];
+
+	if (queued) {
+		cfs_rq->load += task->weight;
+		if (task != cfs_rq->curr) {
+			tree_insert(cfs_rq, task);
+		}
+	}
+}
+
+const struct sched_class fair_sched_class = {
+	.next = &idle_sched_class,
+	.enqueue_task = enqueue_task_fair,
+	.dequeue_task = dequeue_task_fair,
+	.yield_task = yield_task_fair,
+	.check_preempt_curr = check_preempt_wakeup,
+	.pick_next_task = pick_next_task_fair,
+	.put_prev_task = put_prev_task_fair,
+	.set_curr_task = set_curr_task_fair,
+	.task_tick = task_tick_fair,
+	.task_fork = task_fork_fair,
+	.reweight_task = reweight_task_fair,
+	.time_slice_left = time_slice_left_fair,
+	.pick_migration_task = pick_migration_task_fair,
+	.migrate_task_rq = migrate_task_rq_fair,
+};
@@ -0,0 +1,214 @@
+#include <include/sched/fiber.h>
+#include <include/kernel/logger.h>
+#include <include/kernel/mem.h>
+#include <include/x86/irqflags.h>
+
+// Written to the lowest word of each fiber stack, and checked every time the fiber switches out.
+#define STACK_CANARY 0x57AC4CA7
+
+// Defined in sched/task_helper.asm
+extern void switch_context(uint32_t *prev_esp, uint32_t next_esp);
+
+static void fiber_start();
+
+void fiber_sched_init(fiber_sched_t *sched) {
+	spin_lock_init(&sched->lock);
+	TAILQ_INIT(&sched->ready);
+	sched->nr_fibers = 0;
+	sched->current = NULL;
+	sched->host = NULL;
+	sched->host_waiting = false;
+	sched->nr_switches = 0;
+}
+
+// Wakes up the host if it is waiting for something to do. Called with the lock held.
+static void kick_host(fiber_sched_t *sched) {
+	if (sched->host_waiting) {
+		sched->host_waiting = false;
+		task_wake(sched->host);
+	}
+}
+
+fiber_t *fiber_create(fiber_sched_t *sched, void (*func)(void *data), void *data, uint32_t stack_size) {
+	if (!stack_size) {
+		stack_size = FIBER_STACK_SIZE;
+	} else if (stack_size < FIBER_STACK_MIN) {
+		stack_size = FIBER_STACK_MIN;
+	}
+
+	fiber_t *fiber = kmalloc(sizeof(*fiber));
+	fiber->stack = kmalloc(stack_size);
+	fiber->stack_size = stack_size;
+	fiber->state = FIBER_READY;
+	fiber->func = func;
+	fiber->data = data;
+	fiber->sched = sched;
+	*(uint32_t *) fiber->stack = STACK_CANARY;
+
+	// Same frame as thread_create builds for switch_context, with fiber_start to 'return' to.
+	uint32_t *stack = (uint32_t *) ((uint32_t) fiber->stack + stack_size);
+	*--stack = 0;                          // Return address of fiber_start (never returns)
+	*--stack = (uint32_t) fiber_start;     // Return address of switch_context
+	*--stack = 0;                          // ebp
+	*--stack = 0;                          // ebx
+	*--stack = 0;                          // esi
+	*--stack = 0;                          // edi
+	fiber->esp = (uint32_t) stack;
+
+	uint32_t flags = spin_lock_irqsave(&sched->lock);
+	sched->nr_fibers++;
+	TAILQ_INSERT_TAIL(&sched->ready, fiber, entry);
+	kick_host(sched);
+	spin_unlock_irqrestore(&sched->lock, flags);
+
+	return fiber;
+}
+
+static void fiber_free(fiber_t *fiber) {
+	kfree(fiber->stack);
+	kfree(fiber);
+}
+
+void fiber_sched_run(fiber_sched_t *sched) {
+	task_t *host = task_current();
+	host->fiber_sched = sched;
+
+	// Interrupts stay disabled whenever we are switching, and so for as long as we are in here;
+	// fibers enable them while they run.
+	uint32_t flags = spin_lock_irqsave(&sched->lock);
+	sched->host = host;
+
+	while (sched->nr_fibers) {
+		fiber_t *fiber = TAILQ_FIRST(&sched->ready);
+		if (!fiber) {
+			// Every fiber is waiting on something, so we wait for one of them to be woken.
+			sched->host_waiting = true;
+			task_prepare_block();
+			spin_unlock(&sched->lock);
+			task_block();
+			spin_lock(&sched->lock);
+			continue;
+		}
+
+		TAILQ_REMOVE(&sched->ready, fiber, entry);
+		fiber->state = FIBER_RUNNING;
+		sched->current = fiber;
+		sched->nr_switches++;
+		spin_unlock(&sched->lock);
+
+		// Returns once the fiber yields, waits or returns.
+		switch_context(&sched->host_esp, fiber->esp);
+
+		if (*(uint32_t *) fiber->stack != STACK_CANARY) {
+			KPANIC("Fiber %x overflowed its stack of %d bytes!", fiber, fiber->stack_size);
+		}
+
+		spin_lock(&sched->lock);
+		sched->current = NULL;
+
+		switch (fiber->state) {
+			case FIBER_DONE:
+				sched->nr_fibers--;
+				fiber_free(fiber);
+				break;
+			case FIBER_RUNNING:
+				// Yielded, or woken before it got around to switching out; to the back of the line.
+				fiber->state = FIBER_READY;
+				TAILQ_INSERT_TAIL(&sched->ready, fiber, entry);
+				break;
+			case FIBER_WAITING:
+				// Queued again by fiber_wake.
+				break;
+		}
+	}
+
+	sched->host = NULL;
+	spin_unlock_irqrestore(&sched->lock, flags);
+	host->fiber_sched = NULL;
+}
+
+fiber_t *fiber_current() {
+	fiber_sched_t *sched = task_current()->fiber_sched;
+	return sched ? sched->current : NULL;
+}
+
+// Switches back to the host. Interrupts must be disabled by the caller, and remain disabled once we return.
+static void fiber_switch_out(fiber_t *fiber) {
+	switch_context(&fiber->esp, fiber->sched->host_esp);
+}
+
+static void fiber_start() {
+	// The host switched to us with interrupts disabled.
+	irq_enable();
+
+	fiber_t *fiber = fiber_current();
+	fiber->func(fiber->data);
+
+	// The host frees us (and the stack we are on) once we are switched out for good.
+	irq_disable();
+	fiber->state = FIBER_DONE;
+	fiber_switch_out(fiber);
+
+	KPANIC("Finished fiber %x was switched back to!", fiber);
+}
+
+void fiber_yield() {
+	fiber_t *fiber = fiber_current();
+	if (!fiber) {
+		return;
+	}
+
+	uint32_t flags = irq_save();
+	fiber_switch_out(fiber);
+	irq_restore(flags);
+}
+
+void fiber_prepare_wait() {
+	fiber_t *fiber = fiber_current();
+	if (!fiber) {
+		KPANIC("fiber_prepare_wait called outside of a fiber!");
+	}
+
+	uint32_t flags = spin_lock_irqsave(&fiber->sched->lock);
+	fiber->state = FIBER_WAITING;
+	spin_unlock_irqrestore(&fiber->sched->lock, flags);
+}
+
+void fiber_wait() {
+	fiber_t *fiber = fiber_current();
+	fiber_sched_t *sched = fiber->sched;
+
+	uint32_t flags = spin_lock_irqsave(&sched->lock);
+
+	// Already woken up since fiber_prepare_wait, so there is no need to wait.
+	if (fiber->state != FIBER_WAITING) {
+		spin_unlock_irqrestore(&sched->lock, flags);
+		return;
+	}
+
+	spin_unlock(&sched->lock);
+	fiber_switch_out(fiber);
+	irq_restore(flags);
+}
+
+bool fiber_wake(fiber_t *fiber) {
+	fiber_sched_t *sched = fiber->sched;
+	uint32_t flags = spin_lock_irqsave(&sched->lock);
+
+	if (fiber->state != FIBER_WAITING) {
+		spin_unlock_irqrestore(&sched->lock, flags);
+		return false;
+	}
+
+	// A fiber which has yet to switch out is simply put back by the host once it does.
+	if (sched->current == fiber) {
+		fiber->state = FIBER_RUNNING;
+	} else {
+		fiber->state = FIBER_READY;
+		TAILQ_INSERT_TAIL(&sched->ready, fiber, entry);
+		kick_host(sched);
+	}
+
+	spin_unlock_irqrestore(&sched->lock, flags);
+	return true;
+}
@@ -0,0 +1,72 @@
+#include <include/sched/sched.h>
+#include <include/kernel/logger.h>
+#include <include/helpers.h>
+
+/*
+	The idle class has exactly one task, rq->idle, which is always there to be picked and hence
+	must be the last class. It is never actually enqueued, nor can it ever block, as there would
+	be nothing left to run.
+*/
+
+static void enqueue_task_idle(struct rq *UNUSED(rq), task_t *UNUSED(task), int UNUSED(flags)) {
+}
+
+static void dequeue_task_idle(struct rq *UNUSED(rq), task_t *UNUSED(task)) {
+	KPANIC("The idle task can not block!");
+}
+
+static void yield_task_idle(struct rq *UNUSED(rq)) {
+}
+
+static void check_preempt_curr_idle(struct rq *UNUSED(rq), task_t *UNUSED(task)) {
+}
+
+static task_t *pick_next_task_idle(struct rq *rq) {
+	return rq->idle;
+}
+
+static void put_prev_task_idle(struct rq *UNUSED(rq), task_t *UNUSED(task)) {
+}
+
+static void set_curr_task_idle(struct rq *UNUSED(rq), task_t *UNUSED(task)) {
+}
+
+static void task_tick_idle(struct rq *UNUSED(rq), task_t *UNUSED(task)) {
+}
+
+static void task_fork_idle(task_t *UNUSED(task)) {
+}
+
+static void reweight_task_idle(struct rq *UNUSED(rq), task_t *UNUSED(task), int UNUSED(nice)) {
+}
+
+// Anything becoming runnable preempts the idle task when it wakes up, so there is no slice to end.
+static uint64_t time_slice_left_idle(struct rq *UNUSED(rq), task_t *UNUSED(task)) {
+	return UINT64_MAX;
+}
+
+// Each CPU has an idle task of its own, which never leaves it.
+static task_t *pick_migration_task_idle(struct rq *UNUSED(rq), struct rq *UNUSED(dst), bool UNUSED(force)) {
+	return NULL;
+}
+
+static void migrate_task_rq_idle(task_t *UNUSED(task), struct rq *UNUSED(src), struct rq *UNUSED(dst)) {
+	KPANIC("The idle task can not migrate!");
+}
+
+const struct sched_class idle_sched_class = {
+	.next = NULL,
+	.enqueue_task = enqueue_task_idle,
+	.dequeue_task = dequeue_task_idle,
+	.yield_task = yield_task_idle,
+	.check_preempt_curr = check_preempt_curr_idle,
+	.pick_next_task = pick_next_task_idle,
+	.put_prev_task = put_prev_task_idle,
+	.set_curr_task = set_curr_task_idle,
+	.task_tick = task_tick_idle,
+	.task_fork = task_fork_idle,
+	.reweight_task = reweight_task_idle,
+	.time_slice_left = time_slice_left_idle,
+	.pick_migration_task = pick_migration_task_idle,
+	.migrate_task_rq = migrate_task_rq_idle,
+};
@@ -0,0 +1,60 @@
+#include <include/sched/mutex.h>
+#include <include/kernel/logger.h>
+
+void mutex_init(mutex_t *mutex) {
+	mutex->owner = NULL;
+	wait_queue_init(&mutex->waiters);
+}
+
+void mutex_lock(mutex_t *mutex) {
+	uint32_t flags = spin_lock_irqsave(&mutex->waiters.lock);
+	task_t *self = task_current();
+
+	if (!mutex->owner) {
+		mutex->owner = self;
+	} else {
+		// The unlocker makes us the owner before waking us
+		while (mutex->owner != self) {
+			wait_queue_sleep(&mutex->waiters);
+		}
+	}
+
+	spin_unlock_irqrestore(&mutex->waiters.lock, flags);
+}
+
+bool mutex_trylock(mutex_t *mutex) {
+	uint32_t flags = spin_lock_irqsave(&mutex->waiters.lock);
+
+	bool acquired = !mutex->owner;
+	if (acquired) {
+		mutex->owner = task_current();
+	}
+
+	spin_unlock_irqrestore(&mutex->waiters.lock, flags);
+	return acquired;
+}
+
+void __mutex_unlock(mutex_t *mutex) {
+	spin_lock(&mutex->waiters.lock);
+
+	if (mutex->owner != task_current()) {
+		KPANIC("Mutex %x unlocked by task %d, but is owned by %x!", mutex, task_current()->id, mutex->owner);
+	}
+
+	// Hand the lock off to the next waiter, if there is one
+	wait_queue_entry_t *entry = TAILQ_FIRST(&mutex->waiters.waiters);
+	mutex->owner = entry ? entry->task : NULL;
+	if (entry) {
+		__wake_up_one(&mutex->waiters);
+	}
+
+	spin_unlock(&mutex->waiters.lock);
+}
+
+void mutex_unlock(mutex_t *mutex) {
+	uint32_t flags = irq_save();
+	__mutex_unlock(mutex);
+	irq_restore(flags);
+
+	sched_preempt();
+}
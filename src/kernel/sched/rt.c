@@ -0,0 +1,181 @@
+#include <include/sched/sched.h>
+#include <include/helpers.h>
+
+/*
+	The real-time class runs the highest priority runnable task, always before any fair task. Tasks
+	of the same priority run in the order they became runnable: SCHED_FIFO tasks keep the CPU until
+	they block or yield, while SCHED_RR tasks go to the back of the line after each slice. There is
+	no limit on how long real-time tasks may keep the CPU from everything else.
+*/
+
+static inline struct rt_queue *rt_queue_of(struct rq *rq, task_t *task) {
+	return &rq->rt.queues[task->rt_priority];
+}
+
+// Highest priority with a runnable task, or 0 if there are none.
+static int rt_highest_priority(struct rt_rq *rt_rq) {
+	for (int i = BITMAP_SIZE(RT_PRIO_MAX + 1) - 1; i >= 0; i--) {
+		if (rt_rq->bitmap[i]) {
+			return i * 32 + 31 - __builtin_clz(rt_rq->bitmap[i]);
+		}
+	}
+
+	return 0;
+}
+
+// Whether other tasks of the same priority are waiting behind the task.
+static bool rt_has_peers(struct rq *rq, task_t *task) {
+	return TAILQ_FIRST(rt_queue_of(rq, task)) != task || TAILQ_NEXT(task, rt_entry);
+}
+
+// Charges the current task for the time it has run since we last checked.
+static void update_curr_rt(struct rq *rq) {
+	task_t *curr = rq->curr;
+	if (!curr || curr->sched_class != &rt_sched_class) {
+		return;
+	}
+
+	uint64_t delta = rq->clock - curr->exec_start;
+	if ((int64_t) delta <= 0) {
+		return;
+	}
+
+	curr->exec_start = rq->clock;
+	curr->sum_exec_runtime += delta;
+}
+
+// Moves the task to the back of the queue for its priority.
+static void requeue_task_rt(struct rq *rq, task_t *task) {
+	struct rt_queue *queue = rt_queue_of(rq, task);
+	TAILQ_REMOVE(queue, task, rt_entry);
+	TAILQ_INSERT_TAIL(queue, task, rt_entry);
+}
+
+static void enqueue_task_rt(struct rq *rq, task_t *task, int UNUSED(flags)) {
+	struct rt_rq *rt_rq = &rq->rt;
+
+	TAILQ_INSERT_TAIL(rt_queue_of(rq, task), task, rt_entry);
+	BITMAP_SET(rt_rq->bitmap, task->rt_priority);
+
+	// For SCHED_RR, this marks the start of a fresh slice (see task_tick_rt)
+	task->prev_sum_exec_runtime = task->sum_exec_runtime;
+
+	rt_rq->nr_running++;
+	task->on_rq = true;
+}
+
+static void dequeue_task_rt(struct rq *rq, task_t *task) {
+	struct rt_rq *rt_rq = &rq->rt;
+	struct rt_queue *queue = rt_queue_of(rq, task);
+
+	update_curr_rt(rq);
+
+	TAILQ_REMOVE(queue, task, rt_entry);
+	if (TAILQ_EMPTY(queue)) {
+		BITMAP_CLEAR(rt_rq->bitmap, task->rt_priority);
+	}
+
+	rt_rq->nr_running--;
+	task->on_rq = false;
+}
+
+static void yield_task_rt(struct rq *rq) {
+	requeue_task_rt(rq, rq->curr);
+}
+
+// Only a higher priority preempts; equal priorities wait their turn.
+static void check_preempt_curr_rt(struct rq *rq, task_t *task) {
+	if (task->rt_priority > rq->curr->rt_priority) {
+		resched_curr(rq);
+	}
+}
+
+static task_t *pick_next_task_rt(struct rq *rq) {
+	int prio = rt_highest_priority(&rq->rt);
+	if (!prio) {
+		return NULL;
+	}
+
+	task_t *task = TAILQ_FIRST(&rq->rt.queues[prio]);
+	task->exec_start = rq->clock;
+	return task;
+}
+
+// The task stays queued while it runs, so there is nothing to put back.
+static void put_prev_task_rt(struct rq *rq, task_t *UNUSED(task)) {
+	update_curr_rt(rq);
+}
+
+static void set_curr_task_rt(struct rq *rq, task_t *task) {
+	task->exec_start = rq->clock;
+}
+
+static void task_tick_rt(struct rq *rq, task_t *curr) {
+	update_curr_rt(rq);
+
+	if (curr->policy != SCHED_RR) {
+		return;
+	}
+
+	if (curr->sum_exec_runtime - curr->prev_sum_exec_runtime < SCHED_RR_TIMESLICE) {
+		return;
+	}
+
+	// Slice is up, so let the next one of the same priority have a go, if there is one.
+	curr->prev_sum_exec_runtime = curr->sum_exec_runtime;
+	if (rt_has_peers(rq, curr)) {
+		requeue_task_rt(rq, curr);
+		resched_curr(rq);
+	}
+}
+
+static void task_fork_rt(task_t *UNUSED(task)) {
+}
+
+// Nice levels have no meaning here, but are kept for when the task goes back to the fair class.
+static void reweight_task_rt(struct rq *UNUSED(rq), task_t *task, int nice) {
+	task->nice = nice;
+}
+
+static uint64_t time_slice_left_rt(struct rq *rq, task_t *curr) {
+	if (curr->policy != SCHED_RR || !rt_has_peers(rq, curr)) {
+		return UINT64_MAX;
+	}
+
+	uint64_t delta_exec = curr->sum_exec_runtime - curr->prev_sum_exec_runtime;
+	return delta_exec < SCHED_RR_TIMESLICE ? SCHED_RR_TIMESLICE - delta_exec : 0;
+}
+
+// The highest priority tasks which are waiting gain the most from running elsewhere.
+static task_t *pick_migration_task_rt(struct rq *rq, struct rq *dst, bool force) {
+	for (int prio = RT_PRIO_MAX; prio >= RT_PRIO_MIN; prio--) {
+		task_t *task;
+		TAILQ_FOREACH(task, &rq->rt.queues[prio], rt_entry) {
+			if (can_migrate_task(rq, dst, task, force)) {
+				return task;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static void migrate_task_rq_rt(task_t *UNUSED(task), struct rq *UNUSED(src), struct rq *UNUSED(dst)) {
+}
+
+const struct sched_class rt_sched_class = {
+	.next = &fair_sched_class,
+	.enqueue_task = enqueue_task_rt,
+	.dequeue_task = dequeue_task_rt,
+	.yield_task = yield_task_rt,
+	.check_preempt_curr = check_preempt_curr_rt,
+	.pick_next_task = pick_next_task_rt,
+	.put_prev_task = put_prev_task_rt,
+	.set_curr_task = set_curr_task_rt,
+	.task_tick = task_tick_rt,
+	.task_fork = task_fork_rt,
+	.reweight_task = reweight_task_rt,
+	.time_slice_left = time_slice_left_rt,
+	.pick_migration_task = pick_migration_task_rt,
+	.migrate_task_rq = migrate_task_rq_rt,
+};
@@ -0,0 +1,42 @@
+#include <include/sched/semaphore.h>
+
+void sem_init(semaphore_t *sem, uint32_t count) {
+	sem->count = count;
+	wait_queue_init(&sem->waiters);
+}
+
+void sem_wait(semaphore_t *sem) {
+	uint32_t flags = spin_lock_irqsave(&sem->waiters.lock);
+
+	if (sem->count) {
+		sem->count--;
+	} else {
+		// Being woken means sem_post handed us its unit
+		wait_queue_sleep(&sem->waiters);
+	}
+
+	spin_unlock_irqrestore(&sem->waiters.lock, flags);
+}
+
+bool sem_trywait(semaphore_t *sem) {
+	uint32_t flags = spin_lock_irqsave(&sem->waiters.lock);
+
+	bool acquired = sem->count > 0;
+	if (acquired) {
+		sem->count--;
+	}
+
+	spin_unlock_irqrestore(&sem->waiters.lock, flags);
+	return acquired;
+}
+
+void sem_post(semaphore_t *sem) {
+	uint32_t flags = spin_lock_irqsave(&sem->waiters.lock);
+
+	if (!__wake_up_one(&sem->waiters)) {
+		sem->count++;
+	}
+
+	spin_unlock_irqrestore(&sem->waiters.lock, flags);
+	sched_preempt();
+}
@@ -1,41 +1,66 @@
 #include <include/sched/task.h>
+#include <include/sched/sched.h>
+#include <include/sched/preempt.h>
 #include <include/x86/idt.h>
+#include <include/x86/irqflags.h>
+#include <include/x86/cpu.h>
+#include <include/x86/smp.h>
+#include <include/x86/fpu.h>
 #include <include/mm/alloc.h>
 #include <include/helpers.h>
-#include <include/drivers/timer.h>
+#include <include/kernel/tick.h>
+#include <include/kernel/ktimer.h>
+#include <include/kernel/time.h>
 #include <include/kernel/mem.h>
 #include <include/kernel/logger.h>
+#include <include/kernel/spinlock.h>
+#include <include/kernel/trace.h>
+#include <include/kernel/workqueue.h>
 
 #include <string.h>
 
-#define DUMMY_EIP_STR "0x12345"
-#define DUMMY_EIP 0x12345
+// The highest priority scheduling class; the rest are reached by following sched_class->next.
+#define sched_class_highest (&dl_sched_class)
+#define for_each_class(class) for (class = sched_class_highest; class; class = class->next)
 
-const uint32_t TICKS_PER_SLICE = 50;
+#define cpu_rq(cpu) (&runqueues[(cpu)])
+#define this_rq() cpu_rq(smp_processor_id())
+
+// The task running on this CPU
+#define current (this_cpu()->current)
+
+#define task_allowed_on(task, cpu) ((task)->cpus_allowed & (1 << (cpu)))
+
+// A task which ran within this long (0.5ms) is assumed to still have a warm cache on its CPU.
+static const uint64_t sched_migration_cost = 500000ULL;
+// How often (100ms) the load of all CPUs is evened out, besides CPUs stealing work when they go idle.
+#define BALANCE_INTERVAL_MS 100
+// After failing to find anything to move this many times, tasks are moved even if cache hot.
+#define BALANCE_MAX_FAILED 3
 
 // Needed for determining the initial stack start offset, so we know how much to copy over.
 extern uint32_t STACK_START;
 
-// To correct an extremely fatal bug where GCC's inline assembly will automatically reuse
-// certain registers without caring if it has been assigned to, we use a dedicated assembly
-// procedure to handle task switching for us. The bug originally caused a 'mov' instruction
-// of the instruction pointer into the 'ecx' register to be reused in the 'mov' instruction
-// into the 'esp' (stack pointer). Since it assumed that the 'ecx' register was reserved, it
-// also stored the original stack pointer there as well, so our instruction pointer which overwrote
-// the original contents, was being pushed into 'esp'. In summary: It caused the stack to point
-// to the code segment (possible since we use a flat memory model), and subsequent stack operations
-// would unfortunately cause the instruction pointer to point to invalid instructions. Tragic...
-extern void perform_task_switch(uint32_t, uint32_t, uint32_t);
+// Saves the callee-saved registers of the current task onto its stack, stores its stack pointer
+// in 'prev_esp', and then restores the registers of the next task from 'next_esp' before returning
+// into it. Since the switch is an ordinary function call, whatever the caller was doing is resumed
+// exactly where it left off when the task is switched back to, which is what allows blocking from
+// any kernel code rather than just from inside of the timer interrupt handler.
+extern void switch_context(uint32_t *prev_esp, uint32_t next_esp);
 
-// Assembly function to return the current instruction pointer. The instruction pointer is used
-// to jump to when we clone our current task/process, so we effectively 'return twice'.
-extern uint32_t read_eip();
 
-
-// The list of tasks. Since we are currently a uniprocessor system, there is no need to worry
-// about concurrent access, however, all accesses to it should disable interrupts.
+/*
+	The list of all tasks, runnable or not. Which tasks are runnable is tracked separately by
+	each scheduling class in the run queue of the CPU the task belongs to. Each run queue has a
+	lock of its own, which must be held (with interrupts disabled) to touch it or any of its tasks'
+	scheduling state. Where more than one is needed, tasks_lock is taken before any run queue lock.
+*/
 static LIST_HEAD(task_queue, task) tasks = LIST_HEAD_INITIALIZER(tasks);
-static volatile task_t *current;
+static spinlock_t tasks_lock = SPINLOCK_INITIALIZER;
+static struct rq runqueues[MAX_CPUS];
+
+// Identifiers handed out to new tasks
+static size_t next_id;
 
 // Moves the kernel's stack to a larger one (4KB -> 4MB).
 // All slots in the stack are scanned to determine if they are
@@ -43,15 +68,75 @@ static volatile task_t *current;
 // all frame pointers are corrected.
 static uint32_t move_stack();
 
-// Clones the parent's stack for the child task, ensuring that it can start in a safe
-// and consistent state. All slots in the stack are scanned to determine if they are
-// pointers to the other's stack, and are redirected to the new one. This is so that
-// all frame pointers are corrected.
-static void copy_stack(task_t *child, task_t *parent);
+// Selects the next task to run and switches to it. Must be called with interrupts disabled,
+// and returns (with interrupts still disabled) once the calling task is switched back to.
+static void schedule();
+
+// Same as schedule, but entered with the lock of the run queue already held. It is released
+// before returning.
+static void __schedule(struct rq *rq);
+
+// Releases the run queue lock held across a task switch, from the side of the next task.
+static void finish_task_switch();
+
+// Runs the idle task of this CPU, which must already be current. Never returns.
+static void idle_loop();
+
+// Locks the run queue of the CPU which the task belongs to, disabling interrupts.
+static struct rq *task_rq_lock(task_t *task, uint32_t *flags);
+
+// Picks the CPU which the task should be placed on.
+static uint32_t select_task_cpu(task_t *task);
+
+// Locks two run queues at once, always in the same order to avoid deadlock. Interrupts must be disabled.
+static void double_rq_lock(struct rq *rq1, struct rq *rq2);
+
+static void double_rq_unlock(struct rq *rq1, struct rq *rq2);
+
+// Moves a task which is not running from the run queue of one CPU to another. Both must be locked.
+static void move_task(struct rq *src, struct rq *dst, task_t *task);
+
+// Moves a runnable task which is on no run queue at all onto one of a CPU it is allowed to run on,
+// enqueueing it with the given flags (ENQUEUE_WAKEUP if it has just been woken).
+static void push_task(task_t *task, int enqueue_flags);
+
+// Moves up to 'count' tasks from 'src' to 'dst', both of which are locked, returning how many were moved.
+static uint32_t move_tasks(struct rq *src, struct rq *dst, uint32_t count);
+
+// Steals a task from the busiest CPU for this one, which is about to go idle. Returns whether one was found.
+static bool idle_balance(struct rq *rq);
+
+// Evens out the number of runnable tasks between the busiest and the least busy CPU.
+static void rebalance();
 
-// Makes use of an interrupt handler trick, where we manipulate the registers pushed
-// on the stack to trick the CPU into jumping into the next process.
-static void task_switch(regs_t *regs);
+// Wakes up an idle CPU, if there is one, to take some of the work off of the busy run queue.
+static void kick_idle_cpu(struct rq *busy);
+
+// Adds or removes a task from the run queue through its class, keeping count of runnable tasks.
+static void enqueue_task(struct rq *rq, task_t *task, int flags);
+
+static void dequeue_task(struct rq *rq, task_t *task);
+
+// Asks each scheduling class, in order of priority, for the next task to run.
+static task_t *pick_next_task(struct rq *rq);
+
+// Timer interrupt handler, which charges the current task for its time and preempts it if needed.
+static void sched_tick(regs_t *regs);
+
+// Advances the scheduler clock to the current time.
+static void update_rq_clock(struct rq *rq);
+
+// Checks whether a newly runnable task should preempt the current one.
+static void check_preempt_curr(struct rq *rq, task_t *task);
+
+// Updates the accounting of the tasks being switched between.
+static void account_switch(struct rq *rq, task_t *prev, task_t *next, bool preempted);
+
+// Adds the delay, in nanoseconds, to the histogram.
+static void histogram_add(struct sched_histogram *hist, uint64_t delay);
+
+// Where new threads begin execution, the first time they are switched to.
+static void thread_start();
 
 // Helper to create a new task structure
 static task_t *task_new();
@@ -61,167 +146,887 @@ void task_init() {
     uint32_t stack = move_stack();
     KTRACE("Moved stack successfully...");
 
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        struct rq *rq = cpu_rq(cpu);
+        spin_lock_init(&rq->lock);
+        rq->cpu = cpu;
+
+        for (uint32_t prio = 0; prio <= RT_PRIO_MAX; prio++) {
+            TAILQ_INIT(&rq->rt.queues[prio]);
+        }
+        RB_INIT(&rq->dl.tasks_timeline);
+        LIST_INIT(&rq->dl.throttled);
+    }
+
 	// Create process of ourselves
-	task_t *task = kmalloc(sizeof(task_t));
-    memset(task, 0, sizeof(*task));
+	task_t *task = task_new();
 	task->stack_start = stack;
-    task->ticks = TICKS_PER_SLICE;
 	
     LIST_INSERT_HEAD(&tasks, task, next_task);
-    current = task;
+
+    // We are already running, so we become the current task of the run queue right away.
+    struct rq *rq = this_rq();
+    task->cpu = rq->cpu;
+    enqueue_task(rq, task, 0);
+    current = rq->curr = pick_next_task(rq);
 
 	KTRACE("Stack Start: %x", task->stack_start);
 
-	timer_set_handler(1000, task_switch);
-    register_interrupt_handler(IRQ_YIELD, task_switch);
+	tick_add_handler(sched_tick);
 	KTRACE("Multitasking initialized...");
 }
 
-// TODO: Don't bother copying thread stack and just initialize a new one.
-void thread_create(void (*task)(void *args), void *args) {
-	KTRACE("Forking...");
-	// Ensure we are not interrupted
-	asm volatile("cli");
+task_t *thread_create(void (*task)(void *args), void *args) {
+	KTRACE("Creating thread...");
 
-	// Allocate a new process
+	// Allocate a new process along with a fresh stack.
     task_t *child = task_new();
-    task_t *parent = current;
-    child->id = parent->id + 1;
-    
-    // Copy from parent
-    copy_stack(child, parent);
-    KTRACE("Copied stacks...");
-    
-    // Append to queue
-    LIST_INSERT_AFTER(parent, child, next_task);
-    KTRACE("Added child to queue...");
-    
-    uint32_t eip = read_eip();
-    
-    // If we are the parent, setup esp/ebp/eip for child
-    if (current == parent) {
-    	KTRACE("Parent setting up child...");
-        uint32_t esp, ebp;
-        asm volatile ("mov %%esp, %0" : "=r" (esp));
-        asm volatile ("mov %%ebp, %0" : "=r" (ebp));
-        
-        uint32_t offset = child->stack_start - parent->stack_start;
-
-        child->esp = offset + esp;
-        child->ebp = offset + ebp;
-        child->eip = eip;
-
-        KTRACE("Child Process Configured: eip: %x, esp: %x, ebp: %x", child->eip, child->esp, child->ebp);
-        
-        asm volatile ("sti");
+    child->stack_start = alloc_block();
+    child->entry = task;
+    child->args = args;
+
+    // Build the frame which switch_context will pop off the stack when we are first switched to:
+    // The callee-saved registers, followed by the address to 'return' to. The frame pointer
+    // is zeroed to signify the end of a stack trace.
+    uint32_t *stack = (uint32_t *) (child->stack_start + PAGE_SIZE);
+    *--stack = 0;                          // Return address of thread_start (never returns)
+    *--stack = (uint32_t) thread_start;    // Return address of switch_context
+    *--stack = 0;                          // ebp
+    *--stack = 0;                          // ebx
+    *--stack = 0;                          // esi
+    *--stack = 0;                          // edi
+    child->esp = (uint32_t) stack;
+
+    KTRACE("Child Process Configured: entry: %x, esp: %x", child->entry, child->esp);
+
+	// Ensure we are not interrupted
+    uint32_t flags = spin_lock_irqsave(&tasks_lock);
+    LIST_INSERT_HEAD(&tasks, child, next_task);
+    spin_unlock(&tasks_lock);
+
+    child->cpu = select_task_cpu(child);
+    struct rq *rq = cpu_rq(child->cpu);
+    spin_lock(&rq->lock);
+    update_rq_clock(rq);
+    enqueue_task(rq, child, ENQUEUE_NEW);
+    check_preempt_curr(rq, child);
+    spin_unlock(&rq->lock);
+
+    kick_idle_cpu(rq);
+    irq_restore(flags);
+
+    KTRACE("Added child to run queue...");
+    return child;
+}
+
+void task_set_nice(task_t *task, int nice) {
+    nice = MAX(NICE_MIN, MIN(NICE_MAX, nice));
+
+    uint32_t flags;
+    struct rq *rq = task_rq_lock(task, &flags);
+    update_rq_clock(rq);
+    task->sched_class->reweight_task(rq, task, nice);
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+bool sched_setattr(task_t *task, const struct sched_attr *attr) {
+    const struct sched_class *class;
+    switch (attr->policy) {
+        case SCHED_NORMAL:
+            class = &fair_sched_class;
+            break;
+        case SCHED_FIFO:
+        case SCHED_RR:
+            if (attr->priority < RT_PRIO_MIN || attr->priority > RT_PRIO_MAX) {
+                return false;
+            }
+            class = &rt_sched_class;
+            break;
+        case SCHED_DEADLINE:
+            class = &dl_sched_class;
+            break;
+        default:
+            return false;
+    }
+
+    uint32_t flags;
+    struct rq *rq = task_rq_lock(task, &flags);
+
+    // The idle task is only ever picked when there is nothing else, and must stay that way.
+    if (task == rq->idle || !dl_admit(rq, task, attr)) {
+        spin_unlock_irqrestore(&rq->lock, flags);
+        return false;
+    }
+
+    // Take the task out of its old class entirely, and put it back in the new one.
+    update_rq_clock(rq);
+    bool queued = task->on_rq;
+    bool running = rq->curr == task;
+    if (queued) {
+        dequeue_task(rq, task);
+    }
+    if (running) {
+        task->sched_class->put_prev_task(rq, task);
+    }
+
+    task->policy = attr->policy;
+    task->rt_priority = class == &rt_sched_class ? attr->priority : 0;
+    if (class == &dl_sched_class) {
+        task->dl_runtime = attr->runtime;
+        task->dl_deadline = attr->deadline ? attr->deadline : attr->period;
+        task->dl_period = attr->period;
+
+        // Starts its first period once enqueued (see update_dl_entity)
+        task->deadline = rq->clock;
+        task->runtime = 0;
+    }
+    task->sched_class = class;
+    class->reweight_task(rq, task, MAX(NICE_MIN, MIN(NICE_MAX, attr->nice)));
+
+    if (queued) {
+        enqueue_task(rq, task, ENQUEUE_WAKEUP);
+    }
+    if (running) {
+        class->set_curr_task(rq, task);
+
+        // It may no longer be the one which should be running
+        resched_curr(rq);
+    } else if (queued) {
+        check_preempt_curr(rq, task);
+    }
+
+    spin_unlock_irqrestore(&rq->lock, flags);
+    sched_preempt();
+    return true;
+}
+
+bool thread_set_affinity(task_t *task, uint32_t mask) {
+    bool online = false;
+    struct cpu *cpu;
+    for_each_online_cpu(cpu) {
+        online |= (mask & (1 << cpu->id)) != 0;
+    }
+
+    if (!online) {
+        return false;
+    }
+
+    uint32_t flags;
+    struct rq *rq = task_rq_lock(task, &flags);
+    task->cpus_allowed = mask;
+
+    if (task_allowed_on(task, rq->cpu)) {
+        spin_unlock_irqrestore(&rq->lock, flags);
+        return true;
+    }
+
+    if (rq->curr == task) {
+        // It moves itself once switched out (see __schedule)
+        resched_curr(rq);
+        spin_unlock(&rq->lock);
+    } else if (task->on_rq) {
+        spin_unlock(&rq->lock);
+
+        struct rq *dst = cpu_rq(select_task_cpu(task));
+        double_rq_lock(rq, dst);
+
+        // It may have started running, or been moved, while nothing was locked.
+        if (task->on_rq && task->cpu == rq->cpu && rq->curr != task) {
+            move_task(rq, dst, task);
+        }
+
+        double_rq_unlock(rq, dst);
+    } else if (task->state == TASK_BLOCKED) {
+        // It is moved when woken up (see task_wake)
+        spin_unlock(&rq->lock);
     } else {
-    	asm volatile ("sti");
-        // Inside of child, so execute the thread. If we exit early, it is an error as we do not have a way to handle this.
-    	task(args);
+        // Already on its way to another CPU (see push_task), which will respect the new mask.
+        spin_unlock(&rq->lock);
+    }
+
+    irq_restore(flags);
+    sched_preempt();
+    return true;
+}
+
+bool sched_get_cpu_stats(uint32_t cpu, struct sched_cpu_stats *stats) {
+    if (cpu >= nr_cpus || !cpus[cpu].online) {
+        return false;
+    }
+
+    struct rq *rq = cpu_rq(cpu);
+    uint32_t flags = spin_lock_irqsave(&rq->lock);
+    stats->nr_running = rq->nr_running;
+    stats->nr_switches = rq->nr_switches;
+    stats->nr_migrations = rq->nr_migrations;
+    spin_unlock_irqrestore(&rq->lock, flags);
+
+    return true;
+}
+
+// Snapshots the accounting of the task, with its run queue locked so that the counts agree.
+void sched_get_task_stats(task_t *task, struct sched_task_stats *stats) {
+    uint32_t flags;
+    struct rq *rq = task_rq_lock(task, &flags);
+    stats->runtime = task->sum_exec_runtime;
+    stats->nvcsw = task->nvcsw;
+    stats->nivcsw = task->nivcsw;
+    stats->nr_waits = task->nr_waits;
+    stats->wait_sum = task->wait_sum;
+    stats->wait_max = task->wait_max;
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+// Adds the counts of one histogram to another
+static void histogram_merge(struct sched_histogram *dst, struct sched_histogram *src) {
+    for (uint32_t i = 0; i < SCHED_HIST_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+    dst->count += src->count;
+    dst->max = MAX(dst->max, src->max);
+}
+
+void sched_get_histograms(struct sched_histogram *wakeup_latency, struct sched_histogram *run_length) {
+    memset(wakeup_latency, 0, sizeof(*wakeup_latency));
+    memset(run_length, 0, sizeof(*run_length));
 
-    	KPANIC("Thread returned early! Currently no implemented way to return allocated stack!");
+    struct cpu *cpu;
+    for_each_online_cpu(cpu) {
+        struct rq *rq = cpu_rq(cpu->id);
+        uint32_t flags = spin_lock_irqsave(&rq->lock);
+        histogram_merge(wakeup_latency, &rq->wakeup_latency);
+        histogram_merge(run_length, &rq->run_length);
+        spin_unlock_irqrestore(&rq->lock, flags);
+    }
+}
+
+void sched_reset_histograms() {
+    struct cpu *cpu;
+    for_each_online_cpu(cpu) {
+        struct rq *rq = cpu_rq(cpu->id);
+        uint32_t flags = spin_lock_irqsave(&rq->lock);
+        memset(&rq->wakeup_latency, 0, sizeof(rq->wakeup_latency));
+        memset(&rq->run_length, 0, sizeof(rq->run_length));
+        spin_unlock_irqrestore(&rq->lock, flags);
     }
 }
 
 // Yield the CPU to the scheduler.
 void yield() {
-    // Give up our time slice...
+    uint32_t flags = irq_save();
+    struct rq *rq = this_rq();
+    spin_lock(&rq->lock);
+    update_rq_clock(rq);
+    current->sched_class->yield_task(rq);
+    __schedule(rq);
+    irq_restore(flags);
+}
+
+task_t *task_current() {
+    return (task_t *) current;
+}
+
+void task_prepare_block() {
+    current->state = TASK_BLOCKED;
+}
+
+void task_block() {
+    task_t *curr = (task_t *) current;
+    struct rq *rq = this_rq();
+
+    spin_lock(&rq->lock);
+
+    // Already woken up since task_prepare_block, so there is no need to go to sleep.
+    if (curr->state != TASK_BLOCKED) {
+        spin_unlock(&rq->lock);
+        return;
+    }
+
+    update_rq_clock(rq);
+    dequeue_task(rq, curr);
+    __schedule(rq);
+}
+
+bool task_wake(task_t *task) {
+    uint32_t flags;
+    struct rq *rq = task_rq_lock(task, &flags);
+    if (task->state != TASK_BLOCKED) {
+        spin_unlock_irqrestore(&rq->lock, flags);
+        return false;
+    }
+
+    task->state = TASK_RUNNING;
+
+    // The task may not have gotten around to leaving the run queue yet, in which case it
+    // will see that it was woken and keep running instead.
+    if (!task->on_rq) {
+        // Its affinity was changed while it was asleep
+        if (!task_allowed_on(task, rq->cpu)) {
+            spin_unlock(&rq->lock);
+            push_task(task, ENQUEUE_WAKEUP);
+            tick_nohz_update();
+            irq_restore(flags);
+            return true;
+        }
+
+        update_rq_clock(rq);
+        enqueue_task(rq, task, ENQUEUE_WAKEUP);
+
+        // Let the woken task run right away if it deserves to
+        check_preempt_curr(rq, task);
+    }
+
+    spin_unlock(&rq->lock);
+    kick_idle_cpu(rq);
+
+    // With another task to share the CPU with, the current one now has a slice to run out.
+    tick_nohz_update();
+
+    irq_restore(flags);
+    return true;
+}
+
+void sched_preempt() {
+    if (in_interrupt() || preempt_count()) {
+        return;
+    }
+
+    uint32_t flags = irq_save();
+    if (this_rq()->need_resched) {
+        schedule();
+    }
+    irq_restore(flags);
+}
+
+uint64_t sched_clock() {
+    return this_rq()->clock;
+}
+
+/*
+	Each CPU has a tick of its own, so this is only the soonest deadline of this CPU's run queue.
+	Called by tick_nohz_update with interrupts disabled, which is why the lock is taken as is.
+*/
+uint32_t sched_next_event() {
+    uint64_t left = UINT64_MAX;
+    struct rq *rq = this_rq();
+    spin_lock(&rq->lock);
+
+    // Still booting, so there is nothing to preempt.
+    task_t *curr = rq->curr;
+    if (curr) {
+        update_rq_clock(rq);
+        left = MIN(left, curr->sched_class->time_slice_left(rq, curr));
+
+        // Throttled deadline tasks are let back in from the tick (see sched_tick)
+        left = MIN(left, dl_next_replenish(rq));
+    }
+
+    spin_unlock(&rq->lock);
+
+    if (left == UINT64_MAX) {
+        return UINT32_MAX;
+    }
+
+    left = MIN(left, (uint64_t) (UINT32_MAX - NSEC_PER_TICK));
+    return CEILING((uint32_t) left, (uint32_t) NSEC_PER_TICK);
+}
+
+void task_idle() {
+    struct rq *rq = this_rq();
+    task_t *self = (task_t *) current;
+
+    // Leave our scheduling class for good. As we are still its current task, it must also be
+    // told that we are being switched out.
     asm volatile ("cli");
-    current->ticks = 0;
-    asm volatile ("sti");
+    spin_lock(&rq->lock);
+    update_rq_clock(rq);
+    dequeue_task(rq, self);
+    self->sched_class->put_prev_task(rq, self);
+    self->sched_class = &idle_sched_class;
+    rq->idle = self;
+    spin_unlock(&rq->lock);
+
+    KTRACE("Task %d is now the idle task...", self->id);
+    idle_loop();
+}
+
+void sched_init_ap(uint32_t stack) {
+    struct rq *rq = this_rq();
+
+    // Whatever we are running on now becomes our idle task. It is never enqueued, as it is not
+    // picked like the others are.
+    task_t *task = task_new();
+    task->stack_start = stack;
+    task->cpu = rq->cpu;
+    task->sched_class = &idle_sched_class;
+
+    spin_lock(&tasks_lock);
+    LIST_INSERT_HEAD(&tasks, task, next_task);
+    spin_unlock(&tasks_lock);
+
+    spin_lock(&rq->lock);
+    rq->idle = rq->curr = task;
+    current = task;
+    spin_unlock(&rq->lock);
 
-    // To end our time slice, we raise our own interrupt so that
-    // we cal safely reuse task_switch for yielding
-    asm volatile ("INT $255");
+    KTRACE("CPU %d: Task %d is now the idle task...", rq->cpu, task->id);
+    idle_loop();
+}
+
+void resched_curr(struct rq *rq) {
+    rq->need_resched = true;
+
+    // Another CPU must be told to check for itself
+    if (rq->cpu != smp_processor_id()) {
+        smp_send_reschedule(rq->cpu);
+    }
+}
+
+static void idle_loop() {
+    for (;;) {
+        schedule();
+
+        // Before going to sleep, look for work which another CPU has more than enough of.
+        if (idle_balance(this_rq())) {
+            continue;
+        }
+
+        // Nothing left to run, so stop the tick until the next timer is due and wait for an interrupt.
+        // As interrupts are only enabled once 'hlt' begins, a wakeup can not slip in between.
+        tick_nohz_update();
+        asm volatile ("sti; hlt; cli");
+    }
+}
+
+static struct rq *task_rq_lock(task_t *task, uint32_t *flags) {
+    *flags = irq_save();
+
+    // Tasks never change CPUs while their run queue is locked, so once the lock is ours the
+    // task must still belong to it.
+    for (;;) {
+        struct rq *rq = cpu_rq(task->cpu);
+        spin_lock(&rq->lock);
+        if (rq->cpu == task->cpu) {
+            return rq;
+        }
+        spin_unlock(&rq->lock);
+    }
+}
+
+/*
+	Picks the least busy CPU which the task may run on, out of those which are online and have gotten
+	as far as running their idle task. The CPU it was last on wins ties, as its cache may still be warm.
+	The run queues are not locked, as this is only a hint; the load balancer corrects any misplacement.
+*/
+static uint32_t select_task_cpu(task_t *task) {
+    struct rq *best = NULL;
+    struct cpu *cpu;
+
+    for_each_online_cpu(cpu) {
+        struct rq *rq = cpu_rq(cpu->id);
+        if (!rq->curr || !task_allowed_on(task, rq->cpu)) {
+            continue;
+        }
+
+        if (!best || rq->nr_running < best->nr_running || (rq->nr_running == best->nr_running && rq->cpu == task->cpu)) {
+            best = rq;
+        }
+    }
+
+    // Allowed nowhere which is online; thread_set_affinity makes sure of this not happening.
+    return best ? best->cpu : task->cpu;
+}
+
+static void double_rq_lock(struct rq *rq1, struct rq *rq2) {
+    if (rq1 == rq2) {
+        spin_lock(&rq1->lock);
+    } else if (rq1->cpu < rq2->cpu) {
+        spin_lock(&rq1->lock);
+        spin_lock(&rq2->lock);
+    } else {
+        spin_lock(&rq2->lock);
+        spin_lock(&rq1->lock);
+    }
+}
+
+static void double_rq_unlock(struct rq *rq1, struct rq *rq2) {
+    spin_unlock(&rq1->lock);
+    if (rq1 != rq2) {
+        spin_unlock(&rq2->lock);
+    }
+}
+
+bool can_migrate_task(struct rq *src, struct rq *dst, task_t *task, bool force) {
+    if (!task_allowed_on(task, dst->cpu) || src->curr == task) {
+        return false;
+    }
+
+    return force || src->clock - task->exec_start >= sched_migration_cost;
+}
+
+static void move_task(struct rq *src, struct rq *dst, task_t *task) {
+    bool queued = task->on_rq;
+    if (queued) {
+        dequeue_task(src, task);
+    }
+
+    task->sched_class->migrate_task_rq(task, src, dst);
+    task->cpu = dst->cpu;
+    task->nr_migrations++;
+    dst->nr_migrations++;
+
+    if (queued) {
+        update_rq_clock(dst);
+        enqueue_task(dst, task, 0);
+        check_preempt_curr(dst, task);
+    }
+}
+
+static void push_task(task_t *task, int enqueue_flags) {
+    uint32_t flags = irq_save();
+    struct rq *src = cpu_rq(task->cpu);
+    struct rq *dst = cpu_rq(select_task_cpu(task));
+
+    // Nobody else moves a task while it is in between run queues, so its CPU can not change under us.
+    double_rq_lock(src, dst);
+    move_task(src, dst, task);
+    update_rq_clock(dst);
+    enqueue_task(dst, task, enqueue_flags);
+    check_preempt_curr(dst, task);
+    double_rq_unlock(src, dst);
+
+    irq_restore(flags);
+}
+
+static uint32_t move_tasks(struct rq *src, struct rq *dst, uint32_t count) {
+    const struct sched_class *class;
+    bool force = dst->nr_balance_failed > BALANCE_MAX_FAILED;
+    uint32_t moved = 0;
+
+    update_rq_clock(src);
+    while (moved < count) {
+        task_t *task = NULL;
+        for_each_class(class) {
+            if ((task = class->pick_migration_task(src, dst, force))) {
+                break;
+            }
+        }
+
+        if (!task) {
+            break;
+        }
+
+        move_task(src, dst, task);
+        moved++;
+    }
+
+    dst->nr_balance_failed = moved ? 0 : dst->nr_balance_failed + 1;
+    return moved;
+}
+
+static bool idle_balance(struct rq *rq) {
+    struct rq *busiest = NULL;
+    struct cpu *cpu;
+
+    // Only a CPU with a task waiting behind the one it is running has anything to give.
+    for_each_online_cpu(cpu) {
+        struct rq *other = cpu_rq(cpu->id);
+        if (other != rq && other->nr_running > 1 && (!busiest || other->nr_running > busiest->nr_running)) {
+            busiest = other;
+        }
+    }
+
+    if (!busiest) {
+        return false;
+    }
+
+    double_rq_lock(rq, busiest);
+    uint32_t moved = 0;
+    if (busiest->nr_running > 1 && !rq->nr_running) {
+        moved = move_tasks(busiest, rq, 1);
+    }
+    double_rq_unlock(rq, busiest);
+
+    return moved > 0;
+}
+
+static void rebalance() {
+    struct rq *busiest = NULL, *idlest = NULL;
+    struct cpu *cpu;
+
+    for_each_online_cpu(cpu) {
+        struct rq *rq = cpu_rq(cpu->id);
+        if (!rq->curr) {
+            continue;
+        }
+
+        if (!busiest || rq->nr_running > busiest->nr_running) {
+            busiest = rq;
+        }
+        if (!idlest || rq->nr_running < idlest->nr_running) {
+            idlest = rq;
+        }
+    }
+
+    if (!busiest || busiest->nr_running < idlest->nr_running + 2) {
+        return;
+    }
+
+    double_rq_lock(busiest, idlest);
+    if (busiest->nr_running >= idlest->nr_running + 2) {
+        move_tasks(busiest, idlest, (busiest->nr_running - idlest->nr_running) / 2);
+    }
+    double_rq_unlock(busiest, idlest);
+}
+
+static void kick_idle_cpu(struct rq *busy) {
+    struct cpu *cpu;
+
+    if (busy->nr_running < 2) {
+        return;
+    }
+
+    for_each_online_cpu(cpu) {
+        struct rq *rq = cpu_rq(cpu->id);
+
+        // We will look for work ourselves on the way back to idling, if that is what we are doing.
+        if (rq->curr && rq->curr == rq->idle && !rq->nr_running) {
+            if (rq->cpu != smp_processor_id()) {
+                smp_send_reschedule(rq->cpu);
+            }
+            return;
+        }
+    }
+}
+
+static void enqueue_task(struct rq *rq, task_t *task, int flags) {
+    task->sched_class->enqueue_task(rq, task, flags);
+    rq->nr_running++;
+
+    // The current task of another CPU may now have a slice to run out, which its tick must know about.
+    tick_nohz_kick(rq->cpu);
+
+    // It waits from now until it is switched to. Tasks which are moved between CPUs keep waiting.
+    if (task != rq->curr && !task->wait_start) {
+        task->wait_start = rq->clock;
+        task->wait_woken = (flags & (ENQUEUE_WAKEUP)) != 0;
+    }
+}
+
+static void dequeue_task(struct rq *rq, task_t *task) {
+    task->sched_class->dequeue_task(rq, task);
+    rq->nr_running--;
 }
 
 static task_t *task_new() {
     task_t *task = kmalloc(sizeof(task_t));
     memset(task, 0, sizeof(task_t));
+    task->id = __atomic_fetch_add(&next_id, 1, __ATOMIC_RELAXED);
+    task->state = TASK_RUNNING;
+    task->cpus_allowed = CPU_MASK_ALL;
+
+    // All tasks start out in the fair class
+    task->sched_class = &fair_sched_class;
+    task->sched_class->task_fork(task);
+
     KTRACE("Created New Process...");
     return task;
 }
 
-static void task_switch(regs_t *UNUSED(regs)) {
-    // Check if our timeslice expired
-    if (current->ticks) {
-        current->ticks--;
+static void thread_start() {
+    // We were switched to from within schedule(), which always runs with interrupts disabled
+    // and the run queue locked.
+    finish_task_switch();
+    asm volatile ("sti");
+
+    // If we exit early, it is an error as we do not have a way to handle this.
+    current->entry(current->args);
+
+    KPANIC("Thread returned early! Currently no implemented way to return allocated stack!");
+}
+
+static void check_preempt_curr(struct rq *rq, task_t *task) {
+    const struct sched_class *class;
+    task_t *curr = rq->curr;
+
+    if (task->sched_class == curr->sched_class) {
+        curr->sched_class->check_preempt_curr(rq, task);
         return;
     }
 
-    // KTRACE("Preparing to task switch");
-    volatile task_t *curr = current;
+    // Tasks of a higher class always preempt those of a lower one.
+    for_each_class(class) {
+        if (class == curr->sched_class) {
+            break;
+        }
 
-    // Ensure we preserve our current state so we return here later.
-    // Information needing to be saved are the registers esp, ebp, and eip
-    uint32_t esp, ebp, eip;
-    
-    // The stack pointer and base pointer can readily be retrieved
-    // but the instruction pointer is a tough one. The instruction pointer
-    // MUST be of the instruction following 'read_eip'
-    asm volatile ("mov %%esp, %0" : "=r" (esp));
-    asm volatile ("mov %%ebp, %0" : "=r" (ebp));
-    eip = read_eip();
-
-    // If the instruction pointer is DUMMY_EIP, then we have just jumped here after switching
-    // to a new task. Note that the task itself would also have been inside of an interrupt handler, 
-    // which forces it to return to it's normal execution.
-    if (eip != DUMMY_EIP) {
-        // KTRACE("Preserving Current Process Info: pid: %x, eip: %x, esp: %x, ebp: %x", current->id, eip, esp, ebp);
-    } else {
-        // KTRACE("Child returned, continuing task...");
-        return;
+        if (class == task->sched_class) {
+            resched_curr(rq);
+            break;
+        }
+    }
+}
+
+static task_t *pick_next_task(struct rq *rq) {
+    const struct sched_class *class;
+    for_each_class(class) {
+        task_t *task = class->pick_next_task(rq);
+        if (task) {
+            return task;
+        }
+    }
+
+    KPANIC("No runnable tasks!");
+    return NULL;
+}
+
+/*
+	The actual switch is deferred until the interrupt handler returns (see sched_preempt). Every CPU
+	runs this from its own tick, for its own run queue only.
+*/
+static void sched_tick(regs_t *UNUSED(regs)) {
+    static volatile uint32_t next_balance;
+    struct rq *rq = this_rq();
+
+    // Each CPU has a tick of its own, which only looks after its own run queue.
+    spin_lock(&rq->lock);
+    task_t *curr = rq->curr;
+    if (curr) {
+        update_rq_clock(rq);
+        dl_replenish_throttled(rq);
+        curr->sched_class->task_tick(rq, curr);
     }
+    spin_unlock(&rq->lock);
 
-    // Select the next process
-    current = LIST_NEXT(current, next_task);
-    if (!current) {
-        current = LIST_FIRST(&tasks);
+    // Balancing looks at all CPUs at once, so only whichever tick gets there first does it.
+    uint32_t balance = next_balance;
+    if (time_after_eq(jiffies, balance) && __atomic_compare_exchange_n(&next_balance, &balance,
+            jiffies + msecs_to_jiffies(BALANCE_INTERVAL_MS), false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        rebalance();
     }
-    current->ticks = TICKS_PER_SLICE;
+}
+
+static void update_rq_clock(struct rq *rq) {
+    rq->clock = ktime_get_ns();
+}
+
+static void schedule() {
+    struct rq *rq = this_rq();
+    spin_lock(&rq->lock);
+    __schedule(rq);
+}
 
-    // Preserve the current task's progress.
-    curr->eip = eip;
-    curr->esp = esp;
-    curr->ebp = ebp;
+static void __schedule(struct rq *rq) {
+    task_t *prev = (task_t *) current;
+
+    // Whoever disabled preemption relies on staying on this CPU until they enable it again.
+    if (preempt_count()) {
+        KPANIC("Scheduling while atomic: Task %d, preempt_count %d", prev->id, preempt_count());
+    }
 
-    // Bugged? Need to initiate a function call or else a page fault occurs
-    // printf("");
-    // KTRACE("Task Switch: %d -> %d", curr->id, current->id);
-    // KTRACE("Jumping to new process... eip: %x, esp: %x, ebp: %x", current->eip, current->esp, current->ebp);
+    bool preempted = rq->need_resched;
+    rq->need_resched = false;
+    update_rq_clock(rq);
+
+    // No longer allowed to run here (see thread_set_affinity), so it is moved elsewhere once it has
+    // been switched out. Until then, it is runnable but on no run queue at all.
+    if (prev->on_rq && prev->state == TASK_RUNNING && !task_allowed_on(prev, rq->cpu)) {
+        dequeue_task(rq, prev);
+        rq->push_task = prev;
+    }
+
+    // Its pool may have to hand the rest of its work to another worker, which takes the lock of
+    // the pool, so it is only told once the switch is done.
+    if (prev->wq_worker && prev->state != TASK_RUNNING) {
+        rq->sleeping_worker = prev->wq_worker;
+    }
+
+    prev->sched_class->put_prev_task(rq, prev);
+    task_t *next = pick_next_task(rq);
+    current = rq->curr = next;
+
+    // Nothing better to run, so just continue where we left off
+    if (next != prev) {
+        rq->nr_switches++;
+        account_switch(rq, prev, next, preempted);
+        fpu_switch_out(prev);
+
+        trace_event(sched_switch, prev->id, next->id, prev->state);
+
+        // The lock stays held until the switch is complete, so that no other CPU can wake
+        // (and enqueue) the previous task before its registers have been saved.
+        switch_context(&prev->esp, next->esp);
+    }
 
-    // Jump to other task. The task's stack pointer and base pointer will accurately point to the
-    // task's previous position on the stack.
-    perform_task_switch(current->eip, current->ebp, current->esp);
+    finish_task_switch();
 }
 
-static void copy_stack(task_t *child, task_t *parent) {
-    KTRACE("Copying stack of %d at %x into %d...", parent->id, parent->stack_start, child->id);
+static void account_switch(struct rq *rq, task_t *prev, task_t *next, bool preempted) {
+    uint64_t now = rq->clock;
 
-    // Allocate a new page for the child's stack.
-    uint32_t new_stack = alloc_block();
-    KTRACE("Allocated block: %x", new_stack);
-    KTRACE("Copying stack from %x -> %x", parent->stack_start, new_stack);
+    // The idle task runs whenever there is nothing else, which says nothing about slices.
+    if (prev != rq->idle) {
+        histogram_add(&rq->run_length, now - prev->run_start);
 
-    uint32_t esp;  asm volatile ("mov %%esp, %0" : "=r" (esp));
-    uint32_t offset = new_stack + PAGE_SIZE - (parent->stack_start + PAGE_SIZE - esp) ;
+        // Still runnable, so it was either preempted or yielded, and now waits for its next turn.
+        if (prev->on_rq && prev->state == TASK_RUNNING) {
+            if (preempted) {
+                prev->nivcsw++;
+            } else {
+                prev->nvcsw++;
+            }
 
-    // Copy over stack from stack pointer up.
-    for (uint32_t addr = esp; addr < parent->stack_start + PAGE_SIZE; addr += 4, offset += 4) {
-        uint32_t *word = (uint32_t *) addr;
-        if (*word < (parent->stack_start + PAGE_SIZE) && *word > parent->stack_start) {
-            uint32_t diff = *word - parent->stack_start;
-            KTRACE("Redirecting Pointer in stack at %x with value %x -> %x", word, *word, new_stack + diff);
-            * (uint32_t *) offset = new_stack + diff; 
+            prev->wait_start = now;
+            prev->wait_woken = false;
         } else {
-            * (uint32_t *) offset = *word;
+            prev->nvcsw++;
+        }
+    }
+
+    if (next->wait_start) {
+        uint64_t delay = now - next->wait_start;
+        next->nr_waits++;
+        next->wait_sum += delay;
+        next->wait_max = MAX(next->wait_max, delay);
+
+        if (next->wait_woken) {
+            histogram_add(&rq->wakeup_latency, delay);
         }
+        next->wait_start = 0;
     }
 
-    KTRACE("Finished copying stack of %d", child->id);
-    child->stack_start = new_stack;
+    next->run_start = now;
 }
 
+static void histogram_add(struct sched_histogram *hist, uint64_t delay) {
+    // Roughly microseconds, without a 64-bit division
+    uint64_t usecs = delay >> 10;
+    uint32_t bucket = usecs ? 64 - (uint32_t) __builtin_clzll(usecs) : 0;
+
+    hist->buckets[MIN(bucket, SCHED_HIST_BUCKETS - 1)]++;
+    hist->count++;
+    hist->max = MAX(hist->max, delay);
+}
+
+static void finish_task_switch() {
+    struct rq *rq = this_rq();
+    task_t *push = rq->push_task;
+    struct worker *worker = rq->sleeping_worker;
+    rq->push_task = NULL;
+    rq->sleeping_worker = NULL;
+    spin_unlock(&rq->lock);
+
+    if (push) {
+        push_task(push, 0);
+    }
+
+    if (worker) {
+        wq_worker_sleeping(worker);
+    }
+
+    // The next task, or the same one with a fresh slice, may need the tick at a different time.
+    tick_nohz_update();
+}
 
 static uint32_t move_stack() {
     // The stack reserved for the kernel is exactly a page size (4MB) after the first reserved page.
@@ -1,29 +1,27 @@
-global read_eip
-	read_eip:
-		; EAX is used as the return value for _cdecl
-		; The only value on the stack at this moment is
-		; the return address (instruction pointer)
-		pop eax
-		; Simulate a return (no ret required)
-		jmp eax
-
+; switch_context(uint32_t *prev_esp, uint32_t next_esp)
 ; Here we:
-; * Stop interrupts so we don't get interrupted.
-; * Temporarily put the new EIP location in ECX.
-; * Temporarily put the new page directory's physical address in EAX.
-; * Set the base and stack pointers
-; * Set the page directory
-; * Put a dummy value (0x12345) in EAX so that above we can recognize that we've just
-;   switched task.
-; * Restart interrupts. The STI instruction has a delay - it doesn't take effect until after
-;   the next instruction.
-; * Jump to the location in ECX (remember we put the new EIP in there).
-[GLOBAL perform_task_switch]
-perform_task_switch:
-     cli;
-     mov ecx, [esp+4]   ; EIP
-     mov ebp, [esp+8]  ; EBP
-     mov esp, [esp+12]  ; ESP
-     mov eax, 0x12345   ; magic number to detect a task switch
-     sti;
-     jmp ecx
\ No newline at end of file
+; * Push the callee-saved registers of the current task on its own stack. The caller-saved
+;   registers (EAX, ECX, EDX) have already been saved by the compiler if they were needed.
+; * Save the resulting stack pointer into prev_esp.
+; * Switch to the next task's stack.
+; * Pop the next task's callee-saved registers, which it pushed when it was last switched out
+;   (or which were set up by thread_create for a brand new thread).
+; * Return, which lands wherever the next task called switch_context from.
+; Interrupts must be disabled for the duration, which is the caller's responsibility.
+[GLOBAL switch_context]
+switch_context:
+	mov eax, [esp + 4]	; prev_esp
+	mov edx, [esp + 8]	; next_esp
+
+	push ebp
+	push ebx
+	push esi
+	push edi
+	mov [eax], esp
+
+	mov esp, edx
+	pop edi
+	pop esi
+	pop ebx
+	pop ebp
+	ret
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include <include/sched/wait.h>
+#include <include/x86/irqflags.h>
+#include <include/kernel/ktimer.h>
+
+// State shared with the timer which ends a wait_queue_sleep_until early.
+struct wait_timeout {
+	wait_queue_t *wq;
+	wait_queue_entry_t *entry;
+	bool expired;
+};
+
+void wait_queue_init(wait_queue_t *wq) {
+	spin_lock_init(&wq->lock);
+	TAILQ_INIT(&wq->waiters);
+}
+
+bool wait_queue_empty(wait_queue_t *wq) {
+	return TAILQ_EMPTY(&wq->waiters);
+}
+
+void wait_queue_add(wait_queue_t *wq, wait_queue_entry_t *entry) {
+	entry->task = task_current();
+	entry->woken = false;
+	TAILQ_INSERT_TAIL(&wq->waiters, entry, next);
+}
+
+void wait_queue_block(wait_queue_t *wq, wait_queue_entry_t *entry) {
+	// Guard against being made runnable for some reason other than our wakeup.
+	while (!entry->woken) {
+		// Wakers hold the lock, so they can not have seen us yet, and wake us even if we have
+		// not quite blocked by the time they do.
+		task_prepare_block();
+		spin_unlock(&wq->lock);
+		task_block();
+		spin_lock(&wq->lock);
+	}
+}
+
+void wait_queue_sleep(wait_queue_t *wq) {
+	wait_queue_entry_t entry;
+	wait_queue_add(wq, &entry);
+	wait_queue_block(wq, &entry);
+}
+
+static task_t *wake_entry(wait_queue_t *wq, wait_queue_entry_t *entry);
+
+static void wait_timeout_expired(void *data) {
+	struct wait_timeout *timeout = data;
+	uint32_t flags = spin_lock_irqsave(&timeout->wq->lock);
+
+	// If we were woken normally in the meantime, the entry is no longer on the queue.
+	if (!timeout->entry->woken) {
+		timeout->expired = true;
+		wake_entry(timeout->wq, timeout->entry);
+	}
+
+	spin_unlock_irqrestore(&timeout->wq->lock, flags);
+}
+
+bool wait_queue_sleep_until(wait_queue_t *wq, uint32_t deadline) {
+	wait_queue_entry_t entry;
+	struct wait_timeout timeout = { wq, &entry, false };
+
+	ktimer_t timer;
+	ktimer_setup(&timer, wait_timeout_expired, &timeout);
+
+	wait_queue_add(wq, &entry);
+	ktimer_start_at(&timer, deadline);
+	wait_queue_block(wq, &entry);
+
+	// The timeout may be running on another CPU, and must be done with our stack before we return.
+	// It needs the lock to finish.
+	spin_unlock(&wq->lock);
+	ktimer_cancel_sync(&timer);
+	spin_lock(&wq->lock);
+
+	return !timeout.expired;
+}
+
+// Removes the entry from the queue and makes its task runnable. The entry may be gone as soon
+// as the task runs, so it must not be touched afterwards.
+static task_t *wake_entry(wait_queue_t *wq, wait_queue_entry_t *entry) {
+	task_t *task = entry->task;
+
+	TAILQ_REMOVE(&wq->waiters, entry, next);
+	entry->woken = true;
+	task_wake(task);
+
+	return task;
+}
+
+task_t *__wake_up_one(wait_queue_t *wq) {
+	wait_queue_entry_t *entry = TAILQ_FIRST(&wq->waiters);
+	return entry ? wake_entry(wq, entry) : NULL;
+}
+
+uint32_t __wake_up_all(wait_queue_t *wq) {
+	uint32_t woken = 0;
+	wait_queue_entry_t *entry;
+	while ((entry = TAILQ_FIRST(&wq->waiters))) {
+		wake_entry(wq, entry);
+		woken++;
+	}
+
+	return woken;
+}
+
+task_t *wake_up_one(wait_queue_t *wq) {
+	uint32_t flags = spin_lock_irqsave(&wq->lock);
+	task_t *task = __wake_up_one(wq);
+	spin_unlock_irqrestore(&wq->lock, flags);
+	return task;
+}
+
+uint32_t wake_up_all(wait_queue_t *wq) {
+	uint32_t flags = spin_lock_irqsave(&wq->lock);
+	uint32_t woken = __wake_up_all(wq);
+	spin_unlock_irqrestore(&wq->lock, flags);
+	return woken;
+}
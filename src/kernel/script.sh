@@ -1,2 +1,3 @@
 #!/bin/sh
-nm $1 | grep " T " | awk '{ print $1" "$3 }' > $1.sym
+# Symbol file used to symbolize addresses (see profile.py): Every function, static ones included, by address.
+nm -n $1 | grep -i " t " | awk '{ print $1" "$3 }' > $1.sym
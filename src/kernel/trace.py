@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""
+Turns a trace written out over the serial port (see include/kernel/trace.h) into a timeline in the
+Trace Event format, which chrome://tracing and Perfetto (ui.perfetto.dev) open, with a track for each
+CPU. Tasks show up as the slices they ran for, interrupts as the time their handlers took, and every
+other event as an instant. With --text, the events are printed instead, one per line.
+
+	./trace.py serial.log > trace.json
+	./trace.py --text serial.log
+"""
+import argparse
+import json
+import struct
+
+# struct trace_record: time, id, cpu, task, args
+RECORD = struct.Struct("<QHHI4I")
+
+
+def read_trace(path):
+	"""Returns the tracepoints (id -> (name, format)) and records of the last trace in the log."""
+	tracepoints, records = {}, []
+	inside = False
+	with open(path, errors="replace") as f:
+		for line in f:
+			line = line.strip()
+			if line.startswith("trace: begin"):
+				inside = True
+				tracepoints, records = {}, []
+			elif line.startswith("trace: end"):
+				inside = False
+			elif inside and line.startswith("tp "):
+				fields = line.split(" ", 3)
+				tracepoints[int(fields[1])] = (fields[2], fields[3] if len(fields) > 3 else "")
+			elif inside and line.startswith("t "):
+				data = bytes.fromhex(line.split()[2])
+				if len(data) == RECORD.size:
+					records.append(RECORD.unpack(data))
+
+	records.sort(key=lambda record: record[0])
+	return tracepoints, records
+
+
+def describe(tracepoints, record):
+	time, tp, cpu, task, *args = record
+	name, fmt = tracepoints.get(tp, ("tp%d" % tp, ""))
+	try:
+		text = fmt % tuple(args[:fmt.count("%")])
+	except (TypeError, ValueError):
+		text = " ".join("%x" % arg for arg in args)
+	return name, text
+
+
+def timeline(tracepoints, records):
+	events = []
+	running = {}
+
+	for record in records:
+		time, tp, cpu, task, *args = record
+		name, text = describe(tracepoints, record)
+		us = time / 1000.0
+
+		if name == "sched_switch":
+			prev, nxt = args[0], args[1]
+			start = running.get(cpu)
+			if start is not None:
+				events.append({"name": "task %d" % prev, "ph": "X", "ts": start, "dur": us - start,
+					"pid": 0, "tid": cpu, "args": {"task": prev}})
+			running[cpu] = us
+		elif name == "irq_entry":
+			events.append({"name": "irq %x" % args[0], "ph": "B", "ts": us, "pid": 0, "tid": cpu})
+		elif name == "irq_exit":
+			events.append({"name": "irq %x" % args[0], "ph": "E", "ts": us, "pid": 0, "tid": cpu,
+				"args": {"handled": args[1]}})
+		else:
+			events.append({"name": name, "ph": "i", "s": "t", "ts": us, "pid": 0, "tid": cpu,
+				"args": {"task": task, "event": text}})
+
+	for cpu in sorted({record[2] for record in records}):
+		events.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": cpu, "args": {"name": "CPU %d" % cpu}})
+
+	return {"traceEvents": events, "displayTimeUnit": "ns"}
+
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+	parser.add_argument("--text", action="store_true", help="print the events instead of a timeline")
+	parser.add_argument("log")
+	args = parser.parse_args()
+
+	tracepoints, records = read_trace(args.log)
+
+	if args.text:
+		for record in records:
+			name, text = describe(tracepoints, record)
+			print("%14.6f CPU %d task %-4d %-14s %s" % (record[0] / 1e9, record[2], record[3], name, text))
+		return
+
+	print(json.dumps(timeline(tracepoints, records)))
+
+
+if __name__ == "__main__":
+	main()
@@ -2,6 +2,7 @@
 #include <include/x86/exceptions.h>
 #include <include/kernel/logger.h>
 #include <include/kernel/mem.h>
+#include <include/kernel/trace.h>
 #include <stdbool.h>
 
 static const uint32_t PRESENT = 0x1;
@@ -14,6 +15,7 @@ static void page_fault_handler(struct registers *r) {
 	// Address that triggered the page fault is located in register CR2
 	uint32_t fault_addr;
 	asm volatile ("mov %%cr2, %0" : "=r" (fault_addr));
+	trace_event(page_fault, fault_addr, r->eip, r->err_code);
 
 	const char *msg = NULL;
 	switch (r->err_code & (PRESENT | READ_WRITE | USER_MODE)) {
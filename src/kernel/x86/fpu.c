@@ -0,0 +1,161 @@
+#include <include/x86/fpu.h>
+#include <include/x86/cpu.h>
+#include <include/x86/idt.h>
+#include <include/x86/irqflags.h>
+#include <include/sched/preempt.h>
+#include <include/kernel/mem.h>
+#include <include/kernel/logger.h>
+#include <include/helpers.h>
+
+// Monitor coprocessor, emulate (no FPU), task switched, and native FPU error reporting
+#define CR0_MP 1u << 1
+#define CR0_EM 1u << 2
+#define CR0_TS 1u << 3
+#define CR0_NE 1u << 5
+
+// FXSAVE/FXRSTOR and SSE are supported, as are unmasked SSE exceptions
+#define CR4_OSFXSR 1 << 9
+#define CR4_OSXMMEXCPT 1 << 10
+
+// All SSE exceptions masked, rounding to nearest; the same as at reset.
+#define MXCSR_DEFAULT 0x1F80
+
+#define FXSAVE_SIZE 512
+#define FXSAVE_ALIGN 16
+
+// Device Not Available: Raised on the first FPU instruction after CR0.TS was set.
+#define DEVICE_NOT_AVAILABLE 7
+
+static bool fpu_supported;
+
+static inline uint32_t read_cr0() {
+	uint32_t cr0;
+	asm volatile ("mov %%cr0, %0" : "=r" (cr0));
+	return cr0;
+}
+
+static inline void write_cr0(uint32_t cr0) {
+	asm volatile ("mov %0, %%cr0" :: "r" (cr0) : "memory");
+}
+
+static inline void clts() {
+	asm volatile ("clts" ::: "memory");
+}
+
+static inline void stts() {
+	write_cr0(read_cr0() | (CR0_TS));
+}
+
+static inline void fxsave(void *area) {
+	asm volatile ("fxsave (%0)" :: "r" (area) : "memory");
+}
+
+static inline void fxrstor(void *area) {
+	asm volatile ("fxrstor (%0)" :: "r" (area) : "memory");
+}
+
+// kmalloc only guarantees 4 byte alignment, and tasks never go away, so the slack is simply wasted.
+static void *fpu_alloc() {
+	uintptr_t area = (uintptr_t) kmalloc(FXSAVE_SIZE + FXSAVE_ALIGN - 1);
+	return (void *) ((area + FXSAVE_ALIGN - 1) & ~(uintptr_t) (FXSAVE_ALIGN - 1));
+}
+
+/*
+	The current task wants the FPU. Whoever used it last on this CPU has already been saved (see
+	fpu_switch_out), so the registers are free to be loaded with the current task's, or with a
+	clean state if this is its first time.
+*/
+static void device_not_available(struct registers *UNUSED(regs)) {
+	if (!fpu_supported) {
+		KPANIC("FPU used, but FXSAVE and SSE are not supported!");
+	}
+
+	struct cpu *cpu = this_cpu();
+	task_t *curr = cpu->current;
+	clts();
+
+	if (!curr->fpu_state) {
+		curr->fpu_state = fpu_alloc();
+		uint32_t mxcsr = MXCSR_DEFAULT;
+		asm volatile ("fninit; ldmxcsr %0" :: "m" (mxcsr));
+	} else {
+		fxrstor(curr->fpu_state);
+	}
+
+	cpu->fpu_owner = curr;
+}
+
+void fpu_init_cpu() {
+	// Without FXSAVE there is no way to switch the registers, so leave them disabled altogether.
+	if (!fpu_supported) {
+		write_cr0(read_cr0() | (CR0_EM));
+		return;
+	}
+
+	write_cr0((read_cr0() & ~(CR0_EM)) | (CR0_MP) | (CR0_NE));
+
+	uint32_t cr4;
+	asm volatile ("mov %%cr4, %0" : "=r" (cr4));
+	cr4 |= (CR4_OSFXSR) | (CR4_OSXMMEXCPT);
+	asm volatile ("mov %0, %%cr4" :: "r" (cr4));
+
+	// No one owns the registers yet, so the first to use them traps.
+	asm volatile ("fninit");
+	stts();
+}
+
+void fpu_init() {
+	fpu_supported = cpu_has(CPUID_FEAT_EDX_FXSR) && cpu_has(CPUID_FEAT_EDX_SSE);
+	if (!fpu_supported) {
+		KWARNING("FXSAVE or SSE not supported, the FPU is disabled...");
+	}
+
+	register_interrupt_handler(DEVICE_NOT_AVAILABLE, device_not_available);
+	fpu_init_cpu();
+}
+
+void fpu_switch_out(task_t *prev) {
+	struct cpu *cpu = this_cpu();
+	if (cpu->fpu_owner == prev) {
+		fxsave(prev->fpu_state);
+		cpu->fpu_owner = NULL;
+		stts();
+	}
+}
+
+bool irq_fpu_usable() {
+	return !this_cpu()->in_kernel_fpu;
+}
+
+void kernel_fpu_begin() {
+	preempt_disable();
+	uint32_t flags = irq_save();
+	struct cpu *cpu = this_cpu();
+
+	if (cpu->in_kernel_fpu) {
+		KPANIC("kernel_fpu_begin: CPU %d is already using the FPU!", cpu->id);
+	}
+	cpu->in_kernel_fpu = true;
+
+	// The registers may belong to the task we interrupted, if this is an interrupt handler.
+	if (cpu->fpu_owner) {
+		fxsave(cpu->fpu_owner->fpu_state);
+		cpu->fpu_owner = NULL;
+	} else {
+		clts();
+	}
+
+	irq_restore(flags);
+}
+
+void kernel_fpu_end() {
+	uint32_t flags = irq_save();
+	struct cpu *cpu = this_cpu();
+
+	// As the owner was saved, the next task to use the registers has to trap to get them back.
+	stts();
+	cpu->in_kernel_fpu = false;
+
+	irq_restore(flags);
+	preempt_enable();
+}
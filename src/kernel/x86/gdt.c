@@ -1,17 +1,8 @@
 #include <include/x86/gdt.h>
+#include <include/x86/cpu.h>
 
 #include <stdint.h>
-
-/*
-	There are only three GDT entries we care about right now: The code and data segments, and the
-	null descriptor. The null descriptor is a mandatory entry that MUST be included (and the first)
-	in all of the entries.
-*/
-#define GDT_MAX_ENTRIES 3
-
-#define GDT_DESCRIPTOR_NULL 0
-#define GDT_DESCRIPTOR_CODE 1
-#define GDT_DESCRIPTOR_DATA 2
+#include <string.h>
 
 #define GDT_ADDRESS_MIN 0
 #define GDT_ADDRESS_MAX 0xFFFFF
@@ -19,23 +10,25 @@
 // Invoked from assembly
 extern void gdt_flush(uint32_t);
 
-static void gdt_set_gate(int32_t idx, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags);
+static void gdt_set_gate(struct gdt_entry *entries, int32_t idx, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags);
 
-static struct gdt_entry entries[GDT_MAX_ENTRIES];
-
-static struct gdt_ptr ptr;
 
+void gdt_init() {
+	gdt_init_cpu(&cpus[0]);
+}
 
+void gdt_init_cpu(struct cpu *cpu) {
+	struct gdt_entry *entries = cpu->gdt;
 
-void gdt_init() {
-	ptr.limit = (sizeof(struct gdt_entry) * GDT_MAX_ENTRIES) - 1;
-	ptr.base = (uint32_t) &entries;
+	cpu->gdt_ptr.limit = (sizeof(struct gdt_entry) * GDT_MAX_ENTRIES) - 1;
+	cpu->gdt_ptr.base = (uint32_t) entries;
+	cpu->self = cpu;
 
 	/*
 		The below sets up each descriptor accordingly. They maintain the following format...
 
 		gdt_set_gate(
-			[DESCRIPTOR], [ADDR_MIN], [ADDR_MAX],
+			[ENTRIES], [DESCRIPTOR], [ADDR_MIN], [ADDR_MAX],
 			[ACCESS_BITS],
 			[FLAGS_BITS]
 		);
@@ -43,26 +36,47 @@ void gdt_init() {
 		Where DESCRIPTOR is mapped directly to it's corresponding index.
 	*/
 	gdt_set_gate(
-		GDT_DESCRIPTOR_NULL, GDT_ADDRESS_MIN, GDT_ADDRESS_MIN,
+		entries, GDT_DESCRIPTOR_NULL, GDT_ADDRESS_MIN, GDT_ADDRESS_MIN,
 		GDT_ACCESS_NONE,
 		GDT_FLAGS_NONE
 	);
 	gdt_set_gate(
-		GDT_DESCRIPTOR_CODE, GDT_ADDRESS_MIN, GDT_ADDRESS_MAX,
+		entries, GDT_DESCRIPTOR_CODE, GDT_ADDRESS_MIN, GDT_ADDRESS_MAX,
 		GDT_ACCESS_RW | GDT_ACCESS_EXECUTABLE | GDT_ACCESS_PRIVILEDGE_RING_ZERO | GDT_ACCESS_PRESENT,
 		GDT_FLAGS_SIZE | GDT_FLAGS_GRANULARITY
 	);
 	gdt_set_gate(
-		GDT_DESCRIPTOR_DATA, GDT_ADDRESS_MIN, GDT_ADDRESS_MAX,
+		entries, GDT_DESCRIPTOR_DATA, GDT_ADDRESS_MIN, GDT_ADDRESS_MAX,
 		GDT_ACCESS_RW | GDT_ACCESS_PRIVILEDGE_RING_ZERO | GDT_ACCESS_PRESENT,
 		GDT_FLAGS_SIZE | GDT_FLAGS_GRANULARITY
 	);
 
-	// Update the CPU's GDT
-	gdt_flush((uint32_t) &ptr);
+	// Only spans the CPU's own data, in bytes rather than pages.
+	gdt_set_gate(
+		entries, GDT_DESCRIPTOR_PERCPU, (uint32_t) cpu, sizeof(struct cpu) - 1,
+		GDT_ACCESS_RW | GDT_ACCESS_PRIVILEDGE_RING_ZERO | GDT_ACCESS_PRESENT,
+		GDT_FLAGS_SIZE
+	);
+
+	// As we never leave ring 0, the stack to switch to is never used and is left empty.
+	memset(&cpu->tss, 0, sizeof(struct tss_entry));
+	cpu->tss.ss0 = GDT_SELECTOR(GDT_DESCRIPTOR_DATA);
+	cpu->tss.iomap_base = sizeof(struct tss_entry);
+	gdt_set_gate(
+		entries, GDT_DESCRIPTOR_TSS, (uint32_t) &cpu->tss, sizeof(struct tss_entry) - 1,
+		GDT_ACCESS_ACCESSED | GDT_ACCESS_EXECUTABLE | GDT_ACCESS_PRIVILEDGE_RING_ZERO | GDT_ACCESS_PRESENT,
+		GDT_FLAGS_NONE
+	);
+	// The TSS is a system segment, which is told apart from code and data by the cleared descriptor type bit.
+	entries[GDT_DESCRIPTOR_TSS].access &= (uint8_t) ~(GDT_ACCESS_GARBAGE);
+
+	// Update the CPU's GDT, then point %fs at our per-CPU data and load the TSS.
+	gdt_flush((uint32_t) &cpu->gdt_ptr);
+	asm volatile ("mov %0, %%fs" :: "r" (GDT_SELECTOR(GDT_DESCRIPTOR_PERCPU)));
+	asm volatile ("ltr %w0" :: "r" (GDT_SELECTOR(GDT_DESCRIPTOR_TSS)));
 }
 
-static void gdt_set_gate(int32_t idx, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags) {
+static void gdt_set_gate(struct gdt_entry *entries, int32_t idx, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags) {
 	// The Access and Flags bytes require certain bits to be set or unset.
 	access |= GDT_ACCESS_GARBAGE;
 	flags &= ~(GDT_FLAGS_GARBAGE);
@@ -2,6 +2,15 @@
 #include <include/x86/exceptions.h>
 #include <include/x86/io_port.h>
 #include <include/kernel/logger.h>
+#include <include/sched/task.h>
+#include <include/kernel/tick.h>
+#include <include/kernel/softirq.h>
+#include <include/kernel/trace.h>
+#include <include/x86/cpu.h>
+#include <include/x86/lapic.h>
+#include <include/x86/tsc.h>
+#include <include/x86/irq.h>
+#include <include/helpers.h>
 #include <string.h>
 #include <stdio.h>
 
@@ -17,12 +26,22 @@
 
 #define IDT_MAX_ENTRIES 256
 
+// Bit of the in-service register for the IRQ which the PICs raise spuriously (IRQ7 and IRQ15)
+#define PIC_READ_ISR 0x0B
+#define PIC_SPURIOUS_ISR 0x80
+
+// Number of interrupts raised to measure the cost of the entry path
+#define BENCH_ITERATIONS 1000
+
 static struct idt_entry entries[IDT_MAX_ENTRIES];
 
 static struct idt_ptr ptr;
 
 static interrupt_handler handlers[IDT_MAX_ENTRIES];
 
+// Cleared once the I/O APIC takes over, after which every interrupt is acknowledged through the LAPIC.
+static bool pic_enabled = true;
+
 
 extern void idt_flush(uint32_t idt_ptr);
 
@@ -57,15 +76,26 @@ void idt_init() {
 	exceptions_init();
 }
 
+void idt_init_cpu() {
+	idt_flush((uint32_t) &ptr);
+}
+
 /*
 	Registers an interrupt handler to the specified interrupt number
 */
 void register_interrupt_handler(uint8_t int_num, void (*handler)(struct registers *)) {
+	// Hardware interrupts may be shared, but exceptions have exactly one handler.
+	if (handlers[int_num] && handlers[int_num] != handler) {
+		KPANIC("Interrupt %x already has a handler!", int_num);
+	}
+
 	handlers[int_num] = handler;
 }
 
 // This gets called from our ASM interrupt handler stub.
 void idt_handler(struct registers *registers) {
+	irq_stats_count(registers->int_num);
+
 	// If the handler exists...
 	if(handlers[registers->int_num])
 		handlers[registers->int_num](registers);
@@ -73,28 +103,103 @@ void idt_handler(struct registers *registers) {
 		KTRACE("\nUnexpected Interrupt: %x\n", registers->int_num);
 }
 
-void irq_handler(struct registers *registers) {
-	// Spurious interrupts on IRQ7 occur due to line noise (I.E: Too many interrupts)
-	// and are handled specifically here. We must check with the PIC master controller 
-	// to determine if it really is inside of an interrupt or if it is false.
-	if (registers->int_num == IRQ7) {
-		outb(PIC_MASTER_COMMAND, 0x0B);
-		if (inb(PIC_MASTER_COMMAND) & 0x80) {
-			return;
+/*
+	Acknowledges an interrupt which came through the PICs, returning false if it was spurious, in which
+	case it must not be handled. Spurious interrupts occur on IRQ7 (or IRQ15, on the slave) due to line
+	noise (I.E: Too many interrupts), when the PIC finds nothing in service after all.
+*/
+static __attribute__((noinline)) bool pic_ack(uint32_t vector) {
+	if (vector == IRQ7) {
+		outb(PIC_MASTER_COMMAND, PIC_READ_ISR);
+		if (!(inb(PIC_MASTER_COMMAND) & PIC_SPURIOUS_ISR)) {
+			return false;
+		}
+	} else if (vector == IRQ15) {
+		outb(PIC_SLAVE_COMMAND, PIC_READ_ISR);
+		if (!(inb(PIC_SLAVE_COMMAND) & PIC_SPURIOUS_ISR)) {
+			// The master did see the cascade from the slave, which still needs acknowledging.
+			outb(PIC_MASTER_COMMAND, PIC_EOI);
+			return false;
 		}
 	}
 
 	// If this interrupt is meant for the slave, send EOI
-	if(registers->int_num >= PIC_SLAVE_START_OFFSET)
+	if(vector >= PIC_SLAVE_START_OFFSET)
 		outb(PIC_SLAVE_COMMAND, PIC_EOI);
 
 	// Send EOI to master
 	outb(PIC_MASTER_COMMAND, PIC_EOI);
+	return true;
+}
 
-	if(handlers[registers->int_num])
-		handlers[registers->int_num](registers);
-	else
-		KTRACE("\nUnexpected Interrupt: %x\n", registers->int_num);
+void irq_handler(struct registers *registers) {
+	uint64_t entry = irq_timestamp();
+	uint32_t vector = registers->int_num;
+
+	// Interrupts past those of the PIC, and all of them once the I/O APIC takes over, come from
+	// the LAPIC, which takes a single write to acknowledge.
+	if (likely(!pic_enabled || vector > IRQ15)) {
+		lapic_eoi();
+	} else if (!pic_ack(vector)) {
+		irq_stats_count(vector);
+		return;
+	}
+
+	// If the tick is stopped, jiffies may be behind; catch up so the handler sees the current time.
+	tick_update_jiffies();
+
+	struct cpu *cpu = this_cpu();
+
+	cpu->interrupt_depth++;
+	trace_event(irq_entry, vector);
+
+	bool handled = handle_irq(registers);
+	if (unlikely(!handled))
+		KTRACE_BIN("Unexpected Interrupt: %x", vector);
+
+	trace_event(irq_exit, vector, handled);
+	cpu->interrupt_depth--;
+
+	uint64_t handlers_done = irq_timestamp();
+
+	// Now that the urgent part is done, run whatever work the handler deferred, with interrupts enabled.
+	do_softirq();
+
+	irq_stats_record(vector, entry, handlers_done, irq_timestamp());
+
+	// If the handler woke up a task that should run before us, or our time slice
+	// has expired, switch to it now that the interrupt has been handled.
+	sched_preempt();
+}
+
+static int bench_interrupt(struct registers *UNUSED(regs), void *UNUSED(data)) {
+	return IRQ_HANDLED;
+}
+
+uint32_t irq_entry_cycles() {
+	// Acknowledging through the LAPIC is harmless with nothing in service, unlike through the PICs.
+	if (pic_enabled || !tsc_khz) {
+		return 0;
+	}
+
+	request_irq(IRQ_BENCH, bench_interrupt, 0, "bench", NULL);
+
+	uint32_t flags = irq_save();
+	uint64_t start = rdtsc_ordered();
+	for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+		asm volatile ("int %0" :: "i" (IRQ_BENCH) : "memory");
+	}
+	uint64_t cycles = rdtsc_ordered() - start;
+	irq_restore(flags);
+
+	free_irq(IRQ_BENCH, NULL);
+
+	uint32_t rem;
+	return (uint32_t) div_u64_rem(cycles, BENCH_ITERATIONS, &rem);
+}
+
+bool in_interrupt() {
+	return this_cpu()->interrupt_depth != 0;
 }
 
 
@@ -136,6 +241,13 @@ static void init_pic() {
 	outb(PIC_SLAVE_DATA, 0x0);
 }
 
+void pic_disable() {
+	// The PICs stay remapped past the exceptions, so any spurious interrupt they still raise is harmless.
+	outb(PIC_MASTER_DATA, 0xFF);
+	outb(PIC_SLAVE_DATA, 0xFF);
+	pic_enabled = false;
+}
+
 static void init_isr() {
 	uint8_t isr_flags = IDT_FLAGS_GATE_INTERRUPT32 | IDT_FLAGS_PRIVILEDGE_RING_ZERO | IDT_FLAGS_PRESENT;
 
@@ -180,6 +292,7 @@ static void init_isr() {
 	idt_set_gate(30, (uint32_t)interrupt_service_request_30, CODE_DESCR, isr_flags);
 	idt_set_gate(31, (uint32_t)interrupt_service_request_31, CODE_DESCR, isr_flags);
 	idt_set_gate(255, (uint32_t)interrupt_service_request_255, CODE_DESCR, isr_flags);
+	idt_set_gate(LAPIC_SPURIOUS, (uint32_t)interrupt_spurious, CODE_DESCR, isr_flags);
 }
 
 static void init_irq() {
@@ -209,4 +322,7 @@ static void init_irq() {
 	idt_set_gate(45, (uint32_t)interrupt_request_13, CODE_DESCR, irq_flags);
 	idt_set_gate(46, (uint32_t)interrupt_request_14, CODE_DESCR, irq_flags);
 	idt_set_gate(47, (uint32_t)interrupt_request_15, CODE_DESCR, irq_flags);
+	idt_set_gate(IPI_RESCHEDULE, (uint32_t)interrupt_request_reschedule, CODE_DESCR, irq_flags);
+	idt_set_gate(LAPIC_TIMER, (uint32_t)interrupt_request_lapic_timer, CODE_DESCR, irq_flags);
+	idt_set_gate(IRQ_BENCH, (uint32_t)interrupt_request_bench, CODE_DESCR, irq_flags);
 }
\ No newline at end of file
@@ -6,8 +6,7 @@
 	global interrupt_service_request_%1
 
 		interrupt_service_request_%1:
-			; Disable interrupts
-			cli
+			; No 'cli' needed, as interrupt gates disable interrupts on the way in.
 
 			; Push null error code
 			push 0
@@ -25,8 +24,7 @@
 	global interrupt_service_request_%1
 
 		interrupt_service_request_%1:
-			; Disable interrupts
-			cli
+			; No 'cli' needed, as interrupt gates disable interrupts on the way in.
 
 			; Push interrupt number
 			push %1
@@ -42,9 +40,6 @@
 	global interrupt_request_%1
 
 		interrupt_request_%1:
-			; Disable interrupts
-			cli
-
 			; No error code
 			push byte 0
 			; Set int_num to the remapped value
@@ -89,53 +84,6 @@ isr_generate_noerr 31
 isr_generate_noerr 255
 
 
-global idt_setup
-
-idt_setup:
-	; Push all registers onto the stack
-	pusha
-
-	; As the data segment register is a 16-bit register, we simply store it in AX, the
-	; lower 16-bits of the EAX register. This is needed because the struct registers
-	; requires word-aligned data (4-bytes).
-	mov ax, ds
-	push eax
-
-	; Load kernel data segment descriptor (0x10)
-	mov ax, 0x10
-	mov ds, ax
-    mov es, ax
-    mov fs, ax
-    mov gs, ax
-    mov ss, ax
-
-    ; Push stack pointer, which will be treated as (struct registers *) in the function call
-    push esp
-
-    ; Call C-function idt_handler with the registers as parameter
-    extern idt_handler
-    call idt_handler
-
-    ; Cleanup (struct registers *) parameter
-    add esp, 4
-
-    ; Restore data segment register (What was pushed from eax). Since again, the segment
-    ; registers are 16-bit registers, we must use the first 16-bit register, bx, and move them
-    ; back into the segment registered.
-    pop ebx
-    mov ds, bx
-    mov es, bx
-    mov fs, bx
-    mov gs, bx
-    mov ss, bx
-
-    ; Restore registers pushed during pusha instruction
-    popa
-    ; Cleanup error code and interrupt number
-    add esp, 8
-    ; Handles returning from interrupts
-    iret
-
 irq_generate 0, 32
 irq_generate 1, 33
 irq_generate 2, 34
@@ -153,10 +101,23 @@ irq_generate 13, 45
 irq_generate 14, 46
 irq_generate 15, 47
 
-; TODO: This has only a small variation compared to the above (only variation being that it called irq_handler instead)
-global irq_setup
-
-irq_setup:
+; Offset of the saved CS within struct registers (see x86/idt.h), once everything has been pushed.
+%define REGS_CS 48
+
+; Generates the code common to all interrupts of a kind, which saves the registers as struct registers,
+; calls the C handler with them, and returns from the interrupt.
+; %1 - Name of the entry point
+; %2 - C handler to call
+;
+; Interrupts taken in ring 0 already have the kernel data segments loaded, so they are only reloaded
+; (and restored on the way out) when coming from elsewhere, which is kept off of the common path as
+; reloading a segment register is far from cheap. FS is always left alone, as it points to the per-CPU
+; data of whichever CPU we are on (see x86/cpu.h).
+%macro interrupt_common 2
+global %1
+extern %2
+
+%1:
 	; Push all registers onto the stack
 	pusha
 
@@ -166,37 +127,77 @@ irq_setup:
 	mov ax, ds
 	push eax
 
-	; Load kernel data segment descriptor (0x10)
+	test byte [esp + REGS_CS], 3
+	jnz %1_load_segments
+
+%1_dispatch:
+	; Push stack pointer, which will be treated as (struct registers *) in the function call
+	push esp
+	call %2
+	add esp, 4
+
+	test byte [esp + REGS_CS], 3
+	jnz %1_restore_segments
+
+	; Skip the data segment, which was never changed
+	add esp, 4
+
+%1_return:
+	; Restore registers pushed during pusha instruction
+	popa
+	; Cleanup error code and interrupt number
+	add esp, 8
+	; Handles returning from interrupts
+	iret
+
+%1_load_segments:
+	; Load kernel data segment descriptor (0x10).
 	mov ax, 0x10
 	mov ds, ax
-    mov es, ax
-    mov fs, ax
-    mov gs, ax
-    mov ss, ax
-
-    ; Push stack pointer, which will be treated as (struct registers *) in the function call
-    push esp
-
-    ; Call C-function idt_handler with the registers as parameter
-    extern irq_handler
-    call irq_handler
-
-    ; Cleanup (struct registers *) parameter
-    add esp, 4
-
-    ; Restore data segment register (What was pushed from eax). Since again, the segment
-    ; registers are 16-bit registers, we must use the first 16-bit register, bx, and move them
-    ; back into the segment registered.
-    pop ebx
-    mov ds, bx
-    mov es, bx
-    mov fs, bx
-    mov gs, bx
-    mov ss, bx
-
-    ; Restore registers pushed during pusha instruction
-    popa
-    ; Cleanup error code and interrupt number
-    add esp, 8
-    ; Handles returning from interrupts
-    iret
\ No newline at end of file
+	mov es, ax
+	mov gs, ax
+	jmp %1_dispatch
+
+%1_restore_segments:
+	; Restore data segment register (What was pushed from eax).
+	pop ebx
+	mov ds, bx
+	mov es, bx
+	mov gs, bx
+	jmp %1_return
+%endmacro
+
+; Exceptions (and software interrupts) go to idt_handler, hardware interrupts to irq_handler.
+interrupt_common idt_setup, idt_handler
+interrupt_common irq_setup, irq_handler
+
+; Inter-processor interrupts are delivered by the LAPIC, at vectors above those of the PIC.
+global interrupt_request_reschedule
+
+	interrupt_request_reschedule:
+		push dword 0
+		push dword 0xF0
+		jmp irq_setup
+
+; As is the tick of each processor, once its LAPIC timer takes over (see x86/lapic.h).
+global interrupt_request_lapic_timer
+
+	interrupt_request_lapic_timer:
+		push dword 0
+		push dword 0xF1
+		jmp irq_setup
+
+; Raised by irq_entry_cycles with 'int', to measure the cost of the path above.
+global interrupt_request_bench
+
+	interrupt_request_bench:
+		push dword 0
+		push dword 0xF2
+		jmp irq_setup
+
+; The LAPIC raises a spurious interrupt when an interrupt goes away before it could be delivered.
+; These must not be acknowledged, so there is nothing to do at all.
+global interrupt_spurious
+
+	interrupt_spurious:
+		iret
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include <include/x86/ioapic.h>
+#include <include/x86/idt.h>
+#include <include/x86/mp.h>
+#include <include/x86/cpu.h>
+#include <include/x86/io_port.h>
+#include <include/mm/alloc.h>
+#include <include/kernel/spinlock.h>
+#include <include/kernel/logger.h>
+
+// Interrupt mode configuration register, reached through a select and a data port.
+#define IMCR_SELECT 0x22
+#define IMCR_DATA 0x23
+#define IMCR_REGISTER 0x70
+#define IMCR_APIC 0x01
+
+// Polarity and trigger mode of MP table interrupt entries (see struct mp_irq)
+#define MP_POLARITY_MASK 0x3
+#define MP_POLARITY_LOW 0x3
+#define MP_TRIGGER_MASK 0xC
+#define MP_TRIGGER_LEVEL 0xC
+
+static volatile uint32_t *ioapic;
+
+// Protects the register select, which makes each access two steps.
+static spinlock_t ioapic_lock = SPINLOCK_INITIALIZER;
+
+static uint32_t nr_pins;
+
+// Pin each ISA interrupt is wired to
+static uint8_t isa_pins[ISA_IRQS];
+
+static bool enabled;
+
+static uint32_t ioapic_read(uint32_t reg) {
+	ioapic[IOAPIC_REGSEL / 4] = reg;
+	return ioapic[IOAPIC_WIN / 4];
+}
+
+static void ioapic_write(uint32_t reg, uint32_t value) {
+	ioapic[IOAPIC_REGSEL / 4] = reg;
+	ioapic[IOAPIC_WIN / 4] = value;
+}
+
+static void set_redirection(uint8_t pin, uint32_t low, uint8_t apic_id) {
+	// Write the low half (and with it, the mask) last, so the entry is never live half-written.
+	ioapic_write(IOAPIC_REDTBL(pin), IOAPIC_REDIR_MASKED);
+	ioapic_write(IOAPIC_REDTBL(pin) + 1, (uint32_t) apic_id << 24);
+	ioapic_write(IOAPIC_REDTBL(pin), low);
+}
+
+bool ioapic_init() {
+	if (!mp_info.ioapic_address) {
+		KWARNING("No I/O APIC found, continuing with the PIC...");
+		return false;
+	}
+
+	ioapic = (volatile uint32_t *) alloc_map_device(mp_info.ioapic_address);
+	nr_pins = ((ioapic_read(IOAPIC_VERSION) >> 16) & 0xFF) + 1;
+
+	// ISA interrupts are wired to the pin of the same number, unless the MP tables say otherwise
+	// (the timer, on IRQ0, usually is not), and are active high and edge-triggered by default.
+	uint32_t redir[ISA_IRQS];
+	for (uint8_t irq = 0; irq < ISA_IRQS; irq++) {
+		isa_pins[irq] = irq;
+		redir[irq] = IOAPIC_REDIR_FIXED | (IRQ0 + irq);
+	}
+
+	for (uint32_t i = 0; i < mp_info.nr_irqs; i++) {
+		struct mp_irq *info = &mp_info.irqs[i];
+		if (info->type != MP_IRQ_INT || info->source_irq >= ISA_IRQS || info->ioapic_id != mp_info.ioapic_id) {
+			continue;
+		}
+
+		isa_pins[info->source_irq] = info->ioapic_pin;
+		if ((info->flags & MP_POLARITY_MASK) == MP_POLARITY_LOW) {
+			redir[info->source_irq] |= IOAPIC_REDIR_ACTIVE_LOW;
+		}
+		if ((info->flags & MP_TRIGGER_MASK) == MP_TRIGGER_LEVEL) {
+			redir[info->source_irq] |= IOAPIC_REDIR_LEVEL;
+		}
+	}
+
+	uint32_t flags = spin_lock_irqsave(&ioapic_lock);
+
+	for (uint8_t pin = 0; pin < nr_pins; pin++) {
+		ioapic_write(IOAPIC_REDTBL(pin), IOAPIC_REDIR_MASKED);
+	}
+
+	// IRQ2 is the cascade from the slave PIC, which never fires, and its pin usually belongs to the timer.
+	for (uint8_t irq = 0; irq < ISA_IRQS; irq++) {
+		if (irq != 2 && isa_pins[irq] < nr_pins) {
+			set_redirection(isa_pins[irq], redir[irq], cpus[0].apic_id);
+		}
+	}
+
+	// Systems starting out in PIC mode have the PIC wired straight to the processor, bypassing the APICs.
+	if (mp_info.imcr) {
+		outb(IMCR_SELECT, IMCR_REGISTER);
+		outb(IMCR_DATA, IMCR_APIC);
+	}
+
+	pic_disable();
+	enabled = true;
+
+	spin_unlock_irqrestore(&ioapic_lock, flags);
+
+	KDEBUG("I/O APIC #%d at %x with %d pins, timer on pin %d", mp_info.ioapic_id, mp_info.ioapic_address,
+		nr_pins, isa_pins[0]);
+	return true;
+}
+
+bool ioapic_enabled() {
+	return enabled;
+}
+
+static void update_mask(uint8_t irq, bool masked) {
+	uint32_t flags = spin_lock_irqsave(&ioapic_lock);
+	uint8_t pin = isa_pins[irq];
+	uint32_t low = ioapic_read(IOAPIC_REDTBL(pin));
+	if (masked) {
+		low |= IOAPIC_REDIR_MASKED;
+	} else {
+		low &= ~(IOAPIC_REDIR_MASKED);
+	}
+	ioapic_write(IOAPIC_REDTBL(pin), low);
+	spin_unlock_irqrestore(&ioapic_lock, flags);
+}
+
+void ioapic_mask(uint8_t irq) {
+	if (enabled && irq < ISA_IRQS) {
+		update_mask(irq, true);
+	}
+}
+
+void ioapic_unmask(uint8_t irq) {
+	if (enabled && irq < ISA_IRQS) {
+		update_mask(irq, false);
+	}
+}
+
+bool ioapic_set_affinity(uint8_t irq, uint32_t cpu) {
+	if (!enabled || irq >= ISA_IRQS || cpu >= MAX_CPUS || !cpus[cpu].online) {
+		return false;
+	}
+
+	uint32_t flags = spin_lock_irqsave(&ioapic_lock);
+	uint8_t pin = isa_pins[irq];
+	set_redirection(pin, ioapic_read(IOAPIC_REDTBL(pin)), cpus[cpu].apic_id);
+	spin_unlock_irqrestore(&ioapic_lock, flags);
+
+	return true;
+}
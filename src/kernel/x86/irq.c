@@ -0,0 +1,337 @@
+#include <include/x86/irq.h>
+#include <include/kernel/spinlock.h>
+#include <include/kernel/logger.h>
+#include <include/sched/task.h>
+#include <include/sched/wait.h>
+#include <include/drivers/vga.h>
+#include <include/x86/cpu.h>
+#include <include/helpers.h>
+
+#include <sys/queue.h>
+#include <string.h>
+#include <stdio.h>
+
+#define NR_VECTORS 256
+
+struct irqaction {
+	irq_handler_t handler;
+	void (*thread_fn)(void *data);
+	void *data;
+	uint32_t flags;
+	const char *name;
+	bool used;
+
+	// For threaded handlers: The thread, which waits on 'wq' until 'thread_pending' is set.
+	task_t *thread;
+	wait_queue_t wq;
+	bool thread_pending;
+
+	SLIST_ENTRY(irqaction) next;
+};
+
+// The handlers of a vector. The lock is taken while calling them, so they can not be removed
+// from under an interrupt on another CPU.
+struct irq_desc {
+	spinlock_t lock;
+	SLIST_HEAD(, irqaction) actions;
+};
+
+static struct irq_desc descs[NR_VECTORS];
+
+// Statistics of a single CPU, only ever updated by that CPU with interrupts disabled.
+struct irq_cpu_stats {
+	struct irq_stats vectors[NR_VECTORS];
+
+	// Time from entry until the handlers are done, and until we leave (see irq.h)
+	uint32_t hardirq_hist[IRQ_HIST_BUCKETS];
+	uint32_t total_hist[IRQ_HIST_BUCKETS];
+
+	// Longest time spent in a handler with interrupts disabled, and which vector it was for.
+	uint32_t irqsoff_max;
+	uint32_t irqsoff_vector;
+};
+
+static struct irq_cpu_stats cpu_stats[MAX_CPUS];
+
+// Handlers are requested before memory is set up, so they come from here.
+static struct irqaction actions[IRQ_MAX_ACTIONS];
+static spinlock_t actions_lock = SPINLOCK_INITIALIZER;
+
+static struct irqaction *alloc_action() {
+	uint32_t flags = spin_lock_irqsave(&actions_lock);
+	for (uint32_t i = 0; i < IRQ_MAX_ACTIONS; i++) {
+		if (!actions[i].used) {
+			actions[i].used = true;
+			spin_unlock_irqrestore(&actions_lock, flags);
+			return &actions[i];
+		}
+	}
+	spin_unlock_irqrestore(&actions_lock, flags);
+
+	KPANIC("Too many interrupt handlers!");
+	return NULL;
+}
+
+static void free_action(struct irqaction *action) {
+	uint32_t flags = spin_lock_irqsave(&actions_lock);
+	action->used = false;
+	spin_unlock_irqrestore(&actions_lock, flags);
+}
+
+static int irq_default_primary(struct registers *UNUSED(regs), void *UNUSED(data)) {
+	return IRQ_WAKE_THREAD;
+}
+
+static void irq_thread(void *args) {
+	struct irqaction *action = args;
+
+	for (;;) {
+		uint32_t flags = spin_lock_irqsave(&action->wq.lock);
+		while (!action->thread_pending) {
+			wait_queue_sleep(&action->wq);
+		}
+		action->thread_pending = false;
+		spin_unlock_irqrestore(&action->wq.lock, flags);
+
+		action->thread_fn(action->data);
+	}
+}
+
+static void wake_irq_thread(struct irqaction *action) {
+	spin_lock(&action->wq.lock);
+	action->thread_pending = true;
+	__wake_up_one(&action->wq);
+	spin_unlock(&action->wq.lock);
+}
+
+bool request_threaded_irq(uint8_t vector, irq_handler_t handler, void (*thread_fn)(void *data),
+		uint32_t flags, const char *name, void *data) {
+	struct irq_desc *desc = &descs[vector];
+	struct irqaction *action = alloc_action();
+	action->handler = handler ? handler : irq_default_primary;
+	action->thread_fn = thread_fn;
+	action->data = data;
+	action->flags = flags;
+	action->name = name;
+	action->thread = NULL;
+	action->thread_pending = false;
+
+	if (thread_fn) {
+		wait_queue_init(&action->wq);
+		action->thread = thread_create(irq_thread, action);
+
+		struct sched_attr attr = { .policy = SCHED_FIFO, .priority = IRQ_THREAD_PRIORITY };
+		sched_setattr(action->thread, &attr);
+	}
+
+	uint32_t irq_flags = spin_lock_irqsave(&desc->lock);
+
+	// Sharing must be agreed to by everyone involved, otherwise this is most likely a mistake.
+	struct irqaction *first = SLIST_FIRST(&desc->actions);
+	if (first && !(first->flags & flags & (IRQF_SHARED))) {
+		spin_unlock_irqrestore(&desc->lock, irq_flags);
+		KWARNING("Interrupt %x: %s can not share with %s", vector, name, first->name);
+
+		// A thread which was already started is left asleep, same as in free_irq.
+		if (!action->thread) {
+			free_action(action);
+		}
+		return false;
+	}
+
+	// Keep them in the order they were requested
+	if (!first) {
+		SLIST_INSERT_HEAD(&desc->actions, action, next);
+	} else {
+		struct irqaction *last = first;
+		while (SLIST_NEXT(last, next)) {
+			last = SLIST_NEXT(last, next);
+		}
+		SLIST_INSERT_AFTER(last, action, next);
+	}
+
+	spin_unlock_irqrestore(&desc->lock, irq_flags);
+
+	KTRACE("Interrupt %x: %s%s", vector, name, thread_fn ? " (threaded)" : "");
+	return true;
+}
+
+bool request_irq(uint8_t vector, irq_handler_t handler, uint32_t flags, const char *name, void *data) {
+	return request_threaded_irq(vector, handler, NULL, flags, name, data);
+}
+
+void free_irq(uint8_t vector, void *data) {
+	struct irq_desc *desc = &descs[vector];
+	uint32_t flags = spin_lock_irqsave(&desc->lock);
+
+	struct irqaction *action;
+	SLIST_FOREACH(action, &desc->actions, next) {
+		if (action->data == data) {
+			break;
+		}
+	}
+
+	if (!action) {
+		spin_unlock_irqrestore(&desc->lock, flags);
+		KWARNING("Interrupt %x: No handler to free for %x", vector, data);
+		return;
+	}
+
+	SLIST_REMOVE(&desc->actions, action, irqaction, next);
+	spin_unlock_irqrestore(&desc->lock, flags);
+
+	if (!action->thread) {
+		free_action(action);
+	}
+}
+
+bool handle_irq(struct registers *regs) {
+	struct irq_desc *desc = &descs[regs->int_num];
+	bool handled = false;
+
+	spin_lock(&desc->lock);
+
+	struct irqaction *action;
+	SLIST_FOREACH(action, &desc->actions, next) {
+		int ret = action->handler(regs, action->data);
+		if (ret == IRQ_WAKE_THREAD) {
+			wake_irq_thread(action);
+		}
+
+		handled |= ret != IRQ_NONE;
+	}
+
+	spin_unlock(&desc->lock);
+	return handled;
+}
+
+void irq_stats_count(uint32_t vector) {
+	cpu_stats[smp_processor_id()].vectors[vector].count++;
+}
+
+static uint32_t hist_bucket(uint32_t cycles) {
+	cycles >>= IRQ_HIST_SHIFT;
+	if (!cycles) {
+		return 0;
+	}
+
+	// Everything in [2^(n - 1), 2^n) (after the shift) goes into bucket n.
+	return MIN(32 - (uint32_t) __builtin_clz(cycles), IRQ_HIST_BUCKETS - 1);
+}
+
+void irq_stats_record(uint32_t vector, uint64_t entry, uint64_t handled, uint64_t exit) {
+	struct irq_cpu_stats *stats = &cpu_stats[smp_processor_id()];
+	struct irq_stats *vec = &stats->vectors[vector];
+
+	vec->count++;
+	if (!entry) {
+		return;
+	}
+
+	// Anything which does not fit is far beyond the last bucket anyway.
+	uint32_t hardirq = (uint32_t) MIN(handled - entry, UINT32_MAX);
+	uint32_t total = (uint32_t) MIN(exit - entry, UINT32_MAX);
+
+	vec->cycles += hardirq;
+	if (hardirq > vec->max_cycles) {
+		vec->max_cycles = hardirq;
+	}
+
+	if (hardirq > stats->irqsoff_max) {
+		stats->irqsoff_max = hardirq;
+		stats->irqsoff_vector = vector;
+	}
+
+	stats->hardirq_hist[hist_bucket(hardirq)]++;
+	stats->total_hist[hist_bucket(total)]++;
+}
+
+void irq_stats_get(uint32_t vector, struct irq_stats *stats) {
+	memset(stats, 0, sizeof(*stats));
+
+	struct cpu *cpu;
+	for_each_online_cpu(cpu) {
+		struct irq_stats *vec = &cpu_stats[cpu->id].vectors[vector];
+		stats->count += vec->count;
+		stats->cycles += vec->cycles;
+		stats->max_cycles = MAX(stats->max_cycles, vec->max_cycles);
+	}
+}
+
+// Converts TSC cycles to nanoseconds
+static uint32_t cycles_to_ns(uint64_t cycles) {
+	if (!tsc_khz) {
+		return 0;
+	}
+
+	uint32_t rem;
+	return (uint32_t) div_u64_rem(cycles * 1000000, tsc_khz, &rem);
+}
+
+static void dump_hist(const char *name, uint32_t *hist) {
+	printf("  %s:", name);
+	for (uint32_t i = 0; i < IRQ_HIST_BUCKETS; i++) {
+		if (!hist[i]) {
+			continue;
+		}
+
+		// Labelled with where the bucket ends, except the last, which has no end.
+		if (i < IRQ_HIST_BUCKETS - 1) {
+			printf(" <%uns:%u", cycles_to_ns((uint64_t) 1 << (IRQ_HIST_SHIFT + i)), hist[i]);
+		} else {
+			printf(" >=%uns:%u", cycles_to_ns((uint64_t) 1 << (IRQ_HIST_SHIFT + i - 1)), hist[i]);
+		}
+	}
+	printf("\n");
+}
+
+void irq_stats_dump() {
+	struct cpu *cpu;
+	uint32_t flags = vga_lock();
+
+	printf("Vec Name         ");
+	for_each_online_cpu(cpu) {
+		printf("      CPU%d", cpu->id);
+	}
+	printf("   Avg ns   Max ns\n");
+
+	for (uint32_t vector = 0; vector < NR_VECTORS; vector++) {
+		struct irq_stats stats;
+		irq_stats_get(vector, &stats);
+		if (!stats.count) {
+			continue;
+		}
+
+		// Handlers may come and go while we print, but their names are all static.
+		struct irqaction *action = SLIST_FIRST(&descs[vector].actions);
+		const char *name = vector < IRQ0 ? "exception" : action ? action->name : "none";
+
+		printf(" %2x %-12s", vector, name);
+		for_each_online_cpu(cpu) {
+			printf(" %9u", cpu_stats[cpu->id].vectors[vector].count);
+		}
+
+		uint32_t rem;
+		printf(" %8u %8u\n", cycles_to_ns(div_u64_rem(stats.cycles, stats.count, &rem)),
+			cycles_to_ns(stats.max_cycles));
+	}
+
+	if (tsc_khz) {
+		for_each_online_cpu(cpu) {
+			struct irq_cpu_stats *stats = &cpu_stats[cpu->id];
+			printf("CPU%d: Longest with interrupts disabled: %uns (vector %x)\n", cpu->id,
+				cycles_to_ns(stats->irqsoff_max), stats->irqsoff_vector);
+			dump_hist("Handlers", stats->hardirq_hist);
+			dump_hist("With softirqs", stats->total_hist);
+		}
+	}
+
+	vga_unlock(flags);
+}
+
+void irq_stats_reset() {
+	struct cpu *cpu;
+	for_each_online_cpu(cpu) {
+		memset(&cpu_stats[cpu->id], 0, sizeof(cpu_stats[cpu->id]));
+	}
+}
@@ -0,0 +1,148 @@
+#include <include/x86/lapic.h>
+#include <include/x86/idt.h>
+#include <include/x86/irq.h>
+#include <include/x86/irqflags.h>
+#include <include/x86/cpu.h>
+#include <include/x86/tsc.h>
+#include <include/mm/alloc.h>
+#include <include/drivers/timer.h>
+#include <include/kernel/tick.h>
+#include <include/kernel/time.h>
+#include <include/kernel/logger.h>
+#include <include/helpers.h>
+
+// How long each calibration run of the timer lasts, and how many runs are made.
+#define CALIBRATE_US 10000
+#define CALIBRATE_RUNS 3
+#define CALIBRATE_TICKS (CALIBRATE_US * TIMER_HZ / 1000000)
+
+static volatile uint32_t *lapic;
+
+// Counts of the timer, and cycles of the TSC (in TSC-deadline mode), in one jiffy
+static uint32_t timer_counts_per_tick;
+static uint32_t tsc_cycles_per_tick;
+
+static struct clock_event_device lapic_timers[MAX_CPUS];
+
+static inline uint32_t lapic_read(uint32_t reg) {
+	return lapic[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+	lapic[reg / 4] = value;
+}
+
+void lapic_init(uint32_t address) {
+	lapic = (volatile uint32_t *) alloc_map_device(address);
+	KTRACE("LAPIC mapped at %x, version: %x", address, lapic_read(LAPIC_VERSION) & 0xFF);
+}
+
+void lapic_enable() {
+	// Accept interrupts of all priorities, and enable it with the spurious vector set.
+	lapic_write(LAPIC_TPR, 0);
+	lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS);
+
+	// The error status register must be written to before reading, which also clears it.
+	lapic_write(LAPIC_ESR, 0);
+	lapic_write(LAPIC_ESR, 0);
+	lapic_eoi();
+}
+
+uint8_t lapic_id() {
+	return (uint8_t) (lapic_read(LAPIC_ID) >> 24);
+}
+
+void lapic_eoi() {
+	lapic_write(LAPIC_EOI, 0);
+}
+
+void lapic_send_ipi(uint8_t apic_id, uint32_t icr) {
+	// Writing the low half is what sends the IPI, so the destination must be written first, and
+	// an interrupt handler sending an IPI of its own must not get in between.
+	uint32_t flags = irq_save();
+	lapic_write(LAPIC_ICR_HIGH, (uint32_t) apic_id << 24);
+	lapic_write(LAPIC_ICR_LOW, icr);
+
+	while (lapic_read(LAPIC_ICR_LOW) & (LAPIC_ICR_PENDING)) {
+		asm volatile ("pause");
+	}
+	irq_restore(flags);
+}
+
+static void lapic_timer_set_periodic() {
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | LAPIC_TIMER);
+	lapic_write(LAPIC_TIMER_INITIAL, timer_counts_per_tick);
+}
+
+static void lapic_timer_set_oneshot(uint32_t ticks) {
+	// Changing the mode disarms the timer, so there is no need to stop the periodic one first.
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_ONESHOT | LAPIC_TIMER);
+	lapic_write(LAPIC_TIMER_INITIAL, ticks * timer_counts_per_tick);
+}
+
+static void lapic_timer_set_deadline(uint32_t ticks) {
+	// The LVT write must be seen before the MSR write, which is not ordered with it by itself.
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_TSC_DEADLINE | LAPIC_TIMER);
+	asm volatile ("mfence" ::: "memory");
+	wrmsr(MSR_IA32_TSC_DEADLINE, rdtsc() + (uint64_t) ticks * tsc_cycles_per_tick);
+}
+
+static int lapic_timer_interrupt(struct registers *regs, void *UNUSED(data)) {
+	struct clock_event_device *dev = &lapic_timers[smp_processor_id()];
+	if (dev->event_handler) {
+		dev->event_handler(regs);
+	}
+
+	return IRQ_HANDLED;
+}
+
+void lapic_timer_init_cpu() {
+	struct clock_event_device *dev = &lapic_timers[smp_processor_id()];
+	dev->name = "LAPIC";
+	dev->set_periodic = lapic_timer_set_periodic;
+
+	if (tsc_cycles_per_tick) {
+		dev->set_oneshot = lapic_timer_set_deadline;
+		// Anything longer would confuse comparisons of jiffies, which wrap around.
+		dev->max_delta_ticks = INT32_MAX;
+	} else {
+		dev->set_oneshot = lapic_timer_set_oneshot;
+		dev->max_delta_ticks = UINT32_MAX / timer_counts_per_tick;
+	}
+
+	lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+	tick_register_device(dev);
+}
+
+bool lapic_timer_init() {
+	lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER);
+
+	// Anything interrupting us between starting the timer and the delay, or after it, can only make a
+	// run count more, so the smallest count is the most accurate.
+	uint32_t counts = UINT32_MAX;
+	for (int i = 0; i < CALIBRATE_RUNS; i++) {
+		lapic_write(LAPIC_TIMER_INITIAL, UINT32_MAX);
+		udelay(CALIBRATE_US);
+		uint32_t run = UINT32_MAX - lapic_read(LAPIC_TIMER_CURRENT);
+		counts = MIN(counts, run);
+	}
+	lapic_write(LAPIC_TIMER_INITIAL, 0);
+
+	timer_counts_per_tick = counts / CALIBRATE_TICKS;
+	if (!timer_counts_per_tick) {
+		KWARNING("LAPIC timer failed to calibrate, continuing with the PIT...");
+		return false;
+	}
+
+	if ((cpuid(1).ecx & (CPUID_FEAT_ECX_TSC_DEADLINE)) && tsc_khz) {
+		uint32_t rem;
+		tsc_cycles_per_tick = (uint32_t) div_u64_rem((uint64_t) tsc_khz * 1000, TIMER_HZ, &rem);
+	}
+
+	KDEBUG("LAPIC timer: %d counts per jiffy%s", timer_counts_per_tick, tsc_cycles_per_tick ? ", TSC-deadline" : "");
+
+	request_irq(LAPIC_TIMER, lapic_timer_interrupt, 0, "LAPIC timer", NULL);
+	lapic_timer_init_cpu();
+	return true;
+}
@@ -0,0 +1,193 @@
+#include <include/x86/mp.h>
+#include <include/x86/cpu.h>
+#include <include/kernel/logger.h>
+#include <include/helpers.h>
+
+#include <string.h>
+
+// Entry types of the configuration table, and their sizes
+#define MP_ENTRY_PROCESSOR 0
+#define MP_ENTRY_BUS 1
+#define MP_ENTRY_IOAPIC 2
+#define MP_ENTRY_IO_INTERRUPT 3
+#define MP_ENTRY_LOCAL_INTERRUPT 4
+
+#define MP_PROCESSOR_ENABLED 1 << 0
+#define MP_PROCESSOR_BSP 1 << 1
+#define MP_IOAPIC_ENABLED 1 << 0
+
+// Second feature byte of the floating pointer: IMCR present (PIC mode)
+#define MP_FEATURE2_IMCR 1 << 7
+
+// Only the first 4MB of physical memory is mapped (at 0xC0000000), which is where the tables live.
+#define LOW_MEMORY_END 0x400000
+#define LOW_MEMORY(addr) ((void *) ((addr) + 0xC0000000))
+
+struct __attribute__((packed)) mp_processor {
+	uint8_t type;
+	uint8_t lapic_id;
+	uint8_t lapic_version;
+	uint8_t flags;
+	uint32_t signature;
+	uint32_t features;
+	uint32_t reserved[2];
+};
+
+struct __attribute__((packed)) mp_bus {
+	uint8_t type;
+	uint8_t id;
+	char bus_type[6];
+};
+
+struct __attribute__((packed)) mp_ioapic {
+	uint8_t type;
+	uint8_t id;
+	uint8_t version;
+	uint8_t flags;
+	uint32_t address;
+};
+
+struct __attribute__((packed)) mp_io_interrupt {
+	uint8_t type;
+	uint8_t irq_type;
+	uint16_t flags;
+	uint8_t source_bus;
+	uint8_t source_irq;
+	uint8_t ioapic_id;
+	uint8_t ioapic_pin;
+};
+
+struct mp_info mp_info;
+
+static uint8_t checksum(void *addr, uint32_t length) {
+	uint8_t sum = 0;
+	for (uint8_t *byte = addr; length--; byte++) {
+		sum += *byte;
+	}
+
+	return sum;
+}
+
+static struct mp_floating_pointer *search(uint32_t start, uint32_t length) {
+	for (uint32_t addr = start; addr < start + length; addr += 16) {
+		struct mp_floating_pointer *mpf = LOW_MEMORY(addr);
+		if (!memcmp(mpf->signature, "_MP_", 4) && !checksum(mpf, mpf->length * 16)) {
+			return mpf;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+	The floating pointer is in the first KB of the Extended BIOS Data Area, the last KB of base
+	memory, or the BIOS ROM, in that order.
+*/
+static struct mp_floating_pointer *find_floating_pointer() {
+	struct mp_floating_pointer *mpf;
+
+	uint32_t ebda = (uint32_t) *(uint16_t *) LOW_MEMORY(0x40E) << 4;
+	if (ebda && (mpf = search(ebda, 1024))) {
+		return mpf;
+	}
+
+	uint32_t base_end = (uint32_t) *(uint16_t *) LOW_MEMORY(0x413) * 1024;
+	if (base_end && (mpf = search(base_end - 1024, 1024))) {
+		return mpf;
+	}
+
+	return search(0xF0000, 0x10000);
+}
+
+bool mp_init() {
+	struct mp_floating_pointer *mpf = find_floating_pointer();
+	if (!mpf || !mpf->config) {
+		// Either not a multiprocessor system, or one of the default configurations we do not bother with.
+		return false;
+	}
+
+	if (mpf->config >= LOW_MEMORY_END) {
+		KWARNING("MP configuration table at %x is out of reach", mpf->config);
+		return false;
+	}
+
+	struct mp_config_table *config = LOW_MEMORY(mpf->config);
+	if (memcmp(config->signature, "PCMP", 4) || checksum(config, config->length)) {
+		KWARNING("MP configuration table at %x is corrupt", mpf->config);
+		return false;
+	}
+
+	mp_info.lapic_address = config->lapic_address;
+	mp_info.imcr = mpf->features[1] & (MP_FEATURE2_IMCR);
+
+	// Bus ids that belong to the ISA bus
+	uint32_t isa_buses[BITMAP_SIZE(256)];
+	memset(isa_buses, 0, sizeof(isa_buses));
+
+	// The boot processor is always cpus[0], and the rest are numbered in the order they appear.
+	nr_cpus = 1;
+
+	uint8_t *entry = (uint8_t *) (config + 1);
+	for (uint32_t i = 0; i < config->entry_count; i++) {
+		switch (*entry) {
+			case MP_ENTRY_PROCESSOR: {
+				struct mp_processor *proc = (struct mp_processor *) entry;
+				if (!(proc->flags & (MP_PROCESSOR_ENABLED))) {
+					// Disabled by the BIOS, so leave it be
+				} else if (proc->flags & (MP_PROCESSOR_BSP)) {
+					cpus[0].apic_id = proc->lapic_id;
+				} else if (nr_cpus < MAX_CPUS) {
+					cpus[nr_cpus].id = nr_cpus;
+					cpus[nr_cpus].apic_id = proc->lapic_id;
+					nr_cpus++;
+				}
+
+				entry += sizeof(struct mp_processor);
+				break;
+			}
+			case MP_ENTRY_BUS: {
+				struct mp_bus *bus = (struct mp_bus *) entry;
+				if (!memcmp(bus->bus_type, "ISA", 3)) {
+					BITMAP_SET(isa_buses, bus->id);
+				}
+
+				entry += sizeof(struct mp_bus);
+				break;
+			}
+			case MP_ENTRY_IOAPIC: {
+				struct mp_ioapic *ioapic = (struct mp_ioapic *) entry;
+				if ((ioapic->flags & (MP_IOAPIC_ENABLED)) && !mp_info.ioapic_address) {
+					mp_info.ioapic_id = ioapic->id;
+					mp_info.ioapic_address = ioapic->address;
+				}
+
+				entry += sizeof(struct mp_ioapic);
+				break;
+			}
+			case MP_ENTRY_IO_INTERRUPT: {
+				struct mp_io_interrupt *irq = (struct mp_io_interrupt *) entry;
+				if (BITMAP_GET(isa_buses, irq->source_bus) && mp_info.nr_irqs < MP_MAX_IRQS) {
+					struct mp_irq *info = &mp_info.irqs[mp_info.nr_irqs++];
+					info->type = irq->irq_type;
+					info->flags = irq->flags;
+					info->source_irq = irq->source_irq;
+					info->ioapic_id = irq->ioapic_id;
+					info->ioapic_pin = irq->ioapic_pin;
+				}
+
+				entry += sizeof(struct mp_io_interrupt);
+				break;
+			}
+			case MP_ENTRY_LOCAL_INTERRUPT:
+				entry += sizeof(struct mp_io_interrupt);
+				break;
+			default:
+				KWARNING("Unknown MP configuration table entry type %d", *entry);
+				return true;
+		}
+	}
+
+	KDEBUG("MP: %d CPUs, LAPIC: %x, IOAPIC #%d: %x, %d ISA interrupts", nr_cpus, mp_info.lapic_address,
+		mp_info.ioapic_id, mp_info.ioapic_address, mp_info.nr_irqs);
+	return true;
+}
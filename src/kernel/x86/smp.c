@@ -0,0 +1,171 @@
+#include <include/x86/smp.h>
+#include <include/x86/cpu.h>
+#include <include/x86/gdt.h>
+#include <include/x86/idt.h>
+#include <include/x86/irq.h>
+#include <include/x86/fpu.h>
+#include <include/x86/lapic.h>
+#include <include/x86/ioapic.h>
+#include <include/x86/mp.h>
+#include <include/mm/alloc.h>
+#include <include/kernel/mem.h>
+#include <include/kernel/time.h>
+#include <include/kernel/tick.h>
+#include <include/kernel/spinlock.h>
+#include <include/kernel/logger.h>
+#include <include/sched/task.h>
+#include <include/helpers.h>
+
+#include <string.h>
+
+// Where the trampoline is copied to. The Startup IPI gives the page to start at, rather than the address.
+#define TRAMPOLINE_BASE 0x8000
+#define TRAMPOLINE_PAGE (TRAMPOLINE_BASE >> 12)
+
+// 4MB page identity mapping the first 4MB, present and writable.
+#define PDE_IDENTITY 0x83
+
+// How long we wait, in microseconds, for each step of starting an application processor.
+#define INIT_DELAY 10000
+#define STARTUP_DELAY 200
+#define ONLINE_TIMEOUT 100000
+
+// Defined in x86/trampoline.asm
+extern uint8_t trampoline_start[];
+extern uint8_t trampoline_end[];
+extern uint8_t trampoline_cr3[];
+extern uint8_t trampoline_stack[];
+extern uint8_t trampoline_entry[];
+
+// The boot processor is online from the start, the rest are brought up in smp_init.
+struct cpu cpus[MAX_CPUS] = { [0] = { .online = true } };
+uint32_t nr_cpus = 1;
+
+// Processors are started one at a time, each finding out who it is (and its stack) from here.
+static struct cpu *volatile booting_cpu;
+static volatile uint32_t booting_stack;
+
+// Set once all processors have been started, and the trampoline is no longer needed.
+static volatile bool smp_released;
+
+// Where a label of the trampoline ends up once copied, in the higher half.
+static void *trampoline_address(uint8_t *label) {
+	return (void *) (0xC0000000 + TRAMPOLINE_BASE + (uint32_t) (label - trampoline_start));
+}
+
+static int reschedule_interrupt(struct registers *UNUSED(regs), void *UNUSED(data)) {
+	// Whoever sent this has already marked our current task as needing to be rescheduled,
+	// which happens on our way out of the interrupt. We may also have a slice to run out now.
+	tick_nohz_update();
+	return IRQ_HANDLED;
+}
+
+// Where application processors arrive from the trampoline, on their own stack.
+static void ap_start() {
+	struct cpu *cpu = booting_cpu;
+	uint32_t stack = booting_stack;
+
+	gdt_init_cpu(cpu);
+	idt_init_cpu();
+	fpu_init_cpu();
+	lapic_enable();
+	lapic_timer_init_cpu();
+	cpu->online = true;
+
+	// Wait until the boot processor is done with the identity mapping used by the trampoline, and
+	// make sure we do not keep it around in our TLB.
+	while (!smp_released) {
+		cpu_relax();
+	}
+	asm volatile ("invlpg (0)" ::: "memory");
+
+	sched_init_ap(stack);
+}
+
+// Sends the INIT-SIPI-SIPI sequence, as described in the Intel MultiProcessor Specification.
+static bool start_ap(struct cpu *cpu) {
+	booting_cpu = cpu;
+	booting_stack = alloc_block();
+	*(uint32_t *) trampoline_address(trampoline_stack) = booting_stack + PAGE_SIZE;
+
+	lapic_send_ipi(cpu->apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT | LAPIC_ICR_LEVEL);
+	lapic_send_ipi(cpu->apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL);
+	udelay(INIT_DELAY);
+
+	// Modern processors start on the first Startup IPI, older ones may need the second.
+	for (uint32_t i = 0; i < 2 && !cpu->online; i++) {
+		lapic_send_ipi(cpu->apic_id, LAPIC_ICR_STARTUP | TRAMPOLINE_PAGE);
+		udelay(STARTUP_DELAY);
+	}
+
+	for (uint32_t waited = 0; waited < ONLINE_TIMEOUT && !cpu->online; waited += 100) {
+		udelay(100);
+	}
+
+	return cpu->online;
+}
+
+uint32_t smp_init() {
+	if (!cpu_has(CPUID_FEAT_EDX_APIC) || !mp_init()) {
+		KWARNING("No MP tables found, continuing with only the boot processor...");
+		return 1;
+	}
+
+	lapic_init(mp_info.lapic_address ? mp_info.lapic_address : LAPIC_DEFAULT_ADDRESS);
+	lapic_enable();
+	cpus[0].apic_id = lapic_id();
+	request_irq(IPI_RESCHEDULE, reschedule_interrupt, 0, "reschedule", NULL);
+
+	// Route device interrupts through the I/O APIC from now on.
+	ioapic_init();
+
+	// Every processor needs a tick of its own, which the PIT can not give them.
+	if (!lapic_timer_init()) {
+		KWARNING("Continuing with only the boot processor...");
+		return 1;
+	}
+
+	if (nr_cpus == 1) {
+		return 1;
+	}
+
+	memcpy((void *) (0xC0000000 + TRAMPOLINE_BASE), trampoline_start, (size_t) (trampoline_end - trampoline_start));
+
+	// Processors start out at physical addresses, so they need the first 4MB identity mapped for as
+	// long as they are in the trampoline, and the page directory has to be reachable from there too.
+	uint32_t cr3;
+	asm volatile ("mov %%cr3, %0" : "=r" (cr3));
+	uint32_t *pd = (uint32_t *) (cr3 + 0xC0000000);
+	uint32_t old_pde = pd[0];
+	pd[0] = PDE_IDENTITY;
+	asm volatile ("invlpg (0)" ::: "memory");
+
+	*(uint32_t *) trampoline_address(trampoline_cr3) = cr3;
+	*(uint32_t *) trampoline_address(trampoline_entry) = (uint32_t) ap_start;
+
+	for (uint32_t i = 1; i < nr_cpus; i++) {
+		if (!start_ap(&cpus[i])) {
+			KWARNING("CPU %d (LAPIC %d) failed to start!", i, cpus[i].apic_id);
+		}
+	}
+
+	pd[0] = old_pde;
+	asm volatile ("invlpg (0)" ::: "memory");
+	smp_released = true;
+
+	return num_online_cpus();
+}
+
+uint32_t num_online_cpus() {
+	uint32_t count = 0;
+	struct cpu *cpu;
+	for_each_online_cpu(cpu) {
+		count++;
+	}
+
+	return count;
+}
+
+void smp_send_reschedule(uint32_t cpu) {
+	lapic_send_ipi(cpus[cpu].apic_id, LAPIC_ICR_FIXED | IPI_RESCHEDULE);
+}
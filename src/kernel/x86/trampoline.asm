@@ -0,0 +1,90 @@
+; trampoline.asm -- Where application processors begin executing
+
+; Application processors start out in real mode at the page given in the Startup IPI, so this
+; code is copied down to TRAMPOLINE_BASE in low memory (see x86/smp.c) before starting each one.
+; It switches to protected mode, enables paging with the kernel's page directory, and then jumps
+; into the higher half. Until paging is enabled we run at physical addresses, and right after it
+; we still do, so the first 4MB must be identity mapped for as long as the trampoline is in use.
+TRAMPOLINE_BASE equ 0x8000
+
+; Translates the address of a label below to where it ends up once copied.
+%define TRAMPOLINE(label) (TRAMPOLINE_BASE + (label - trampoline_start))
+
+; Same as in boot.asm: Enable 4MB pages (CR4.PSE), protected mode (CR0.PE), and paging (CR0.PG)
+CR4_PSE equ 0x00000010
+CR0_PE equ 0x00000001
+CR0_PG equ 0x80000000
+
+section .text
+
+global trampoline_start
+global trampoline_end
+global trampoline_cr3
+global trampoline_stack
+global trampoline_entry
+
+bits 16
+
+	trampoline_start:
+		cli
+		cld
+
+		; The Startup IPI sets CS to the page we are at, but the rest are left undefined
+		xor ax, ax
+		mov ds, ax
+
+		; Load a flat GDT of our own, as the kernel's is out of reach in the higher half
+		o32 lgdt [TRAMPOLINE(trampoline_gdt_ptr)]
+
+		mov eax, cr0
+		or eax, CR0_PE
+		mov cr0, eax
+
+		; Far jump to flush the prefetched real mode instructions and load the code segment
+		jmp dword 0x08:TRAMPOLINE(trampoline_protected)
+
+bits 32
+
+	trampoline_protected:
+		mov ax, 0x10
+		mov ds, ax
+		mov es, ax
+		mov ss, ax
+
+		mov eax, cr4
+		or eax, CR4_PSE
+		mov cr4, eax
+
+		mov eax, [TRAMPOLINE(trampoline_cr3)]
+		mov cr3, eax
+
+		mov eax, cr0
+		or eax, CR0_PG
+		mov cr0, eax
+
+		; Switch to the stack allocated for us, and leave the trampoline for the higher half for good.
+		mov esp, [TRAMPOLINE(trampoline_stack)]
+		xor ebp, ebp
+		mov eax, [TRAMPOLINE(trampoline_entry)]
+		jmp eax
+
+	align 8
+	trampoline_gdt:
+		; Null, code, and data descriptors, with the same layout as the kernel's.
+		dq 0
+		dq 0x00CF9A000000FFFF
+		dq 0x00CF92000000FFFF
+
+	trampoline_gdt_ptr:
+		dw (trampoline_gdt_ptr - trampoline_gdt - 1)
+		dd TRAMPOLINE(trampoline_gdt)
+
+	; Filled in by the boot processor before starting each application processor
+	trampoline_cr3:
+		dd 0
+	trampoline_stack:
+		dd 0
+	trampoline_entry:
+		dd 0
+
+	trampoline_end:
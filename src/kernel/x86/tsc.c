@@ -0,0 +1,84 @@
+#include <include/x86/tsc.h>
+#include <include/x86/cpu.h>
+#include <include/x86/io_port.h>
+#include <include/x86/irqflags.h>
+#include <include/drivers/timer.h>
+#include <include/kernel/time.h>
+#include <include/kernel/logger.h>
+#include <include/helpers.h>
+
+// Controls the gate of PIT channel 2 and the PC speaker, which it normally drives.
+#define PIT_PORT_B 0x61
+#define PIT_PORT_B_GATE2 1 << 0
+#define PIT_PORT_B_SPEAKER 1 << 1
+// Output of channel 2, which goes high once it counts down to zero in mode 0.
+#define PIT_PORT_B_OUT2 1 << 5
+
+// Channel 2, mode 0: count down once
+#define PIT_CHANNEL2_ONESHOT 0xB0
+
+// How long each calibration run lasts, and how many runs are made.
+#define CALIBRATE_MS 10
+#define CALIBRATE_RUNS 5
+
+uint32_t tsc_khz;
+
+static uint64_t tsc_read() {
+	return rdtsc();
+}
+
+static struct clocksource tsc_clocksource = {
+	.name = "TSC",
+	.read = tsc_read,
+};
+
+/*
+	Counts how many cycles pass while PIT channel 2 counts down for CALIBRATE_MS. Channel 2 is used
+	as, unlike channel 0, it can be polled for completion without an interrupt, and it is not
+	otherwise used by us (it drives the PC speaker, which we keep disconnected).
+*/
+static uint64_t pit_calibrate_tsc() {
+	uint16_t count = PIT_FREQUENCY * CALIBRATE_MS / 1000;
+	uint8_t port_b = inb(PIT_PORT_B);
+
+	outb(PIT_PORT_B, (uint8_t) ((port_b & ~(PIT_PORT_B_SPEAKER)) | PIT_PORT_B_GATE2));
+	outb(PIT_COMMAND, PIT_CHANNEL2_ONESHOT);
+	outb(PIT_CHANNEL2, (uint8_t) (count & 0xFF));
+	outb(PIT_CHANNEL2, (uint8_t) ((count >> 8) & 0xFF));
+
+	uint64_t start = rdtsc_ordered();
+	while (!(inb(PIT_PORT_B) & (PIT_PORT_B_OUT2)))
+		;
+	uint64_t end = rdtsc_ordered();
+
+	outb(PIT_PORT_B, port_b);
+	return end - start;
+}
+
+void tsc_init() {
+	if (!cpu_has(CPUID_FEAT_EDX_TSC)) {
+		KWARNING("No Time Stamp Counter, falling back to jiffies for timekeeping");
+		return;
+	}
+
+	// Anything interrupting us (such as an SMI stealing cycles) can only ever make a run take
+	// longer, so the shortest run is the most accurate.
+	uint32_t flags = irq_save();
+	uint64_t cycles = UINT64_MAX;
+	for (int i = 0; i < CALIBRATE_RUNS; i++) {
+		uint64_t run = pit_calibrate_tsc();
+		cycles = MIN(cycles, run);
+	}
+	irq_restore(flags);
+
+	uint32_t rem;
+	tsc_khz = (uint32_t) div_u64_rem(cycles, CALIBRATE_MS, &rem);
+	KDEBUG("TSC: %d cycles over %dms", (uint32_t) cycles, CALIBRATE_MS);
+
+	// Without an invariant TSC, its rate changes with the frequency of the processor.
+	if (cpuid(0x80000000).eax < 0x80000007 || !(cpuid(0x80000007).edx & (CPUID_APM_EDX_INVARIANT_TSC))) {
+		KDEBUG("TSC is not invariant, and may drift if the processor changes frequency");
+	}
+
+	clocksource_register(&tsc_clocksource, tsc_khz);
+}
@@ -2,10 +2,15 @@
 #define _STDIO_H
 
 #include <sys/cdefs.h>
+#include <stdarg.h>
+#include <stddef.h>
 
 int printf(const char* __restrict, ...);
 int putchar(int);
 int puts(const char*);
 int sprintf(char *out, const char *format, ...);
+int snprintf(char *out, size_t size, const char *format, ...);
+int vsprintf(char *out, const char *format, va_list args);
+int vsnprintf(char *out, size_t size, const char *format, va_list args);
 
 #endif
@@ -10,5 +10,6 @@ void* memcpy(void* __restrict, const void* __restrict, size_t);
 void* memmove(void*, const void*, size_t);
 void* memset(void*, int, size_t);
 size_t strlen(const char*);
+int strcmp(const char*, const char*);
 
 #endif
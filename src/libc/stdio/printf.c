@@ -22,14 +22,23 @@
 */
 
 #include <stdarg.h>
+#include <stddef.h>
 
-static void printchar(char **str, int c)
+/* Where output goes when not to the console: the string at pos, cut off at end (if not NULL) */
+struct out {
+	char *pos;
+	char *end;
+};
+
+static void printchar(struct out *str, int c)
 {
 	extern int putchar(int c);
 	
 	if (str) {
-		**str = c;
-		++(*str);
+		if (!str->end || str->pos < str->end) {
+			*str->pos = c;
+			++str->pos;
+		}
 	}
 	else (void)putchar(c);
 }
@@ -37,7 +46,7 @@ static void printchar(char **str, int c)
 #define PAD_RIGHT 1
 #define PAD_ZERO 2
 
-static int prints(char **out, const char *string, int width, int pad)
+static int prints(struct out *out, const char *string, int width, int pad)
 {
 	register int pc = 0, padchar = ' ';
 
@@ -70,7 +79,7 @@ static int prints(char **out, const char *string, int width, int pad)
 /* the following should be enough for 32 bit int */
 #define PRINT_BUF_LEN 12
 
-static int printi(char **out, int i, int b, int sg, int width, int pad, int letbase)
+static int printi(struct out *out, int i, int b, int sg, int width, int pad, int letbase)
 {
 	char print_buf[PRINT_BUF_LEN];
 	register char *s;
@@ -113,7 +122,7 @@ static int printi(char **out, int i, int b, int sg, int width, int pad, int letb
 	return pc + prints (out, s, width, pad);
 }
 
-static int print(char **out, const char *format, va_list args )
+static int print(struct out *out, const char *format, va_list args )
 {
 	register int width, pad;
 	register int pc = 0;
@@ -172,23 +181,56 @@ static int print(char **out, const char *format, va_list args )
 			++pc;
 		}
 	}
-	if (out) **out = '\0';
-	va_end( args );
+	if (out) *out->pos = '\0';
 	return pc;
 }
 
 int printf(const char *format, ...)
 {
         va_list args;
+        int ret;
         
         va_start( args, format );
-        return print( 0, format, args );
+        ret = print( 0, format, args );
+        va_end( args );
+        return ret;
 }
 
 int sprintf(char *out, const char *format, ...)
 {
         va_list args;
+        int ret;
+        
+        va_start( args, format );
+        ret = vsprintf( out, format, args );
+        va_end( args );
+        return ret;
+}
+
+int vsprintf(char *out, const char *format, va_list args)
+{
+        struct out str = { out, NULL };
+        return print( &str, format, args );
+}
+
+/* Writes at most size - 1 characters and a terminator, returning how many would have been written */
+int vsnprintf(char *out, size_t size, const char *format, va_list args)
+{
+        char scratch;
+        struct out str = { out, out + size - 1 };
+
+        /* Not even the terminator fits */
+        if (!size) str.pos = str.end = &scratch;
+        return print( &str, format, args );
+}
+
+int snprintf(char *out, size_t size, const char *format, ...)
+{
+        va_list args;
+        int ret;
         
         va_start( args, format );
-        return print( &out, format, args );
-}
\ No newline at end of file
+        ret = vsnprintf( out, size, format, args );
+        va_end( args );
+        return ret;
+}
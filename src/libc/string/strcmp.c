@@ -0,0 +1,13 @@
+#include <string.h>
+
+int strcmp(const char *first, const char *second) {
+	const unsigned char *a = (const unsigned char *) first;
+	const unsigned char *b = (const unsigned char *) second;
+
+	while (*a && *a == *b) {
+		a++;
+		b++;
+	}
+
+	return *a - *b;
+}